@@ -3,16 +3,51 @@
 
 #define DEBUG
 //#define DIFF_TEST
+#define DECODE_CACHE
+
+#define BLOCK_CACHE
+
+/* Simulate the caches on every memory access, see include/memory/cache.h */
+//#define CACHE_SIM
+
+/* Simulate branch predictors on every jump, see include/cpu/bpred.h */
+//#define BRANCH_SIM
 
 #if _SHARE
 // do not enable these features while building a reference design
 #undef DIFF_TEST
 #undef DEBUG
+#undef CACHE_SIM
+#undef BRANCH_SIM
+// a reference runs instruction by instruction, to check the faster builds
+#undef BLOCK_CACHE
+#endif
+
+#define JIT
+
+#ifdef CACHE_SIM
+// instructions are then fetched every time they are executed
+#undef DECODE_CACHE
+#endif
+
+#if defined(DEBUG) || !defined(DECODE_CACHE)
+// tracing works instruction by instruction, and blocks are built
+// from the decode cache
+#undef BLOCK_CACHE
+#endif
+
+#if !defined(BLOCK_CACHE) || !defined(__x86_64__) || defined(BRANCH_SIM)
+// the JIT compiles blocks into x86-64 code, which does not report jumps
+#undef JIT
 #endif
 
 /* You will define this macro in PA2 */
 //#define HAS_IOE
 
+/* Present the screen and handle SDL events in a thread of their own,
+ * so that emulation does not wait for the display */
+//#define RENDER_THREAD
+
 #include <stdint.h>
 #include <assert.h>
 #include <string.h>
@@ -0,0 +1,37 @@
+#ifndef __CPU_BPRED_H__
+#define __CPU_BPRED_H__
+
+#include "common.h"
+
+/* Models of branch predictors. The RTL jump instructions report every
+ * control transfer, and the control helpers mark the calls and returns
+ * before jumping. All direction predictors see the same branches, and
+ * the one selected with -B is used for the per-branch statistics and
+ * for the cycle count. Enable it with BRANCH_SIM in include/common.h.
+ */
+
+enum { BP_JUMP, BP_CALL, BP_RET };
+
+#ifdef BRANCH_SIM
+extern __thread int bpred_type;
+extern __thread vaddr_t bpred_link;
+
+void bpred_cond(vaddr_t pc, vaddr_t target, bool taken);
+void bpred_jump(vaddr_t pc, vaddr_t target, bool is_indirect);
+
+static inline void bpred_call(vaddr_t link) { bpred_type = BP_CALL; bpred_link = link; }
+static inline void bpred_ret(void) { bpred_type = BP_RET; }
+#else
+static inline void bpred_call(vaddr_t link) {}
+static inline void bpred_ret(void) {}
+#endif
+
+void init_bpred(const char *name);
+/* Each thread running a machine or a hart has predictors of its own. */
+void init_bpred_state(void);
+void free_bpred_state(void);
+bool bpred_enabled(void);
+uint64_t bpred_nr_miss(void);
+void bpred_statistic(void);
+
+#endif
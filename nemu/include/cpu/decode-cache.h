@@ -0,0 +1,62 @@
+#ifndef __CPU_DECODE_CACHE_H__
+#define __CPU_DECODE_CACHE_H__
+
+#include "cpu/exec.h"
+
+#ifdef DECODE_CACHE
+
+/* longest instruction among the supported ISAs (x86) */
+#define MAX_INSTR_LEN 15
+
+typedef struct {
+  vaddr_t pc;
+  int len;
+  paddr_t paddr, paddr_last;  // physical addresses of the first and the last byte
+  EHelper execute;
+  DecodeInfo info;
+#ifdef DEBUG
+  uint8_t bytes[MAX_INSTR_LEN];
+#endif
+} DecodedInstr;
+
+typedef struct {
+  bool valid;
+  DecodedInstr di;
+} DCacheEntry;
+
+// no larger than PAGE_SIZE, so that the pc and its paddr index the same entry
+#define DCACHE_SIZE 4096
+
+void dcache_replay(DecodedInstr *di);
+DecodedInstr *dcache_last(void);
+
+/* Code is tracked with this granularity, by physical address. A store
+ * into a tracked chunk flushes the cached decodings of the instructions
+ * overlapping it, on every hart.
+ */
+#define DCACHE_CHUNK_SHIFT 8
+#define NR_CODE_CHUNK (PMEM_SIZE >> DCACHE_CHUNK_SHIFT)
+
+// points into the context of the machine
+extern __thread uint8_t *dcache_code_map;
+
+void dcache_fetch(paddr_t addr, int len);
+void dcache_flush_chunk(paddr_t addr);
+void dcache_drop_chunk(paddr_t addr);
+void dcache_flush_all(void);
+
+static inline void dcache_check_write(paddr_t addr, int len) {
+  uint32_t mask = NR_CODE_CHUNK - 1;
+  uint32_t first = (addr >> DCACHE_CHUNK_SHIFT) & mask;
+  uint32_t last = ((addr + len - 1) >> DCACHE_CHUNK_SHIFT) & mask;
+  if (dcache_code_map[first]) dcache_flush_chunk(addr);
+  if (last != first && dcache_code_map[last]) dcache_flush_chunk(addr + len - 1);
+}
+
+#else
+#define dcache_fetch(addr, len)
+#define dcache_check_write(addr, len)
+#define dcache_flush_all()
+#endif
+
+#endif
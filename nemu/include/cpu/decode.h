@@ -9,6 +9,12 @@ typedef void (*DHelper) (vaddr_t *);
 #define OP_STR_SIZE 40
 enum { OP_TYPE_REG, OP_TYPE_MEM, OP_TYPE_IMM };
 
+/* How `val' and `addr' of an operand are (re)computed from the machine state.
+ * The decode helpers record this so that the decode cache can replay a
+ * decoding without fetching and decoding the instruction again.
+ */
+enum { OP_RELOAD_REG = 0x1, OP_RELOAD_MEM = 0x2, OP_RELOAD_ADDR = 0x4 };
+
 typedef struct {
   uint32_t type;
   int width;
@@ -19,9 +25,38 @@ typedef struct {
     int32_t simm;
   };
   rtlreg_t val;
+  struct {
+    uint8_t flags;
+    uint8_t width;        // width of the register loaded into `val'
+    uint8_t reg;          // `reg' may be overwritten by `addr' in the union
+    int8_t base, index;   // -1 if not used
+    uint8_t scale;
+    int32_t disp;
+  } reload;
   char str[OP_STR_SIZE];
 } Operand;
 
+/* val <- reg[op->reg][width * 8 - 1 .. 0] */
+static inline void op_reload_reg(Operand *op, int width) {
+  op->reload.flags |= OP_RELOAD_REG;
+  op->reload.width = width;
+  op->reload.reg = op->reg;
+}
+
+/* val <- M[addr] */
+static inline void op_reload_mem(Operand *op) {
+  op->reload.flags |= OP_RELOAD_MEM;
+}
+
+/* addr <- disp + reg[base] + (reg[index] << scale) */
+static inline void op_reload_addr(Operand *op, int base, int index, int scale, int32_t disp) {
+  op->reload.flags |= OP_RELOAD_ADDR;
+  op->reload.base = base;
+  op->reload.index = index;
+  op->reload.scale = scale;
+  op->reload.disp = disp;
+}
+
 #include "isa/decode.h"
 
 typedef struct {
@@ -37,7 +72,7 @@ typedef struct {
 void operand_write(Operand *, rtlreg_t *);
 
 /* shared by all helper functions */
-extern DecodeInfo decinfo;
+extern __thread DecodeInfo decinfo;
 
 #define id_src (&decinfo.src)
 #define id_src2 (&decinfo.src2)
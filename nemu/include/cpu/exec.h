@@ -4,6 +4,7 @@
 #include "nemu.h"
 #include "monitor/diff-test.h"
 #include "rtl/rtl.h"
+#include "monitor/itrace.h"
 
 #define make_EHelper(name) void concat(exec_, name) (vaddr_t *pc)
 typedef void (*EHelper) (vaddr_t *);
@@ -23,23 +24,25 @@ typedef struct {
 #define EMPTY              EX(inv)
 
 static inline uint32_t instr_fetch(vaddr_t *pc, int len) {
-  uint32_t instr = vaddr_read(*pc, len);
+  uint32_t instr = vaddr_ifetch(*pc, len);
 #ifdef DEBUG
-  uint8_t *p_instr = (void *)&instr;
-  int i;
-  for (i = 0; i < len; i ++) {
-    extern char log_bytebuf[];
-    strcatf(log_bytebuf, "%02x ", p_instr[i]);
-  }
+  itrace_bytes(&instr, len);
 #endif
   (*pc) += len;
   return instr;
 }
 
+#ifdef DECODE_CACHE
+void dcache_snapshot(EHelper execute);
+#endif
+
 /* Instruction Decode and EXecute */
 static inline void idex(vaddr_t *pc, OpcodeEntry *e) {
   if (e->decode)
     e->decode(pc);
+#ifdef DECODE_CACHE
+  dcache_snapshot(e->execute);
+#endif
   e->execute(pc);
 }
 
@@ -51,10 +54,12 @@ static inline void update_pc(void) {
 void display_inv_msg(vaddr_t pc);
 
 #ifdef DEBUG
+// the assembly is only formatted for instructions to be printed
 #define print_asm(...) \
   do { \
-    extern char log_asmbuf[]; \
-    strcatf(log_asmbuf, __VA_ARGS__); \
+    extern __thread bool log_asm_enable; \
+    extern __thread char log_asmbuf[]; \
+    if (log_asm_enable) strcatf(log_asmbuf, __VA_ARGS__); \
   } while (0)
 #else
 #define print_asm(...)
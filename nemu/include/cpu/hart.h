@@ -0,0 +1,47 @@
+#ifndef __CPU_HART_H__
+#define __CPU_HART_H__
+
+#include "common.h"
+
+/* Multiple harts sharing pmem. Each hart runs on a host thread of its
+ * own, with its own thread-local CPU state and caches. Hart 0 is the
+ * thread of the monitor, and the only one with devices: an I/O access
+ * by another hart is passed to hart 0, which serves it at its next
+ * event check.
+ *
+ * The other harts start when the guest writes their entry to the MPE
+ * device, and only run while hart 0 is in cpu_exec(). The machine ends
+ * as soon as any hart ends. The harts share the map of cached code: a
+ * store into code cached by any hart makes every hart flush it at its
+ * next event check. Watchpoints are shared too, and a hit on any hart
+ * stops all of them.
+ */
+
+#define MAX_HART 8
+
+extern int nr_hart;
+extern __thread int hart_id;
+
+void init_hart(int n, bool jit);
+bool hart_started(void);
+
+/* called by hart 0 when entering and leaving cpu_exec() */
+void hart_resume(void);
+void hart_pause(void);
+/* called by every hart at its event checks */
+void hart_check(void);
+void hart_flush_code(paddr_t addr);
+void hart_request_stop(void);
+
+/* I/O of the harts other than hart 0 */
+uint32_t hart_io_read(paddr_t addr, int len, bool is_pio);
+void hart_io_write(paddr_t addr, uint32_t data, int len, bool is_pio);
+
+/* the device interface */
+int hart_io_id(void);
+void hart_start(vaddr_t pc);
+void hart_stop(int id);
+
+void hart_statistic(void);
+
+#endif
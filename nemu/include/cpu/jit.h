@@ -0,0 +1,64 @@
+#ifndef __CPU_JIT_H__
+#define __CPU_JIT_H__
+
+#include "common.h"
+#include "cpu/decode.h"
+
+#ifdef JIT
+
+/* The JIT traces the RTL instructions executed by a hot block and
+ * compiles them into host code. Execution helpers should therefore
+ * express their semantics with RTL instructions only. A helper which
+ * has other side effects, or which reads the machine state with plain C
+ * code, must call jit_barrier() so that the block is left to the
+ * interpreter.
+ */
+
+enum {
+  JIT_LI, JIT_MV,
+  JIT_ADD, JIT_SUB, JIT_AND, JIT_OR, JIT_XOR, JIT_SHL, JIT_SHR, JIT_SAR,
+  JIT_MUL_LO, JIT_MUL_HI, JIT_IMUL_LO, JIT_IMUL_HI,
+  JIT_DIV_Q, JIT_DIV_R, JIT_IDIV_Q, JIT_IDIV_R,
+  JIT_DIV64_Q, JIT_DIV64_R, JIT_IDIV64_Q, JIT_IDIV64_R,
+  JIT_LM, JIT_SM, JIT_HOST_LM, JIT_HOST_SM,
+  JIT_SETRELOP, JIT_J, JIT_JR, JIT_JRELOP,
+  JIT_INSTR,  // marks the beginning of a guest instruction
+};
+
+typedef uint32_t (*JitCode)(void);
+
+#define MAX_IR 8192
+
+typedef struct {
+  uint8_t op;
+  uint8_t aux;         // length of memory access, or relop
+  uint8_t is_const;    // JIT_SRC_CONST(i) if src[i] is an immediate
+  void *dest;
+  const void *src[3];
+  uint32_t cval[3];
+  uint32_t imm;
+} JitIR;
+
+extern __thread bool jit_recording;
+
+void jit_rec(int op, const void *dest, const void *src1, const void *src2,
+    const void *src3, uint32_t imm, int aux);
+void jit_record_fail(void);
+void jit_record_begin(void);
+void jit_record_instr(vaddr_t pc, vaddr_t seq_pc, const DecodeInfo *info);
+JitCode jit_record_end(int nr_instr, bool *full);
+void jit_flush(void);
+bool jit_is_enabled(void);
+void jit_statistic(void);
+
+static inline void jit_barrier(void) {
+  if (jit_recording) jit_record_fail();
+}
+
+#else
+#define jit_barrier()
+#endif
+
+void init_jit(bool enable);
+
+#endif
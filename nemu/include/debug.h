@@ -6,6 +6,13 @@
 #include <assert.h>
 #include "monitor/log.h"
 
+/* Report a failed assertion and abort NEMU, or only the machine of the
+ * current thread if it runs in a pool (see src/monitor/pool.c). */
+void __attribute__((noreturn)) assert_fail(const char *cond, const char *file, int line, const char *func);
+
+#undef assert
+#define assert(cond) ((cond) ? (void)0 : assert_fail(#cond, __FILE__, __LINE__, __func__))
+
 #define Log(format, ...) \
     _Log("\33[1;34m[%s,%d,%s] " format "\33[0m\n", \
         __FILE__, __LINE__, __func__, ## __VA_ARGS__)
@@ -13,11 +20,12 @@
 #define Assert(cond, ...) \
   do { \
     if (!(cond)) { \
+      log_flush(); \
       fflush(stdout); \
       fprintf(stderr, "\33[1;31m"); \
       fprintf(stderr, __VA_ARGS__); \
       fprintf(stderr, "\33[0m\n"); \
-      assert(cond); \
+      assert_fail(#cond, __FILE__, __LINE__, __func__); \
     } \
   } while (0)
 
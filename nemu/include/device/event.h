@@ -0,0 +1,26 @@
+#ifndef __DEVICE_EVENT_H__
+#define __DEVICE_EVENT_H__
+
+#include "common.h"
+
+/* Devices register periodic events, which are run by the CPU loop once
+ * `g_nr_guest_instr' reaches `event_next'.
+ *
+ * By default time is measured in guest instructions, at EVENT_CLOCK_HZ
+ * instructions per second, so that a run is reproducible. In the
+ * wall-clock mode (-w), time is the host time, and a timer signal sets
+ * `event_next' to 0 when an event may be due.
+ */
+
+#define EVENT_CLOCK_HZ (100 * 1000 * 1000)
+
+typedef void(*event_callback_t)(void);
+
+extern __thread uint64_t g_nr_guest_instr;
+extern __thread volatile uint64_t event_next;
+
+void add_event(const char *name, int hz, event_callback_t callback);
+void event_run(void);
+uint64_t event_clock_us(void);
+
+#endif
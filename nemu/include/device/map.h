@@ -4,6 +4,14 @@
 #include "common.h"
 #include "monitor/diff-test.h"
 
+#define IO_SPACE_MAX (1024 * 1024)
+#define PORT_IO_SPACE_MAX 65535
+#define NR_IO_MAP 32
+
+#define MMIO_PAGE_SHIFT 12
+#define MMIO_L1_BITS 10
+#define MMIO_L2_BITS (32 - MMIO_PAGE_SHIFT - MMIO_L1_BITS)
+
 typedef void(*io_callback_t)(uint32_t, int, bool);
 uint8_t* new_space(int size);
 
@@ -16,23 +24,16 @@ typedef struct {
   io_callback_t callback;
 } IOMap;
 
+typedef IOMap** MMIOPage;
+
 static inline bool map_inside(IOMap *map, paddr_t addr) {
   return (addr >= map->low && addr <= map->high);
 }
 
-static inline int find_mapid_by_addr(IOMap *maps, int size, paddr_t addr) {
-  int i;
-  for (i = 0; i < size; i ++) {
-    if (map_inside(maps + i, addr)) {
-      difftest_skip_ref();
-      return i;
-    }
-  }
-  return -1;
-}
-
 void add_pio_map(char *name, ioaddr_t addr, uint8_t *space, int len, io_callback_t callback);
 void add_mmio_map(char *name, paddr_t addr, uint8_t* space, int len, io_callback_t callback);
+IOMap* new_map(char *name, paddr_t addr, uint8_t *space, int len, io_callback_t callback);
+void free_mmio_table(void);
 
 uint32_t map_read(paddr_t addr, int len, IOMap *map);
 void map_write(paddr_t addr, uint32_t data, int len, IOMap *map);
@@ -0,0 +1,15 @@
+#ifndef __DEVICE_PERFCNT_H__
+#define __DEVICE_PERFCNT_H__
+
+#include "common.h"
+
+/* Events counted for the performance counter device. Misses are counted
+ * by the components modeling them, and are collected when read. */
+typedef struct {
+  uint64_t load, store;
+  uint64_t branch;    // taken branches
+} PerfCnt;
+
+extern __thread PerfCnt perfcnt;
+
+#endif
@@ -0,0 +1,32 @@
+#ifndef __MEMORY_CACHE_H__
+#define __MEMORY_CACHE_H__
+
+#include "common.h"
+
+/* A model of the memory hierarchy: split L1 caches backed by a unified
+ * L2, all set-associative, write-back and write-allocate. It only counts
+ * hits and misses of the accesses to pmem, and never holds any data.
+ * Enable it with CACHE_SIM in include/common.h.
+ */
+
+enum { CACHE_L1I, CACHE_L1D, CACHE_L2, NR_CACHE };
+enum { CACHE_READ, CACHE_WRITE, CACHE_FETCH };
+
+#ifdef CACHE_SIM
+void cache_access(paddr_t addr, int len, int type);
+#endif
+
+/* `spec' is a comma-separated list of `level:size:line:assoc:policy',
+ * where level is l1i, l1d or l2, and policy is lru, plru or random,
+ * such as "l1d:16K:32:4:plru,l2:1M:64:16:lru". Fields left empty keep
+ * their defaults. A level of size 0 misses on every access.
+ */
+void init_cache(const char *spec);
+/* Each thread running a machine or a hart has caches of its own. */
+void init_cache_state(void);
+void free_cache_state(void);
+bool cache_enabled(void);
+uint64_t cache_nr_miss(int level);
+void cache_statistic(void);
+
+#endif
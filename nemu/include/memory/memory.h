@@ -4,7 +4,7 @@
 #include "common.h"
 
 #define PMEM_SIZE (128 * 1024 * 1024)
-extern uint8_t pmem[];
+extern __thread uint8_t *pmem;
 
 #define IMAGE_START 0x100000
 
@@ -13,13 +13,22 @@ extern uint8_t pmem[];
 /* convert the host virtual address in NEMU to guest physical address in the guest program */
 #define host_to_guest(p) ((paddr_t)((void *)p - (void *)pmem))
 
+void init_mem(void);
+void attach_mem(uint8_t *mem);
+void free_mem(void);
 void register_pmem(paddr_t base);
 
 uint32_t isa_vaddr_read(vaddr_t, int);
+uint32_t isa_vaddr_ifetch(vaddr_t, int);
 void isa_vaddr_write(vaddr_t, uint32_t, int);
+uint32_t isa_vaddr_atomic(vaddr_t, uint32_t, int, int);
+bool isa_vaddr_cas(vaddr_t, uint32_t, uint32_t);
 
 #define vaddr_read isa_vaddr_read
+#define vaddr_ifetch isa_vaddr_ifetch
 #define vaddr_write isa_vaddr_write
+#define vaddr_atomic isa_vaddr_atomic
+#define vaddr_cas isa_vaddr_cas
 
 uint32_t paddr_read(paddr_t, int);
 void paddr_write(paddr_t, uint32_t, int);
@@ -28,4 +37,16 @@ void paddr_write(paddr_t, uint32_t, int);
 #define PAGE_MASK         (PAGE_SIZE - 1)
 #define PG_ALIGN __attribute((aligned(PAGE_SIZE)))
 
+/* the checksum of a page, which DUT and REF of differential testing
+ * compute the same way to compare their memory */
+static inline uint64_t page_sum(const void *page) {
+  const uint64_t *p = page;
+  uint64_t sum = 0;
+  int i;
+  for (i = 0; i < PAGE_SIZE / sizeof(uint64_t); i ++) {
+    sum = (sum ^ p[i]) * 0x100000001b3ull;
+  }
+  return sum;
+}
+
 #endif
@@ -0,0 +1,45 @@
+#ifndef __MEMORY_TLB_H__
+#define __MEMORY_TLB_H__
+
+#include "common.h"
+
+/* A direct-mapped software TLB shared by all ISAs. An entry maps a
+ * virtual page to the host address of its physical page in pmem, with
+ * the accesses it allows. Pages outside pmem are never cached, and are
+ * accessed through paddr_read() and paddr_write().
+ */
+
+enum { TLB_R = 0x1, TLB_W = 0x2, TLB_X = 0x4 };
+
+/* Provided by the ISA: translate the page of `vaddr' for an access of
+ * `type', and set `*perm' to the accesses allowed on the page. Only
+ * `type' is required to be allowed, so that a walk can grant TLB_W
+ * only when it has set the dirty bit. On a fault, `*perm' is set
+ * without `type'.
+ */
+paddr_t isa_tlb_walk(vaddr_t vaddr, int type, int *perm);
+
+/* Provided by the ISA: raise the exception of an access of `type' at
+ * `vaddr' which faulted, as the instruction at `pc' does. The
+ * instruction is abandoned before, see cpu_fault().
+ */
+void isa_tlb_fault(vaddr_t vaddr, int type, vaddr_t pc);
+
+uint32_t tlb_read(vaddr_t addr, int len, int type);
+void tlb_write(vaddr_t addr, uint32_t data, int len);
+
+/* Atomic read-modify-write of pmem, performed with host atomics so that
+ * they are atomic to the plain accesses of the other harts. Only
+ * ATOMIC_SWAP supports a `len' other than 4. Return the old value.
+ */
+enum { ATOMIC_SWAP, ATOMIC_ADD, ATOMIC_AND, ATOMIC_OR, ATOMIC_XOR,
+  ATOMIC_MIN, ATOMIC_MAX, ATOMIC_MINU, ATOMIC_MAXU };
+
+uint32_t tlb_atomic(vaddr_t addr, uint32_t data, int len, int op);
+/* store `data' if the word at `addr' is still `expect' */
+bool tlb_cas(vaddr_t addr, uint32_t expect, uint32_t data);
+/* called when the translation changes, also drops the decoded code */
+void tlb_flush(void);
+void tlb_statistic(void);
+
+#endif
@@ -14,9 +14,14 @@ void difftest_step(vaddr_t ori_pc, vaddr_t next_pc);
 #define difftest_step(ori_pc, next_pc)
 #endif
 
+/* copy the whole state of DUT to REF */
+void difftest_sync(void);
+
 extern void (*ref_difftest_memcpy_from_dut)(paddr_t dest, void *src, size_t n);
+extern void (*ref_difftest_memcpy_to_dut)(paddr_t src, void *dest, size_t n);
 extern void (*ref_difftest_getregs)(void *c);
 extern void (*ref_difftest_setregs)(const void *c);
 extern void (*ref_difftest_exec)(uint64_t n);
+extern int (*ref_difftest_memcmp_pages)(const paddr_t *addr, const uint64_t *sum, int n);
 
 #endif
@@ -3,6 +3,32 @@
 
 #include "common.h"
 
+/* An expression is parsed once into a tree, folded, and flattened into
+ * a sequence of operations in reverse Polish notation, which can be
+ * evaluated without parsing. Registers and constant addresses in pmem
+ * are resolved to host pointers at that time.
+ */
+
+enum {
+  EXPR_IMM, EXPR_REG, EXPR_MEM, EXPR_DEREF, EXPR_NEG, EXPR_NOT,
+  EXPR_ADD, EXPR_SUB, EXPR_MUL, EXPR_DIV, EXPR_EQ, EXPR_NEQ, EXPR_AND, EXPR_OR,
+};
+
+typedef struct {
+  uint32_t type;
+  uint32_t imm;   // the value of EXPR_IMM, or the address of EXPR_MEM
+  void *ptr;      // the register of EXPR_REG, or the host address of EXPR_MEM
+} ExprOp;
+
+#define EXPR_MAX_OP 128
+
+typedef struct {
+  int nr_op;
+  ExprOp op[EXPR_MAX_OP];
+} ExprCode;
+
+bool expr_compile(const char *e, ExprCode *code);
+uint32_t expr_eval(const ExprCode *code, bool *success);
 uint32_t expr(char *, bool *);
 
 #endif
@@ -0,0 +1,44 @@
+#ifndef __MONITOR_FTRACE_H__
+#define __MONITOR_FTRACE_H__
+
+#include "common.h"
+
+/* The function call tracer. The control helpers report calls and returns,
+ * which are appended to a buffer of binary records. The buffer is replayed
+ * into a calling context tree when it is full and at the end of the run.
+ */
+
+enum { FTRACE_CALL, FTRACE_RET };
+
+typedef struct {
+  uint32_t type;
+  vaddr_t target;   // the function called, or the address returned to
+  vaddr_t link;     // the return address of a call
+  uint64_t icount;  // guest instructions retired after this one
+} FtraceRecord;
+
+#define FTRACE_BUF_SIZE 65536
+
+extern __thread bool ftrace_enable;
+extern FtraceRecord ftrace_buf[];
+extern int ftrace_nr;
+
+void ftrace_process(void);
+uint64_t cpu_nr_instr(void);
+
+static inline void ftrace_record(uint32_t type, vaddr_t target, vaddr_t link) {
+  FtraceRecord *r = &ftrace_buf[ftrace_nr ++];
+  r->type = type;
+  r->target = target;
+  r->link = link;
+  r->icount = cpu_nr_instr() + 1;
+  if (ftrace_nr == FTRACE_BUF_SIZE) ftrace_process();
+}
+
+#define ftrace_call(target, link) \
+  do { if (ftrace_enable) ftrace_record(FTRACE_CALL, target, link); } while (0)
+
+#define ftrace_ret(target) \
+  do { if (ftrace_enable) ftrace_record(FTRACE_RET, target, 0); } while (0)
+
+#endif
@@ -0,0 +1,61 @@
+#ifndef __MONITOR_ITRACE_H__
+#define __MONITOR_ITRACE_H__
+
+#include "common.h"
+
+/* The instruction trace. The last ITRACE_SIZE instructions executed are
+ * kept in a ring of binary records, which is written to a file when NEMU
+ * aborts, when the program hits a bad trap, or by the `itrace' command.
+ * tools/itrace renders such a file into disassembly.
+ */
+
+#define ITRACE_SIZE 4096   // must be a power of 2
+#define ITRACE_MAX_LEN 15  // longest instruction among the supported ISAs (x86)
+
+typedef struct {
+  vaddr_t pc;
+  uint8_t len;
+  uint8_t bytes[ITRACE_MAX_LEN];
+} ItraceRecord;
+
+/* the file starts with this header, followed by `nr_record' records
+ * from the oldest to the newest */
+typedef struct {
+  char magic[4];       // "ITRC"
+  char isa[12];
+  uint32_t nr_record;
+  uint32_t record_size;
+} ItraceHeader;
+
+#ifdef DEBUG
+
+extern __thread ItraceRecord itrace_ring[ITRACE_SIZE];
+extern __thread uint64_t itrace_nr;
+
+static inline ItraceRecord* itrace_cur(void) {
+  return &itrace_ring[itrace_nr & (ITRACE_SIZE - 1)];
+}
+
+static inline void itrace_begin(vaddr_t pc) {
+  ItraceRecord *r = itrace_cur();
+  r->pc = pc;
+  r->len = 0;
+}
+
+/* append the bytes fetched to the record of the current instruction */
+static inline void itrace_bytes(const void *p, int len) {
+  ItraceRecord *r = itrace_cur();
+  if (r->len + len > ITRACE_MAX_LEN) len = ITRACE_MAX_LEN - r->len;
+  memcpy(r->bytes + r->len, p, len);
+  r->len += len;
+}
+
+static inline void itrace_end(void) {
+  itrace_nr ++;
+}
+
+#endif
+
+void itrace_dump(const char *file);
+
+#endif
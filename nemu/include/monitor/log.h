@@ -5,23 +5,29 @@
 
 #ifdef DEBUG
 extern FILE* log_fp;
+void log_printf(const char *fmt, ...);
 #	define log_write(...) \
   do { \
     if (log_fp != NULL) { \
-      fprintf(log_fp, __VA_ARGS__); \
-      fflush(log_fp); \
+      log_printf(__VA_ARGS__); \
     } \
   } while (0)
 #else
 #	define log_write(...)
 #endif
 
+/* set by the threads running machines of the pool */
+extern __thread bool log_quiet;
+
 #define _Log(...) \
   do { \
-    printf(__VA_ARGS__); \
-    log_write(__VA_ARGS__); \
+    if (!log_quiet) { \
+      printf(__VA_ARGS__); \
+      log_write(__VA_ARGS__); \
+    } \
   } while (0)
 
 void strcatf(char *buf, const char *fmt, ...);
+void log_flush(void);
 
 #endif
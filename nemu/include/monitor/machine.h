@@ -0,0 +1,34 @@
+#ifndef __MONITOR_MACHINE_H__
+#define __MONITOR_MACHINE_H__
+
+#include "common.h"
+#include "memory/memory.h"
+#include "device/map.h"
+#include "cpu/decode-cache.h"
+#include "cpu/jit.h"
+
+/* The large tables of a machine, and the maps of its devices. They are
+ * allocated with the machine instead of being thread-local, so a thread
+ * only carries `mctx', only the pages touched are allocated by the host,
+ * and everything goes away with free_machine_context(). */
+typedef struct {
+  uint8_t io_space[IO_SPACE_MAX] PG_ALIGN;
+  IOMap *port_map[PORT_IO_SPACE_MAX + 1];
+  MMIOPage *mmio_table[1 << MMIO_L1_BITS];
+  IOMap maps[NR_IO_MAP];   // allocated by new_map()
+  int nr_map;
+#ifdef DECODE_CACHE
+  DCacheEntry dcache[DCACHE_SIZE];
+  uint8_t dcache_code_map[NR_CODE_CHUNK];
+#endif
+#ifdef JIT
+  JitIR ir_buf[MAX_IR];
+#endif
+} MachineContext;
+
+extern __thread MachineContext *mctx;
+
+void init_machine_context(void);
+void free_machine_context(void);
+
+#endif
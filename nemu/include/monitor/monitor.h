@@ -11,6 +11,6 @@ typedef struct {
   uint32_t halt_ret;
 } NEMUState;
 
-extern NEMUState nemu_state;
+extern __thread NEMUState nemu_state;
 
 #endif
@@ -0,0 +1,38 @@
+#ifndef __MONITOR_SNAPSHOT_H__
+#define __MONITOR_SNAPSHOT_H__
+
+#include "common.h"
+#include "memory/memory.h"
+
+/* Snapshots of the whole machine. The registers, the state registered
+ * by the devices with snapshot_add(), and the non-zero pages of pmem
+ * are written to a file. A later snapshot taken by the same NEMU only
+ * holds the pages written since the previous one, and refers to it.
+ *
+ * The pages of a full snapshot are page aligned in the file, and are
+ * mapped copy-on-write into pmem when it is loaded.
+ */
+
+/* The dirty bits of each page of pmem, one for each of their users,
+ * which clear their own bit. Differential testing also uses them to
+ * find the pages written since its last check. */
+enum { DIRTY_SNAPSHOT = 0x1, DIRTY_DIFFTEST = 0x2, DIRTY_ALL = 0xff };
+
+extern __thread uint8_t snapshot_dirty[];
+
+/* called on every store into pmem, with the offset in pmem */
+static inline void snapshot_mark_dirty(paddr_t offset, int len) {
+  snapshot_dirty[(offset / PAGE_SIZE) % (PMEM_SIZE / PAGE_SIZE)] = DIRTY_ALL;
+  snapshot_dirty[((offset + len - 1) / PAGE_SIZE) % (PMEM_SIZE / PAGE_SIZE)] = DIRTY_ALL;
+}
+
+/* Sections are saved in the order they are added, and must be added
+ * in the same order by the NEMU loading the snapshot. */
+void snapshot_add(const char *name, void *p, size_t size);
+/* `hook' is called after a snapshot is loaded */
+void snapshot_add_hook(void (*hook)(void));
+
+bool snapshot_save(const char *file);
+bool snapshot_load(const char *file);
+
+#endif
@@ -0,0 +1,14 @@
+#ifndef __MONITOR_SYMBOL_H__
+#define __MONITOR_SYMBOL_H__
+
+#include "common.h"
+
+/* Function symbols from the ELF file of the guest program */
+
+void init_symbol(const char *elf_file);
+int symbol_find(vaddr_t addr);  // the function containing `addr', or -1
+int symbol_count(void);
+const char* symbol_name(int idx);
+vaddr_t symbol_addr(int idx);
+
+#endif
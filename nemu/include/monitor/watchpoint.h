@@ -2,14 +2,34 @@
 #define __WATCHPOINT_H__
 
 #include "common.h"
+#include "monitor/expr.h"
 
 typedef struct watchpoint {
   int NO;
   struct watchpoint *next;
 
-  /* TODO: Add more members if necessary */
-  int value;
-  char expr[32];
+  char *expr;
+  ExprCode code;
+  uint32_t value;
+
+  /* A watch of `*addr' with a constant address in pmem is checked
+   * only when [addr, addr + 4) is written, instead of after every
+   * instruction. */
+  bool is_mem;
+  paddr_t addr;
 } WP;
 
+int wp_add(char *e);
+bool wp_delete(int NO);
+void wp_display(void);
+bool wp_check(void);
+
+extern int wp_nr_mem;
+void wp_check_write(paddr_t addr, int len);
+
+/* Called after pmem is written. */
+static inline void wp_watch_write(paddr_t addr, int len) {
+  if (wp_nr_mem > 0) wp_check_write(addr, len);
+}
+
 #endif
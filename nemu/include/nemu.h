@@ -5,6 +5,10 @@
 #include "memory/memory.h"
 #include "isa/reg.h"
 
-extern CPU_state cpu;
+extern __thread CPU_state cpu;
+
+/* the stack of a host thread running a machine or a hart, which also
+ * holds its thread-local state */
+#define MACHINE_STACK_SIZE (16 * 1024 * 1024)
 
 #endif
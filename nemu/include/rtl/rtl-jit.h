@@ -0,0 +1,115 @@
+#ifndef __RTL_RTL_JIT_H__
+#define __RTL_RTL_JIT_H__
+
+/* With the JIT built in, every RTL basic instruction is still interpreted,
+ * but it is also recorded when a hot block is being traced. The wrappers
+ * are macros so that they can be used before the interpret_rtl_*()
+ * functions are defined. Each argument is evaluated exactly once.
+ */
+
+#include "cpu/jit.h"
+
+#define jit_rtl_li(dest, imm) do { \
+    rtlreg_t *__d = (dest); uint32_t __imm = (imm); \
+    if (jit_recording) jit_rec(JIT_LI, __d, NULL, NULL, NULL, __imm, 4); \
+    interpret_rtl_li(__d, __imm); \
+  } while (0)
+
+#define jit_rtl_mv(dest, src1) do { \
+    rtlreg_t *__d = (dest); const rtlreg_t *__s1 = (src1); \
+    if (jit_recording) jit_rec(JIT_MV, __d, __s1, NULL, NULL, 0, 4); \
+    interpret_rtl_mv(__d, __s1); \
+  } while (0)
+
+#define jit_rtl_binary(name, op, dest, src1, src2) do { \
+    rtlreg_t *__d = (dest); const rtlreg_t *__s1 = (src1), *__s2 = (src2); \
+    if (jit_recording) jit_rec(op, __d, __s1, __s2, NULL, 0, 4); \
+    concat(interpret_rtl_, name)(__d, __s1, __s2); \
+  } while (0)
+
+#define jit_rtl_add(...)      jit_rtl_binary(add,     JIT_ADD,     __VA_ARGS__)
+#define jit_rtl_sub(...)      jit_rtl_binary(sub,     JIT_SUB,     __VA_ARGS__)
+#define jit_rtl_and(...)      jit_rtl_binary(and,     JIT_AND,     __VA_ARGS__)
+#define jit_rtl_or(...)       jit_rtl_binary(or,      JIT_OR,      __VA_ARGS__)
+#define jit_rtl_xor(...)      jit_rtl_binary(xor,     JIT_XOR,     __VA_ARGS__)
+#define jit_rtl_shl(...)      jit_rtl_binary(shl,     JIT_SHL,     __VA_ARGS__)
+#define jit_rtl_shr(...)      jit_rtl_binary(shr,     JIT_SHR,     __VA_ARGS__)
+#define jit_rtl_sar(...)      jit_rtl_binary(sar,     JIT_SAR,     __VA_ARGS__)
+#define jit_rtl_mul_lo(...)   jit_rtl_binary(mul_lo,  JIT_MUL_LO,  __VA_ARGS__)
+#define jit_rtl_mul_hi(...)   jit_rtl_binary(mul_hi,  JIT_MUL_HI,  __VA_ARGS__)
+#define jit_rtl_imul_lo(...)  jit_rtl_binary(imul_lo, JIT_IMUL_LO, __VA_ARGS__)
+#define jit_rtl_imul_hi(...)  jit_rtl_binary(imul_hi, JIT_IMUL_HI, __VA_ARGS__)
+#define jit_rtl_div_q(...)    jit_rtl_binary(div_q,   JIT_DIV_Q,   __VA_ARGS__)
+#define jit_rtl_div_r(...)    jit_rtl_binary(div_r,   JIT_DIV_R,   __VA_ARGS__)
+#define jit_rtl_idiv_q(...)   jit_rtl_binary(idiv_q,  JIT_IDIV_Q,  __VA_ARGS__)
+#define jit_rtl_idiv_r(...)   jit_rtl_binary(idiv_r,  JIT_IDIV_R,  __VA_ARGS__)
+
+#define jit_rtl_div64(name, op, dest, src1_hi, src1_lo, src2) do { \
+    rtlreg_t *__d = (dest); \
+    const rtlreg_t *__hi = (src1_hi), *__lo = (src1_lo), *__s2 = (src2); \
+    if (jit_recording) jit_rec(op, __d, __hi, __lo, __s2, 0, 4); \
+    concat(interpret_rtl_, name)(__d, __hi, __lo, __s2); \
+  } while (0)
+
+#define jit_rtl_div64_q(...)  jit_rtl_div64(div64_q,  JIT_DIV64_Q,  __VA_ARGS__)
+#define jit_rtl_div64_r(...)  jit_rtl_div64(div64_r,  JIT_DIV64_R,  __VA_ARGS__)
+#define jit_rtl_idiv64_q(...) jit_rtl_div64(idiv64_q, JIT_IDIV64_Q, __VA_ARGS__)
+#define jit_rtl_idiv64_r(...) jit_rtl_div64(idiv64_r, JIT_IDIV64_R, __VA_ARGS__)
+
+#define jit_rtl_lm(dest, addr, len) do { \
+    rtlreg_t *__d = (dest); const rtlreg_t *__a = (addr); int __len = (len); \
+    if (jit_recording) jit_rec(JIT_LM, __d, __a, NULL, NULL, 0, __len); \
+    interpret_rtl_lm(__d, __a, __len); \
+  } while (0)
+
+#define jit_rtl_sm(addr, src1, len) do { \
+    const rtlreg_t *__a = (addr), *__s1 = (src1); int __len = (len); \
+    if (jit_recording) jit_rec(JIT_SM, NULL, __a, __s1, NULL, 0, __len); \
+    interpret_rtl_sm(__a, __s1, __len); \
+  } while (0)
+
+#define jit_rtl_host_lm(dest, addr, len) do { \
+    rtlreg_t *__d = (dest); const void *__a = (addr); int __len = (len); \
+    if (jit_recording) jit_rec(JIT_HOST_LM, __d, __a, NULL, NULL, 0, __len); \
+    interpret_rtl_host_lm(__d, __a, __len); \
+  } while (0)
+
+#define jit_rtl_host_sm(addr, src1, len) do { \
+    void *__a = (addr); const rtlreg_t *__s1 = (src1); int __len = (len); \
+    if (jit_recording) jit_rec(JIT_HOST_SM, __a, __s1, NULL, NULL, 0, __len); \
+    interpret_rtl_host_sm(__a, __s1, __len); \
+  } while (0)
+
+#define jit_rtl_setrelop(relop, dest, src1, src2) do { \
+    uint32_t __relop = (relop); rtlreg_t *__d = (dest); \
+    const rtlreg_t *__s1 = (src1), *__s2 = (src2); \
+    if (jit_recording) jit_rec(JIT_SETRELOP, __d, __s1, __s2, NULL, 0, __relop); \
+    interpret_rtl_setrelop(__relop, __d, __s1, __s2); \
+  } while (0)
+
+#define jit_rtl_j(target) do { \
+    vaddr_t __t = (target); \
+    if (jit_recording) jit_rec(JIT_J, NULL, NULL, NULL, NULL, __t, 0); \
+    interpret_rtl_j(__t); \
+  } while (0)
+
+#define jit_rtl_jr(target) do { \
+    rtlreg_t *__t = (target); \
+    if (jit_recording) jit_rec(JIT_JR, NULL, __t, NULL, NULL, 0, 0); \
+    interpret_rtl_jr(__t); \
+  } while (0)
+
+#define jit_rtl_jrelop(relop, src1, src2, target) do { \
+    uint32_t __relop = (relop); const rtlreg_t *__s1 = (src1), *__s2 = (src2); \
+    vaddr_t __t = (target); \
+    if (jit_recording) jit_rec(JIT_JRELOP, NULL, __s1, __s2, NULL, __t, __relop); \
+    interpret_rtl_jrelop(__relop, __s1, __s2, __t); \
+  } while (0)
+
+#define jit_rtl_exit(state, halt_pc, halt_ret) do { \
+    int __state = (state); vaddr_t __pc = (halt_pc); uint32_t __ret = (halt_ret); \
+    jit_barrier(); \
+    interpret_rtl_exit(__state, __pc, __ret); \
+  } while (0)
+
+#endif
@@ -3,7 +3,11 @@
 
 #include "macro.h"
 
+#ifdef JIT
+#define RTL_PREFIX jit
+#else
 #define RTL_PREFIX interpret
+#endif
 
 #define rtl_li        concat(RTL_PREFIX, _rtl_li      )
 #define rtl_mv        concat(RTL_PREFIX, _rtl_mv      )
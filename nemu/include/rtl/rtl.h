@@ -5,8 +5,12 @@
 #include "rtl/c_op.h"
 #include "rtl/relop.h"
 #include "rtl/rtl-wrapper.h"
+#include "cpu/bpred.h"
+#ifdef JIT
+#include "rtl/rtl-jit.h"
+#endif
 
-extern rtlreg_t s0, s1, t0, t1, ir;
+extern __thread rtlreg_t s0, s1, t0, t1, ir;
 
 void decinfo_set_jmp(bool is_jmp);
 bool interpret_relop(uint32_t relop, const rtlreg_t src1, const rtlreg_t src2);
@@ -109,11 +113,17 @@ static inline void interpret_rtl_setrelop(uint32_t relop, rtlreg_t *dest,
 }
 
 static inline void interpret_rtl_j(vaddr_t target) {
+#ifdef BRANCH_SIM
+  bpred_jump(cpu.pc, target, false);
+#endif
   cpu.pc = target;
   decinfo_set_jmp(true);
 }
 
 static inline void interpret_rtl_jr(rtlreg_t *target) {
+#ifdef BRANCH_SIM
+  bpred_jump(cpu.pc, *target, true);
+#endif
   cpu.pc = *target;
   decinfo_set_jmp(true);
 }
@@ -121,6 +131,9 @@ static inline void interpret_rtl_jr(rtlreg_t *target) {
 static inline void interpret_rtl_jrelop(uint32_t relop,
     const rtlreg_t *src1, const rtlreg_t *src2, vaddr_t target) {
   bool is_jmp = interpret_relop(relop, *src1, *src2);
+#ifdef BRANCH_SIM
+  bpred_cond(cpu.pc, target, is_jmp);
+#endif
   if (is_jmp) cpu.pc = target;
   decinfo_set_jmp(is_jmp);
 }
@@ -132,12 +145,18 @@ void interpret_rtl_exit(int state, vaddr_t halt_pc, uint32_t halt_ret);
 
 static inline void rtl_not(rtlreg_t *dest, const rtlreg_t* src1) {
   // dest <- ~src1
-  TODO();
+  rtl_xori(dest, src1, -1);
 }
 
 static inline void rtl_sext(rtlreg_t* dest, const rtlreg_t* src1, int width) {
   // dest <- signext(src1[(width * 8 - 1) .. 0])
-  TODO();
+  if (width == 4) {
+    rtl_mv(dest, src1);
+  }
+  else {
+    rtl_shli(dest, src1, 32 - width * 8);
+    rtl_sari(dest, dest, 32 - width * 8);
+  }
 }
 
 static inline void rtl_setrelopi(uint32_t relop, rtlreg_t *dest,
@@ -148,7 +167,8 @@ static inline void rtl_setrelopi(uint32_t relop, rtlreg_t *dest,
 
 static inline void rtl_msb(rtlreg_t* dest, const rtlreg_t* src1, int width) {
   // dest <- src1[width * 8 - 1]
-  TODO();
+  rtl_shri(dest, src1, width * 8 - 1);
+  rtl_andi(dest, dest, 0x1);
 }
 
 static inline void rtl_mux(rtlreg_t* dest, const rtlreg_t* cond, const rtlreg_t* src1, const rtlreg_t* src2) {
@@ -0,0 +1,275 @@
+#include "nemu.h"
+#include "cpu/bpred.h"
+
+#ifdef BRANCH_SIM
+
+#include "monitor/symbol.h"
+#include <stdlib.h>
+
+#define PHT_BITS 12     // entries of the tables of 2-bit counters
+#define PHT_SIZE (1 << PHT_BITS)
+#define PHT_MASK (PHT_SIZE - 1)
+#define BTB_SIZE 512
+#define RAS_SIZE 16
+
+#define BR_HASH_SIZE (1 << 16)
+#define BR_PROBE 16
+#define BR_TOP 20
+
+__thread int bpred_type = BP_JUMP;
+__thread vaddr_t bpred_link = 0;
+
+/* direction predictors */
+
+typedef struct {
+  const char *name;
+  bool (*predict)(vaddr_t pc);
+  void (*update)(vaddr_t pc, bool taken);
+} Predictor;
+
+static __thread uint8_t bimodal_pht[PHT_SIZE];
+static __thread uint8_t gshare_pht[PHT_SIZE];
+static __thread uint8_t chooser[PHT_SIZE];   // >= 2 to use gshare
+static __thread uint32_t ghr = 0;
+static __thread bool last_bimodal, last_gshare;
+
+static inline uint32_t pc_idx(vaddr_t pc) { return (pc >> 1) & PHT_MASK; }
+static inline uint32_t gshare_idx(vaddr_t pc) { return ((pc >> 1) ^ ghr) & PHT_MASK; }
+
+static inline void counter_update(uint8_t *c, bool up) {
+  if (up) { if (*c < 3) (*c) ++; }
+  else { if (*c > 0) (*c) --; }
+}
+
+static bool bimodal_predict(vaddr_t pc) {
+  return bimodal_pht[pc_idx(pc)] >= 2;
+}
+
+static void bimodal_update(vaddr_t pc, bool taken) {
+  counter_update(&bimodal_pht[pc_idx(pc)], taken);
+}
+
+static bool gshare_predict(vaddr_t pc) {
+  return gshare_pht[gshare_idx(pc)] >= 2;
+}
+
+static void gshare_update(vaddr_t pc, bool taken) {
+  counter_update(&gshare_pht[gshare_idx(pc)], taken);
+  ghr = ((ghr << 1) | taken) & PHT_MASK;
+}
+
+/* The tournament predictor chooses between the two above, and
+ * must be run before they are updated. */
+static bool tournament_predict(vaddr_t pc) {
+  last_bimodal = bimodal_predict(pc);
+  last_gshare = gshare_predict(pc);
+  return (chooser[pc_idx(pc)] >= 2 ? last_gshare : last_bimodal);
+}
+
+static void tournament_update(vaddr_t pc, bool taken) {
+  if (last_bimodal != last_gshare) counter_update(&chooser[pc_idx(pc)], last_gshare == taken);
+}
+
+static Predictor predictors[] = {
+  { "tournament", tournament_predict, tournament_update },
+  { "bimodal", bimodal_predict, bimodal_update },
+  { "gshare", gshare_predict, gshare_update },
+};
+
+#define NR_PREDICTOR (sizeof(predictors) / sizeof(predictors[0]))
+
+// the predictor selected with -B, shared by the machines of a pool and by the harts
+static Predictor *sel = &predictors[0];
+static __thread uint64_t nr_pred_miss[NR_PREDICTOR];
+
+/* target predictors */
+
+typedef struct {
+  vaddr_t pc, target;
+} BTBEntry;
+
+static __thread BTBEntry btb[BTB_SIZE];
+static __thread vaddr_t ras[RAS_SIZE];
+static __thread int ras_top = 0;
+
+static __thread uint64_t nr_cond = 0, nr_direct = 0, nr_btb_miss = 0;
+static __thread uint64_t nr_indirect = 0, nr_indirect_miss = 0, nr_ret = 0, nr_ret_miss = 0;
+
+// return whether the BTB has predicted `target' for `pc', and update it
+static inline bool btb_check(vaddr_t pc, vaddr_t target) {
+  BTBEntry *e = &btb[(pc >> 1) % BTB_SIZE];
+  bool hit = (e->pc == pc && e->target == target);
+  e->pc = pc;
+  e->target = target;
+  return hit;
+}
+
+/* statistics of each branch */
+
+enum { BR_COND, BR_INDIRECT, BR_RET };
+static const char *br_type_name[] = { "cond", "indirect", "ret" };
+
+typedef struct {
+  vaddr_t pc;
+  uint32_t type;
+  uint64_t count, miss;
+} BranchStat;
+
+static __thread BranchStat *br_stat = NULL;
+static __thread uint64_t nr_lost = 0;
+
+static void br_count(vaddr_t pc, int type, bool miss) {
+  uint32_t h = (pc >> 1) * 2654435761u;
+  int i;
+  for (i = 0; i < BR_PROBE; i ++) {
+    BranchStat *s = &br_stat[(h + i) & (BR_HASH_SIZE - 1)];
+    if (s->count == 0) { s->pc = pc; s->type = type; }
+    if (s->pc == pc) { s->count ++; s->miss += miss; return; }
+  }
+  nr_lost ++;
+}
+
+void bpred_cond(vaddr_t pc, vaddr_t target, bool taken) {
+  bool pred[NR_PREDICTOR];
+  int i;
+  for (i = 0; i < NR_PREDICTOR; i ++) pred[i] = predictors[i].predict(pc);
+  for (i = 0; i < NR_PREDICTOR; i ++) {
+    if (pred[i] != taken) nr_pred_miss[i] ++;
+    predictors[i].update(pc, taken);
+  }
+  nr_cond ++;
+  br_count(pc, BR_COND, pred[sel - predictors] != taken);
+
+  if (taken) {
+    nr_direct ++;
+    nr_btb_miss += !btb_check(pc, target);
+  }
+}
+
+void bpred_jump(vaddr_t pc, vaddr_t target, bool is_indirect) {
+  int type = bpred_type;
+  bpred_type = BP_JUMP;
+
+  if (type == BP_RET) {
+    ras_top = (ras_top + RAS_SIZE - 1) % RAS_SIZE;
+    bool miss = (ras[ras_top] != target);
+    nr_ret ++;
+    nr_ret_miss += miss;
+    br_count(pc, BR_RET, miss);
+    return;
+  }
+
+  if (is_indirect) {
+    bool miss = !btb_check(pc, target);
+    nr_indirect ++;
+    nr_indirect_miss += miss;
+    br_count(pc, BR_INDIRECT, miss);
+  }
+  else {
+    nr_direct ++;
+    nr_btb_miss += !btb_check(pc, target);
+  }
+
+  if (type == BP_CALL) {
+    // the oldest entry is overwritten when the stack is full
+    ras[ras_top] = bpred_link;
+    ras_top = (ras_top + 1) % RAS_SIZE;
+  }
+}
+
+void init_bpred(const char *name) {
+  if (name != NULL) {
+    int i;
+    for (i = 0; i < NR_PREDICTOR; i ++) {
+      if (strcmp(name, predictors[i].name) == 0) break;
+    }
+    if (i == NR_PREDICTOR) panic("unknown branch predictor '%s'", name);
+    sel = &predictors[i];
+  }
+  Log("branch predictor: %s, with a %d-entry BTB and a %d-entry RAS", sel->name, BTB_SIZE, RAS_SIZE);
+  init_bpred_state();
+}
+
+/* The tables and the counters are thread-local, and start empty in a
+ * new thread. Only the statistics of each branch are allocated. */
+void init_bpred_state(void) {
+  br_stat = calloc(BR_HASH_SIZE, sizeof(BranchStat));
+  assert(br_stat);
+}
+
+void free_bpred_state(void) {
+  free(br_stat);
+  br_stat = NULL;
+}
+
+bool bpred_enabled(void) {
+  return true;
+}
+
+/* mispredictions which redirect the fetch after execution */
+uint64_t bpred_nr_miss(void) {
+  return nr_pred_miss[sel - predictors] + nr_indirect_miss + nr_ret_miss;
+}
+
+static int br_cmp(const void *a, const void *b) {
+  uint64_t x = ((const BranchStat *)a)->miss, y = ((const BranchStat *)b)->miss;
+  return (x > y ? -1 : (x < y));
+}
+
+static inline double rate(uint64_t miss, uint64_t total) {
+  return (total ? miss * 100.0 / total : 0.0);
+}
+
+void bpred_statistic(void) {
+  if (br_stat == NULL) return;
+
+  int i;
+  Log("bpred: conditional branches = %ld", nr_cond);
+  for (i = 0; i < NR_PREDICTOR; i ++) {
+    Predictor *p = &predictors[i];
+    Log("  %-10s mispredict = %ld (%.2f%%)%s", p->name, nr_pred_miss[i],
+        rate(nr_pred_miss[i], nr_cond), (p == sel ? " *" : ""));
+  }
+  Log("bpred: indirect jumps = %ld, mispredict = %ld (%.2f%%)",
+      nr_indirect, nr_indirect_miss, rate(nr_indirect_miss, nr_indirect));
+  Log("bpred: returns = %ld, mispredict = %ld (%.2f%%)",
+      nr_ret, nr_ret_miss, rate(nr_ret_miss, nr_ret));
+  Log("bpred: taken direct branches = %ld, BTB miss = %ld (%.2f%%)",
+      nr_direct, nr_btb_miss, rate(nr_btb_miss, nr_direct));
+  uint64_t total = nr_cond + nr_indirect + nr_ret;
+  Log("bpred: overall mispredict = %ld (%.2f%%), %ld branches lost in a full hash bucket",
+      bpred_nr_miss(), rate(bpred_nr_miss(), total), nr_lost);
+
+  qsort(br_stat, BR_HASH_SIZE, sizeof(BranchStat), br_cmp);
+  for (i = 0; i < BR_TOP && br_stat[i].miss > 0; i ++) {
+    BranchStat *s = &br_stat[i];
+    int sym = symbol_find(s->pc);
+    Log("%08x %-8s %10ld %10ld %6.2f%%  %s", s->pc, br_type_name[s->type], s->count,
+        s->miss, rate(s->miss, s->count), (sym >= 0 ? symbol_name(sym) : "[unknown]"));
+  }
+}
+
+#else
+
+void init_bpred(const char *name) {
+  if (name != NULL) Log("branch prediction is not enabled in include/common.h, '%s' ignored", name);
+}
+
+void init_bpred_state(void) {
+}
+
+void free_bpred_state(void) {
+}
+
+bool bpred_enabled(void) {
+  return false;
+}
+
+uint64_t bpred_nr_miss(void) {
+  return 0;
+}
+
+void bpred_statistic(void) {
+}
+
+#endif
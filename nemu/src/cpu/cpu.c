@@ -1,22 +1,373 @@
 #include "cpu/exec.h"
+#include "cpu/decode-cache.h"
+#include "cpu/jit.h"
+#include "device/event.h"
+#include "device/perfcnt.h"
+#include "memory/tlb.h"
+#include <stdlib.h>
 
-CPU_state cpu;
+__thread CPU_state cpu;
 
-rtlreg_t s0, s1, t0, t1, ir;
+__thread rtlreg_t s0, s1, t0, t1, ir;
 
 /* shared by all helper functions */
-DecodeInfo decinfo;
+__thread DecodeInfo decinfo;
+
+#ifdef BLOCK_CACHE
+static __thread bool is_ctrl = false;
+__thread bool block_stop = false;  // also checked by code from the JIT
+// instructions retired by block_exec() before the current block
+static __thread uint64_t block_nr_instr = 0;
+// index of the current instruction in its block, also set by code from the JIT
+__thread uint32_t block_instr_idx = 0;
+#endif
+
+/* the number of instructions retired before the current one */
+uint64_t cpu_nr_instr(void) {
+#ifdef BLOCK_CACHE
+  return g_nr_guest_instr + block_nr_instr + block_instr_idx;
+#else
+  return g_nr_guest_instr;
+#endif
+}
 
 void decinfo_set_jmp(bool is_jmp) {
   decinfo.is_jmp = is_jmp;
+  perfcnt.branch += is_jmp;
+#ifdef BLOCK_CACHE
+  // taken or not, this instruction ends a basic block
+  is_ctrl = true;
+#endif
 }
 
 void isa_exec(vaddr_t *pc);
 
+#ifdef DECODE_CACHE
+bool dcache_exec(vaddr_t *pc);
+void dcache_begin(vaddr_t pc);
+void dcache_fill(void);
+#endif
+
 vaddr_t exec_once(void) {
   decinfo.seq_pc = cpu.pc;
+#ifdef DECODE_CACHE
+  if (!dcache_exec(&decinfo.seq_pc)) {
+    dcache_begin(cpu.pc);
+    isa_exec(&decinfo.seq_pc);
+    dcache_fill();
+  }
+#else
   isa_exec(&decinfo.seq_pc);
+#endif
   update_pc();
 
   return decinfo.seq_pc;
 }
+
+#ifdef BLOCK_CACHE
+
+/* The block engine. A block is a sequence of decoded instructions ending
+ * with the first one which calls rtl_j(), rtl_jr() or rtl_jrelop(). Each
+ * block remembers the blocks it was last followed by, so that a hot loop
+ * goes from one block to the next without looking anything up and without
+ * returning to cpu_exec().
+ */
+
+#define MAX_BLOCK_INSTR 64
+#define NR_BLOCK 8192
+#define NR_BLOCK_INSTR (NR_BLOCK * 4)
+#define BLOCK_HASH_SIZE 4096
+#define BLOCK_HASH_MASK (BLOCK_HASH_SIZE - 1)
+#define JIT_THRESHOLD 32
+
+typedef struct Block {
+  vaddr_t pc;
+  int nr_instr;
+  DecodedInstr *instr;
+  struct Block *next[2];   // chained successors
+  struct Block *hnext;     // hash chain
+#ifdef JIT
+  JitCode code;
+  uint32_t nr_run;
+  bool no_jit;
+#endif
+} Block;
+
+// allocated on the first use, to keep the thread-local state of a machine small
+static __thread Block *block_pool = NULL;
+static __thread DecodedInstr *instr_pool = NULL;
+static __thread Block *block_hash[BLOCK_HASH_SIZE];
+static __thread int nr_block = 0, nr_instr = 0;
+// the block run by block_run(), whose code from the JIT does not update cpu.pc
+static __thread Block *cur_block = NULL;
+
+static __thread uint64_t nr_chain = 0, nr_lookup = 0, nr_build = 0, nr_flush = 0;
+
+
+/* Called whenever cached code is modified. Every block goes away, and
+ * the block being executed stops after the current instruction.
+ */
+void block_flush_all(void) {
+  memset(block_hash, 0, sizeof(block_hash));
+  nr_block = 0;
+  nr_instr = 0;
+  nr_flush ++;
+  block_stop = true;
+#ifdef JIT
+  jit_flush();
+#endif
+}
+
+void free_block_pool(void) {
+  free(block_pool);
+  free(instr_pool);
+  block_pool = NULL;
+  instr_pool = NULL;
+  block_flush_all();
+}
+
+/* stop chaining after the current instruction */
+void block_break(void) {
+  block_stop = true;
+}
+
+static inline Block* block_lookup(vaddr_t pc) {
+  Block *b;
+  for (b = block_hash[pc & BLOCK_HASH_MASK]; b != NULL; b = b->hnext) {
+    if (b->pc == pc) return b;
+  }
+  return NULL;
+}
+
+/* Interpret instructions from cpu.pc, recording them into a new block.
+ * Return the block, or NULL if nothing can be recorded. The number of
+ * instructions executed is added to `*executed'.
+ */
+static Block* block_build(uint64_t n, uint64_t *executed) {
+  if (block_pool == NULL) {
+    block_pool = malloc(sizeof(Block) * NR_BLOCK);
+    instr_pool = malloc(sizeof(DecodedInstr) * NR_BLOCK_INSTR);
+    assert(block_pool && instr_pool);
+  }
+
+  if (nr_block == NR_BLOCK || nr_instr + MAX_BLOCK_INSTR > NR_BLOCK_INSTR) {
+    block_flush_all();
+    block_stop = false;
+  }
+
+  Block *b = &block_pool[nr_block];
+  b->pc = cpu.pc;
+  b->nr_instr = 0;
+  b->instr = &instr_pool[nr_instr];
+  b->next[0] = b->next[1] = NULL;
+#ifdef JIT
+  b->code = NULL;
+  b->nr_run = 0;
+  b->no_jit = false;
+#endif
+  nr_build ++;
+
+  bool complete = false;
+  while (n > 0) {
+    is_ctrl = false;
+    block_nr_instr = *executed;
+    block_instr_idx = 0;
+    exec_once();
+    (*executed) ++;
+    n --;
+
+    DecodedInstr *di = dcache_last();
+    if (block_stop || di == NULL) break;
+    b->instr[b->nr_instr ++] = *di;
+    if (is_ctrl || b->nr_instr == MAX_BLOCK_INSTR) { complete = true; break; }
+  }
+
+  if (!complete) {
+    // Running out of budget, a state change or an instruction which can
+    // not be cached stops the recording in the middle. Such a block is
+    // dropped, since later it would be run as a whole.
+    return NULL;
+  }
+
+  nr_block ++;
+  nr_instr += b->nr_instr;
+  b->hnext = block_hash[b->pc & BLOCK_HASH_MASK];
+  block_hash[b->pc & BLOCK_HASH_MASK] = b;
+  return b;
+}
+
+/* Whether the instruction `i' of the block went somewhere else than
+ * the next one, e.g. by raising an exception which it did not raise
+ * when the block was built. The rest of the block is then skipped.
+ */
+static inline bool block_left(Block *b, int i) {
+  DecodedInstr *di = &b->instr[i];
+  return i + 1 < b->nr_instr && cpu.pc != di->pc + di->len;
+}
+
+#ifdef JIT
+/* Run the whole block once more while recording its RTL instructions,
+ * and compile them. Return the number of instructions executed.
+ */
+static uint64_t block_compile(Block *b) {
+  int i;
+  bool stopped = false;
+  jit_record_begin();
+  for (i = 0; i < b->nr_instr; i ++) {
+    DecodedInstr *di = &b->instr[i];
+    jit_record_instr(di->pc, di->pc + di->len, &di->info);
+    block_instr_idx = i;
+    dcache_replay(di);
+    update_pc();
+    if (block_stop || block_left(b, i)) { i ++; stopped = true; jit_record_fail(); break; }
+  }
+
+  bool full;
+  JitCode code = jit_record_end(b->nr_instr, &full);
+  if (stopped) return i;
+  if (full) {
+    // start over with an empty code cache
+    block_flush_all();
+  }
+  else if (code != NULL) b->code = code;
+  else b->no_jit = true;
+  return i;
+}
+#endif
+
+static inline uint64_t block_run(Block *b, uint64_t n) {
+#ifdef JIT
+  if (jit_is_enabled() && n >= b->nr_instr) {
+    if (b->code != NULL) {
+      // compiled code does not call decinfo_set_jmp()
+      uint32_t nr = b->code();
+      DecodedInstr *last = &b->instr[b->nr_instr - 1];
+      if (nr == b->nr_instr && cpu.pc != last->pc + last->len) perfcnt.branch ++;
+      return nr;
+    }
+    if (!b->no_jit && ++ b->nr_run >= JIT_THRESHOLD) return block_compile(b);
+  }
+#endif
+
+  uint64_t i, nr = (n < b->nr_instr ? n : b->nr_instr);
+  for (i = 0; i < nr; i ++) {
+    block_instr_idx = i;
+    dcache_replay(&b->instr[i]);
+    update_pc();
+    if (block_stop || block_left(b, i)) return i + 1;
+  }
+  return nr;
+}
+
+#ifdef DIFF_TEST
+bool difftest_block_once(void);
+#endif
+
+/* Execute at most `n' instructions by blocks, and return the number of
+ * instructions executed. Stop early when the state of NEMU changes or a
+ * device needs to be updated.
+ */
+uint64_t block_exec(uint64_t n) {
+  uint64_t executed = 0;
+  Block *prev = NULL;
+  block_stop = false;
+
+  while (executed < n) {
+    Block *b = NULL;
+    if (prev != NULL) {
+      if (prev->next[0] != NULL && prev->next[0]->pc == cpu.pc) { b = prev->next[0]; nr_chain ++; }
+      else if (prev->next[1] != NULL && prev->next[1]->pc == cpu.pc) { b = prev->next[1]; nr_chain ++; }
+    }
+    if (b == NULL) {
+      b = block_lookup(cpu.pc);
+      nr_lookup ++;
+      if (b != NULL && prev != NULL) {
+        // the most recent successor is kept in next[0]
+        prev->next[1] = prev->next[0];
+        prev->next[0] = b;
+      }
+    }
+
+    if (b != NULL) {
+      block_nr_instr = executed;
+      block_instr_idx = 0;
+      cur_block = b;
+      executed += block_run(b, n - executed);
+      cur_block = NULL;
+    }
+    else {
+      uint64_t flush = nr_flush;
+      b = block_build(n - executed, &executed);
+      if (flush != nr_flush) prev = NULL;
+      if (b != NULL && prev != NULL) {
+        prev->next[1] = prev->next[0];
+        prev->next[0] = b;
+      }
+    }
+
+    if (block_stop) break;
+#ifdef DIFF_TEST
+    if (difftest_block_once()) break;
+#endif
+    // the wall clock may make an event due at any time
+    if (g_nr_guest_instr + executed >= event_next) break;
+    prev = b;
+  }
+
+  block_nr_instr = 0;
+  block_instr_idx = 0;
+  return executed;
+}
+
+/* Forget the instruction abandoned by a fault, and return its pc. */
+static vaddr_t block_abort(void) {
+#ifdef JIT
+  if (jit_recording) {
+    bool full;
+    jit_record_fail();
+    jit_record_end(0, &full);
+  }
+#endif
+  vaddr_t pc = (cur_block != NULL ? cur_block->instr[block_instr_idx].pc : cpu.pc);
+  cur_block = NULL;
+  block_nr_instr = 0;
+  block_instr_idx = 0;
+  return pc;
+}
+
+void block_statistic(void) {
+  Log("block engine: %d blocks, chained = %ld, looked up = %ld, built = %ld, flushed = %ld",
+      nr_block, nr_chain, nr_lookup, nr_build, nr_flush);
+#ifdef JIT
+  jit_statistic();
+#endif
+}
+
+#else
+
+void block_statistic(void) {
+}
+
+void free_block_pool(void) {
+}
+
+#endif
+
+/* Called by execute() when an access of `type' at `vaddr' faults, see
+ * cpu_fault(). The instruction is retired by raising the exception,
+ * and its pc is returned in `*pc'. Return the number of instructions
+ * retired since g_nr_guest_instr, including it.
+ */
+uint64_t cpu_raise_fault(vaddr_t vaddr, int type, vaddr_t *pc) {
+  uint64_t nr = cpu_nr_instr() - g_nr_guest_instr + 1;
+#ifdef BLOCK_CACHE
+  *pc = block_abort();
+#else
+  *pc = cpu.pc;
+#endif
+  cpu.pc = decinfo.seq_pc = *pc;
+  decinfo.is_jmp = false;
+  isa_tlb_fault(vaddr, type, *pc);
+  update_pc();
+  return nr;
+}
@@ -0,0 +1,206 @@
+#include "cpu/decode-cache.h"
+#include "monitor/monitor.h"
+#include "monitor/machine.h"
+#include "cpu/hart.h"
+
+#ifdef DECODE_CACHE
+
+/* The decode cache is direct-mapped and indexed by the pc. Each entry
+ * holds the decoding information right before the execution helper is
+ * invoked, and the execution helper itself. A hit restores `decinfo',
+ * reloads the register and memory values of the operands, and calls the
+ * execution helper directly, without fetching and decoding anything.
+ */
+
+#define DCACHE_MASK (DCACHE_SIZE - 1)
+#define DCACHE_CHUNK_SIZE (1 << DCACHE_CHUNK_SHIFT)
+
+#define dcache (mctx->dcache)
+
+static __thread DCacheEntry pending = {};
+static __thread DecodedInstr *last = NULL;
+static __thread bool fetched = false;
+
+__thread uint8_t *dcache_code_map = NULL;
+
+static __thread uint64_t nr_hit = 0, nr_miss = 0, nr_flush = 0;
+
+#ifdef BLOCK_CACHE
+void block_flush_all(void);
+#else
+#define block_flush_all()
+#endif
+
+static inline uint32_t chunk_idx(paddr_t addr) {
+  return (addr >> DCACHE_CHUNK_SHIFT) & (NR_CODE_CHUNK - 1);
+}
+
+static inline void operand_reload(Operand *op) {
+  uint8_t flags = op->reload.flags;
+  if (flags & OP_RELOAD_ADDR) {
+    rtl_li(&op->addr, op->reload.disp);
+    if (op->reload.base != -1) {
+      rtl_lr(&s0, op->reload.base, 4);
+      rtl_add(&op->addr, &op->addr, &s0);
+    }
+    if (op->reload.index != -1) {
+      rtl_lr(&s0, op->reload.index, 4);
+      rtl_shli(&s0, &s0, op->reload.scale);
+      rtl_add(&op->addr, &op->addr, &s0);
+    }
+  }
+  if (flags & OP_RELOAD_REG) {
+    rtl_lr(&op->val, op->reload.reg, op->reload.width);
+  }
+  if (flags & OP_RELOAD_MEM) {
+    rtl_lm(&op->val, &op->addr, op->width);
+  }
+}
+
+/* Execute a decoded instruction. `decinfo.seq_pc' is left pointing
+ * to the next instruction, and update_pc() should be called as usual.
+ */
+void dcache_replay(DecodedInstr *di) {
+  // a replay leaves the ISA dependent decoding state as it was
+  struct ISADecodeInfo isa = decinfo.isa;
+  decinfo = di->info;
+  operand_reload(id_src);
+  operand_reload(id_src2);
+  operand_reload(id_dest);
+
+#ifdef DEBUG
+  itrace_bytes(di->bytes, di->len);
+#endif
+
+  di->execute(&decinfo.seq_pc);
+  decinfo.isa = isa;
+}
+
+bool dcache_exec(vaddr_t *pc) {
+  DCacheEntry *e = &dcache[*pc & DCACHE_MASK];
+  if (!e->valid || e->di.pc != *pc) {
+    nr_miss ++;
+    return false;
+  }
+  nr_hit ++;
+
+  last = &e->di;
+  dcache_replay(&e->di);
+  return true;
+}
+
+/* called on a miss before decoding starts */
+void dcache_begin(vaddr_t pc) {
+  id_src->reload.flags = 0;
+  id_src2->reload.flags = 0;
+  id_dest->reload.flags = 0;
+  pending.di.pc = pc;
+  pending.valid = false;
+  fetched = false;
+  last = NULL;
+}
+
+/* called by the TLB for each instruction fetch, which only happens
+ * on a miss, with the physical address of the bytes fetched */
+void dcache_fetch(paddr_t addr, int len) {
+  if (!fetched) {
+    pending.di.paddr = addr;
+    fetched = true;
+  }
+  pending.di.paddr_last = addr + len - 1;
+  // marked before the bytes are read, so that a store by another hart
+  // after the fetch is seen
+  dcache_code_map[chunk_idx(addr)] = 1;
+  dcache_code_map[chunk_idx(addr + len - 1)] = 1;
+}
+
+/* called by idex() right before invoking the execution helper,
+ * the innermost call (the one really executing the instruction) wins */
+void dcache_snapshot(EHelper execute) {
+  pending.di.info = decinfo;
+  pending.di.execute = execute;
+  pending.valid = true;
+}
+
+/* called on a miss after the instruction is executed */
+void dcache_fill(void) {
+  DecodedInstr *di = &pending.di;
+  if (!pending.valid || !fetched || nemu_state.state != NEMU_RUNNING) return;
+
+  di->len = di->info.seq_pc - di->pc;
+  if (di->len <= 0 || di->len > MAX_INSTR_LEN) return;
+
+#ifdef DEBUG
+  memcpy(di->bytes, itrace_cur()->bytes, di->len);
+#endif
+
+  DCacheEntry *e = &dcache[di->pc & DCACHE_MASK];
+  *e = pending;
+  last = &e->di;
+}
+
+/* the decoding of the instruction executed by the last exec_once(),
+ * or NULL if it can not be cached */
+DecodedInstr *dcache_last(void) {
+  return last;
+}
+
+static inline bool overlap_chunk(DecodedInstr *di, uint32_t idx) {
+  return chunk_idx(di->paddr) == idx || chunk_idx(di->paddr_last) == idx;
+}
+
+/* Flush the code of this hart in the chunk of `addr'. */
+void dcache_drop_chunk(paddr_t addr) {
+  uint32_t idx = chunk_idx(addr);
+  nr_flush ++;
+
+  // Instructions overlapping the chunk start at most MAX_INSTR_LEN bytes
+  // before it. Since DCACHE_SIZE >= DCACHE_CHUNK_SIZE, their entries
+  // occupy a contiguous range of the cache. The offset in the page is
+  // the same in the pc and the paddr, so the range is found by `addr'.
+  vaddr_t start = (addr & ~(DCACHE_CHUNK_SIZE - 1)) - MAX_INSTR_LEN;
+  int i;
+  for (i = 0; i < DCACHE_CHUNK_SIZE + MAX_INSTR_LEN; i ++) {
+    DCacheEntry *e = &dcache[(start + i) & DCACHE_MASK];
+    if (e->valid && overlap_chunk(&e->di, idx)) {
+      e->valid = false;
+    }
+  }
+
+  // the instruction being decoded may have written its own code
+  if (pending.valid && fetched && overlap_chunk(&pending.di, idx)) {
+    pending.valid = false;
+  }
+
+  last = NULL;
+  block_flush_all();
+}
+
+void dcache_flush_chunk(paddr_t addr) {
+  // queued for the other harts before the map is cleared
+  hart_flush_code(addr);
+  dcache_drop_chunk(addr);
+  dcache_code_map[chunk_idx(addr)] = 0;
+}
+
+void dcache_flush_all(void) {
+  memset(dcache, 0, sizeof(dcache));
+  // the map is shared by the harts
+  if (nr_hart == 1) memset(dcache_code_map, 0, NR_CODE_CHUNK);
+  pending.valid = false;
+  last = NULL;
+  block_flush_all();
+}
+
+void dcache_statistic(void) {
+  uint64_t total = nr_hit + nr_miss;
+  Log("decode cache: hit = %ld, miss = %ld, hit rate = %.2f%%, flush = %ld",
+      nr_hit, nr_miss, (total ? nr_hit * 100.0 / total : 0.0), nr_flush);
+}
+
+#else
+
+void dcache_statistic(void) {
+}
+
+#endif
@@ -0,0 +1,352 @@
+#include "nemu.h"
+#include "monitor/monitor.h"
+#include "monitor/machine.h"
+#include "cpu/hart.h"
+#include "cpu/decode-cache.h"
+#include "device/event.h"
+#include <pthread.h>
+#include <sched.h>
+
+enum { IO_NONE, IO_PENDING, IO_DONE };
+
+// chunks of code written by other harts, beyond which all code is flushed
+#define NR_INVAL 16
+
+typedef struct {
+  // set to 0 to make the hart call hart_check()
+  volatile uint64_t *event_next;
+  bool stopped;
+  uint64_t nr_instr;
+
+  // the I/O access passed to hart 0
+  int io_state;
+  bool is_pio, is_write;
+  paddr_t addr;
+  uint32_t data;
+  int len;
+
+  // the code to flush, guarded by `lock'
+  paddr_t inval[NR_INVAL];
+  int nr_inval;
+  bool inval_all;
+} Hart;
+
+int nr_hart = 1;
+__thread int hart_id = 0;
+
+static Hart harts[MAX_HART];
+static uint8_t *hart_pmem = NULL;
+#ifdef DECODE_CACHE
+static uint8_t *hart_code_map = NULL;
+#endif
+static vaddr_t start_pc = 0;
+static bool started = false;
+static bool hart_jit = false;
+// the hart whose I/O access is being served
+static int io_hart = 0;
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
+static bool running = false;  // hart 0 is in cpu_exec()
+static bool stop_req = false; // a hart asks the monitor to stop
+static int nr_active = 0;     // the other harts which are not parked
+static bool ended = false;
+static NEMUState end_state;
+
+void init_isa(void);
+void init_jit(bool enable);
+void free_jit(void);
+void free_block_pool(void);
+void init_cache_state(void);
+void free_cache_state(void);
+void init_bpred_state(void);
+void free_bpred_state(void);
+void execute(uint64_t n);
+
+uint32_t pio_read_l(ioaddr_t);
+uint32_t pio_read_w(ioaddr_t);
+uint32_t pio_read_b(ioaddr_t);
+void pio_write_l(ioaddr_t, uint32_t);
+void pio_write_w(ioaddr_t, uint32_t);
+void pio_write_b(ioaddr_t, uint32_t);
+
+static inline void kick(int id) {
+  __atomic_store_n((uint64_t *)harts[id].event_next, 0, __ATOMIC_SEQ_CST);
+}
+
+static void* hart_thread(void *arg) {
+  Hart *h = arg;
+  hart_id = h - harts;
+  init_machine_context();
+  attach_mem(hart_pmem);
+#ifdef DECODE_CACHE
+  // the harts track their code in the map of hart 0
+  dcache_code_map = hart_code_map;
+#endif
+  init_isa();
+  cpu.pc = start_pc;
+  init_jit(hart_jit);
+  init_cache_state();
+  init_bpred_state();
+  Log("Hart %d starts at pc = 0x%08x", hart_id, cpu.pc);
+
+  pthread_mutex_lock(&lock);
+  h->event_next = &event_next;
+  while (true) {
+    while (!running || stop_req) pthread_cond_wait(&cond, &lock);
+    nr_active ++;
+    pthread_mutex_unlock(&lock);
+
+    nemu_state.state = NEMU_RUNNING;
+    execute(-1);
+
+    pthread_mutex_lock(&lock);
+    h->nr_instr = g_nr_guest_instr;
+    if (nemu_state.state == NEMU_END || nemu_state.state == NEMU_ABORT) {
+      if (!ended) {
+        end_state = nemu_state;
+        __atomic_store_n(&ended, true, __ATOMIC_SEQ_CST);
+        kick(0);
+      }
+      h->stopped = true;
+    }
+    __atomic_sub_fetch(&nr_active, 1, __ATOMIC_SEQ_CST);
+    if (h->stopped) break;
+  }
+  h->event_next = NULL;
+  pthread_mutex_unlock(&lock);
+
+  free_jit();
+  free_block_pool();
+  free_cache_state();
+  free_bpred_state();
+  free_machine_context();
+  return NULL;
+}
+
+static uint32_t serve_pio_read(ioaddr_t addr, int len) {
+  switch (len) {
+    case 4: return pio_read_l(addr);
+    case 2: return pio_read_w(addr);
+    case 1: return pio_read_b(addr);
+    default: assert(0);
+  }
+}
+
+static void serve_pio_write(ioaddr_t addr, uint32_t data, int len) {
+  switch (len) {
+    case 4: pio_write_l(addr, data); return;
+    case 2: pio_write_w(addr, data); return;
+    case 1: pio_write_b(addr, data); return;
+    default: assert(0);
+  }
+}
+
+/* Run by hart 0 for the other harts. */
+static void serve_io(void) {
+  int i;
+  for (i = 1; i < nr_hart; i ++) {
+    Hart *h = &harts[i];
+    if (__atomic_load_n(&h->io_state, __ATOMIC_ACQUIRE) != IO_PENDING) continue;
+    io_hart = i;
+    if (h->is_write) {
+      if (h->is_pio) serve_pio_write(h->addr, h->data, h->len);
+      else paddr_write(h->addr, h->data, h->len);
+    }
+    else {
+      h->data = (h->is_pio ? serve_pio_read(h->addr, h->len) : paddr_read(h->addr, h->len));
+    }
+    io_hart = 0;
+    __atomic_store_n(&h->io_state, IO_DONE, __ATOMIC_RELEASE);
+  }
+}
+
+static uint32_t hart_io(paddr_t addr, uint32_t data, int len, bool is_pio, bool is_write) {
+  Hart *h = &harts[hart_id];
+  h->addr = addr;
+  h->data = data;
+  h->len = len;
+  h->is_pio = is_pio;
+  h->is_write = is_write;
+  __atomic_store_n(&h->io_state, IO_PENDING, __ATOMIC_SEQ_CST);
+  kick(0);
+  while (__atomic_load_n(&h->io_state, __ATOMIC_ACQUIRE) != IO_DONE) sched_yield();
+  h->io_state = IO_NONE;
+  return h->data;
+}
+
+uint32_t hart_io_read(paddr_t addr, int len, bool is_pio) {
+  return hart_io(addr, 0, len, is_pio, false);
+}
+
+void hart_io_write(paddr_t addr, uint32_t data, int len, bool is_pio) {
+  hart_io(addr, data, len, is_pio, true);
+}
+
+/* Called by a hart writing a chunk of code, which the other harts
+ * flush at their next event checks. */
+void hart_flush_code(paddr_t addr) {
+  if (nr_hart == 1) return;
+  pthread_mutex_lock(&lock);
+  int i;
+  for (i = 0; i < nr_hart; i ++) {
+    Hart *h = &harts[i];
+    if (i == hart_id || h->inval_all) continue;
+    if (h->nr_inval < NR_INVAL) h->inval[h->nr_inval ++] = addr;
+    else h->inval_all = true;
+    if (h->event_next != NULL) kick(i);
+  }
+  pthread_mutex_unlock(&lock);
+}
+
+static void flush_code(void) {
+#ifdef DECODE_CACHE
+  Hart *h = &harts[hart_id];
+  if (__atomic_load_n(&h->nr_inval, __ATOMIC_SEQ_CST) == 0 &&
+      !__atomic_load_n(&h->inval_all, __ATOMIC_SEQ_CST)) return;
+
+  pthread_mutex_lock(&lock);
+  if (h->inval_all) dcache_flush_all();
+  else {
+    int i;
+    for (i = 0; i < h->nr_inval; i ++) dcache_drop_chunk(h->inval[i]);
+  }
+  h->nr_inval = 0;
+  h->inval_all = false;
+  pthread_mutex_unlock(&lock);
+#endif
+}
+
+/* Called by a hart other than hart 0 to make the monitor stop, for
+ * example on a watchpoint. Every hart parks until hart_resume(). */
+void hart_request_stop(void) {
+  pthread_mutex_lock(&lock);
+  __atomic_store_n(&stop_req, true, __ATOMIC_SEQ_CST);
+  int i;
+  for (i = 0; i < nr_hart; i ++) {
+    if (harts[i].event_next != NULL) kick(i);
+  }
+  pthread_mutex_unlock(&lock);
+}
+
+void hart_check(void) {
+  if (nr_hart == 1) return;
+  // a kick after the event check resetting `event_next' is not lost
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+  flush_code();
+
+  if (hart_id == 0) {
+    serve_io();
+    if (__atomic_load_n(&ended, __ATOMIC_SEQ_CST) && nemu_state.state == NEMU_RUNNING) {
+      pthread_mutex_lock(&lock);
+      nemu_state = end_state;
+      pthread_mutex_unlock(&lock);
+    }
+    if (__atomic_load_n(&stop_req, __ATOMIC_SEQ_CST) && nemu_state.state == NEMU_RUNNING) {
+      nemu_state.state = NEMU_STOP;
+    }
+  }
+  else if (!__atomic_load_n(&running, __ATOMIC_SEQ_CST) || harts[hart_id].stopped ||
+      __atomic_load_n(&stop_req, __ATOMIC_SEQ_CST) ||
+      __atomic_load_n(&ended, __ATOMIC_SEQ_CST)) {
+    if (nemu_state.state == NEMU_RUNNING) nemu_state.state = NEMU_STOP;
+  }
+}
+
+void hart_resume(void) {
+  if (!started) return;
+  pthread_mutex_lock(&lock);
+  __atomic_store_n(&stop_req, false, __ATOMIC_SEQ_CST);
+  __atomic_store_n(&running, true, __ATOMIC_SEQ_CST);
+  pthread_cond_broadcast(&cond);
+  pthread_mutex_unlock(&lock);
+}
+
+/* Wait for the other harts to park, so that the monitor sees a
+ * machine at rest. */
+void hart_pause(void) {
+  if (!started) return;
+  pthread_mutex_lock(&lock);
+  __atomic_store_n(&running, false, __ATOMIC_SEQ_CST);
+  int i;
+  for (i = 1; i < nr_hart; i ++) {
+    if (harts[i].event_next != NULL) kick(i);
+  }
+  pthread_mutex_unlock(&lock);
+
+  while (__atomic_load_n(&nr_active, __ATOMIC_SEQ_CST) > 0) {
+    // a hart may be waiting for its I/O access
+    serve_io();
+    sched_yield();
+  }
+
+  // another hart may end the machine after the last check of hart 0
+  if (ended && (nemu_state.state == NEMU_RUNNING || nemu_state.state == NEMU_STOP)) {
+    nemu_state = end_state;
+  }
+}
+
+bool hart_started(void) {
+  return started;
+}
+
+int hart_io_id(void) {
+  return io_hart;
+}
+
+void hart_start(vaddr_t pc) {
+  if (nr_hart == 1 || started) return;
+  started = true;
+  start_pc = pc;
+  hart_pmem = pmem;
+#ifdef DECODE_CACHE
+  hart_code_map = dcache_code_map;
+#endif
+
+  pthread_attr_t attr;
+  pthread_attr_init(&attr);
+  pthread_attr_setstacksize(&attr, MACHINE_STACK_SIZE);
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+
+  // called in cpu_exec() by hart 0
+  running = true;
+  int i;
+  for (i = 1; i < nr_hart; i ++) {
+    pthread_t t;
+    int ret = pthread_create(&t, &attr, hart_thread, &harts[i]);
+    Assert(ret == 0, "Can not create the thread of hart %d", i);
+  }
+  pthread_attr_destroy(&attr);
+}
+
+void hart_stop(int id) {
+  if (id == 0) return;
+  pthread_mutex_lock(&lock);
+  harts[id].stopped = true;
+  // the hart may not have started yet, or may have left
+  if (harts[id].event_next != NULL) kick(id);
+  pthread_mutex_unlock(&lock);
+}
+
+void hart_statistic(void) {
+  if (!started) return;
+  uint64_t total = g_nr_guest_instr;
+  Log("hart 0: %ld instructions", g_nr_guest_instr);
+  int i;
+  pthread_mutex_lock(&lock);
+  for (i = 1; i < nr_hart; i ++) {
+    Log("hart %d: %ld instructions", i, harts[i].nr_instr);
+    total += harts[i].nr_instr;
+  }
+  pthread_mutex_unlock(&lock);
+  Log("%d harts: %ld instructions", nr_hart, total);
+}
+
+void init_hart(int n, bool jit) {
+  Assert(n >= 1 && n <= MAX_HART, "The number of harts should be in [1, %d]", MAX_HART);
+  nr_hart = n;
+  hart_jit = jit;
+  harts[0].event_next = &event_next;
+  if (n > 1) Log("%d harts, the others start on the MPE device", n);
+}
@@ -0,0 +1,660 @@
+#include "cpu/exec.h"
+#include "cpu/jit.h"
+#include "monitor/machine.h"
+
+#ifdef JIT
+
+#include <sys/mman.h>
+
+/* A small trace compiler from RTL to x86-64.
+ *
+ * A hot block is interpreted once more with recording turned on. Every
+ * RTL basic instruction executed is appended to a trace, whose operands
+ * are the host addresses of the RTL registers (guest registers, temps,
+ * and the operands in `decinfo'). The trace is then compiled into a host
+ * function returning the number of guest instructions it executed.
+ *
+ * Since `decinfo' is restored before each guest instruction, its content
+ * at that time is a constant of the instruction, and reading it before
+ * writing it is recorded as an immediate. Reading `cpu.pc' is recorded
+ * as the pc of the instruction. A value of `decinfo' or of a temp which
+ * was written by C code, and not by an RTL instruction, is neither a
+ * constant nor seen by the compiled code, so reading it gives up the
+ * recording. Such writes are found by comparing the value read with the
+ * one decoded, or with the one left by the last RTL instruction.
+ *
+ * The most used 32-bit RTL registers of the trace are kept in callee-saved
+ * host registers for the duration of the block. They are written back
+ * before calling a helper and when leaving the block.
+ */
+
+#define CODE_CACHE_SIZE (16 * 1024 * 1024)
+#define MAX_LOC 512
+#define MAX_WRITTEN 64
+#define NR_HOST_REG 5
+
+#define JIT_SRC_CONST(i) (1 << (i))
+
+__thread bool jit_recording = false;
+static __thread bool jit_enabled = false;
+
+#define ir_buf (mctx->ir_buf)
+static __thread int nr_ir = 0;
+static __thread bool rec_fail = false;
+
+/* per-instruction recording state */
+static __thread const void *written[MAX_WRITTEN];
+static __thread uint32_t written_val[MAX_WRITTEN];  // as left by RTL
+static __thread int nr_written = 0;
+static __thread int last_written = -1;  // by the last RTL instruction, not taken yet
+static __thread const DecodeInfo *instr_info = NULL;  // `decinfo' as decoded
+static __thread bool jumped = false;
+static __thread vaddr_t instr_pc = 0;
+
+static __thread uint8_t *code_cache = NULL;
+static __thread uint8_t *code_ptr = NULL;
+
+static __thread uint64_t nr_compiled = 0, nr_rejected = 0, nr_code_flush = 0;
+
+/* ---------------- recorder ---------------- */
+
+void jit_record_fail(void) {
+  rec_fail = true;
+}
+
+static inline bool in_decinfo(const void *p) {
+  return (const uint8_t *)p >= (const uint8_t *)&decinfo &&
+    (const uint8_t *)p < (const uint8_t *)(&decinfo + 1);
+}
+
+static inline bool is_temp(const void *p) {
+  return p == &s0 || p == &s1 || p == &t0 || p == &t1 || p == &ir;
+}
+
+static inline int find_written(const void *p) {
+  int i;
+  for (i = 0; i < nr_written; i ++) {
+    if (written[i] == p) return i;
+  }
+  return -1;
+}
+
+static inline void set_written(const void *p) {
+  int i = find_written(p);
+  if (i == -1) {
+    if (nr_written == MAX_WRITTEN) { rec_fail = true; return; }
+    i = nr_written ++;
+    written[i] = p;
+  }
+  last_written = i;
+}
+
+/* the RTL instruction recorded last has been interpreted since */
+static inline void take_written(void) {
+  if (last_written == -1) return;
+  written_val[last_written] = *(uint32_t *)written[last_written];
+  last_written = -1;
+}
+
+/* record a source operand, turning instruction constants into immediates */
+static inline void rec_src(JitIR *ir, int i, const void *p, int len) {
+  ir->src[i] = p;
+  if (p == &cpu.pc) {
+    if (jumped) { rec_fail = true; return; }
+    ir->is_const |= JIT_SRC_CONST(i);
+    ir->cval[i] = instr_pc;
+    return;
+  }
+  if (!in_decinfo(p) && !is_temp(p)) return;
+
+  uint32_t mask = ~0u >> ((4 - len) << 3);
+  uint32_t val = *(uint32_t *)p & mask;
+  int k = find_written(p);
+  if (k != -1) {
+    // overwritten by C code after the RTL instruction
+    if ((written_val[k] & mask) != val) rec_fail = true;
+    return;
+  }
+
+  // not written by RTL, so it has to be a constant of the instruction
+  const uint8_t *decoded = (const uint8_t *)instr_info + ((const uint8_t *)p - (const uint8_t *)&decinfo);
+  if (is_temp(p) || (*(uint32_t *)decoded & mask) != val) { rec_fail = true; return; }
+  ir->is_const |= JIT_SRC_CONST(i);
+  ir->cval[i] = val;
+}
+
+static inline void rec_dest(const void *p) {
+  if (p == &cpu.pc) { rec_fail = true; return; }
+  if (in_decinfo(p) || is_temp(p)) set_written(p);
+}
+
+void jit_rec(int op, const void *dest, const void *src1, const void *src2,
+    const void *src3, uint32_t imm, int aux) {
+  if (rec_fail) return;
+  if (nr_ir == MAX_IR) { rec_fail = true; return; }
+  take_written();
+
+  JitIR *ir = &ir_buf[nr_ir ++];
+  ir->op = op;
+  ir->aux = aux;
+  ir->is_const = 0;
+  ir->imm = imm;
+  ir->dest = (void *)dest;
+
+  switch (op) {
+    case JIT_HOST_LM:
+      rec_src(ir, 0, src1, aux);
+      rec_dest(dest);
+      break;
+    case JIT_HOST_SM:
+      // the destination is addressed with a length, which is not tracked
+      if (dest == &cpu.pc || in_decinfo(dest) || is_temp(dest)) rec_fail = true;
+      rec_src(ir, 0, src1, 4);
+      break;
+    case JIT_J: jumped = true; break;
+    case JIT_JR: case JIT_JRELOP:
+      if (src1 != NULL) rec_src(ir, 0, src1, 4);
+      if (src2 != NULL) rec_src(ir, 1, src2, 4);
+      jumped = true;
+      break;
+    default:
+      if (src1 != NULL) rec_src(ir, 0, src1, 4);
+      if (src2 != NULL) rec_src(ir, 1, src2, 4);
+      if (src3 != NULL) rec_src(ir, 2, src3, 4);
+      if (dest != NULL) rec_dest(dest);
+      break;
+  }
+}
+
+void jit_record_begin(void) {
+  nr_ir = 0;
+  rec_fail = false;
+  jit_recording = true;
+}
+
+void jit_record_instr(vaddr_t pc, vaddr_t seq_pc, const DecodeInfo *info) {
+  nr_written = 0;
+  last_written = -1;
+  jumped = false;
+  instr_pc = pc;
+  instr_info = info;
+
+  if (nr_ir == MAX_IR) { rec_fail = true; return; }
+  JitIR *ir = &ir_buf[nr_ir ++];
+  ir->op = JIT_INSTR;
+  ir->imm = pc;
+  ir->cval[0] = seq_pc;
+}
+
+/* ---------------- register allocation ---------------- */
+
+typedef struct {
+  const void *p;
+  int count;
+  bool partial;  // accessed by host_lm/host_sm, must stay in memory
+  int hreg;      // -1 if in memory
+} Loc;
+
+static __thread Loc locs[MAX_LOC];
+static __thread int nr_loc;
+
+static const int host_regs[NR_HOST_REG] = { 3 /* rbx */, 5 /* rbp */, 12, 13, 14 };
+static __thread const void *hreg_loc[NR_HOST_REG];
+static __thread uint32_t dirty;
+
+static Loc* find_loc(const void *p, bool create) {
+  int i;
+  for (i = 0; i < nr_loc; i ++) {
+    if (locs[i].p == p) return &locs[i];
+  }
+  if (!create) return NULL;
+  if (nr_loc == MAX_LOC) { rec_fail = true; return NULL; }
+  locs[nr_loc] = (Loc) { .p = p, .count = 0, .partial = false, .hreg = -1 };
+  return &locs[nr_loc ++];
+}
+
+static void use_loc(const void *p) {
+  Loc *l = find_loc(p, true);
+  if (l != NULL) l->count ++;
+}
+
+static void partial_loc(const void *p, int len) {
+  uintptr_t first = (uintptr_t)p & ~(uintptr_t)3;
+  uintptr_t last = ((uintptr_t)p + len - 1) & ~(uintptr_t)3;
+  Loc *l = find_loc((void *)first, true);
+  if (l != NULL) l->partial = true;
+  l = find_loc((void *)last, true);
+  if (l != NULL) l->partial = true;
+}
+
+static void regalloc(void) {
+  int i, j;
+  nr_loc = 0;
+  for (i = 0; i < nr_ir; i ++) {
+    JitIR *ir = &ir_buf[i];
+    switch (ir->op) {
+      case JIT_INSTR: case JIT_J: break;
+      case JIT_HOST_LM:
+        if (!(ir->is_const & JIT_SRC_CONST(0))) partial_loc(ir->src[0], ir->aux);
+        use_loc(ir->dest);
+        break;
+      case JIT_HOST_SM:
+        partial_loc(ir->dest, ir->aux);
+        if (!(ir->is_const & JIT_SRC_CONST(0))) use_loc(ir->src[0]);
+        break;
+      default:
+        for (j = 0; j < 3; j ++) {
+          if (ir->src[j] != NULL && !(ir->is_const & JIT_SRC_CONST(j))) use_loc(ir->src[j]);
+        }
+        if (ir->dest != NULL) use_loc(ir->dest);
+        break;
+    }
+  }
+
+  for (i = 0; i < NR_HOST_REG; i ++) {
+    Loc *best = NULL;
+    for (j = 0; j < nr_loc; j ++) {
+      Loc *l = &locs[j];
+      if (l->hreg != -1 || l->partial || ((uintptr_t)l->p & 3) || l->count < 2) continue;
+      if (best == NULL || l->count > best->count) best = l;
+    }
+    hreg_loc[i] = (best ? best->p : NULL);
+    if (best) best->hreg = host_regs[i];
+  }
+}
+
+static inline int loc_hreg(const void *p) {
+  int i;
+  for (i = 0; i < NR_HOST_REG; i ++) {
+    if (hreg_loc[i] == p) return host_regs[i];
+  }
+  return -1;
+}
+
+/* ---------------- x86-64 emitter ---------------- */
+
+enum { EAX = 0, ECX = 1, EDX = 2, ESI = 6, EDI = 7, R15 = 15 };
+
+static __thread uint8_t *p;
+static __thread uintptr_t base;
+
+static inline void emit8(uint8_t b) { *p ++ = b; }
+static inline void emit32(uint32_t w) { memcpy(p, &w, 4); p += 4; }
+static inline void emit64(uint64_t w) { memcpy(p, &w, 8); p += 8; }
+
+static inline int32_t disp_of(const void *loc) {
+  intptr_t d = (intptr_t)loc - (intptr_t)base;
+  if (d != (int32_t)d) rec_fail = true;
+  return d;
+}
+
+/* [r15 + disp32] with `r' in the reg field */
+static inline void emit_modrm_mem(int r, const void *loc) {
+  emit8(0x80 | ((r & 7) << 3) | (R15 & 7));
+  emit32(disp_of(loc));
+}
+
+static inline void emit_rex(int w, int r, int b) {
+  uint8_t rex = 0x40 | (w << 3) | ((r >> 3) << 2) | (b >> 3);
+  if (rex != 0x40) emit8(rex);
+}
+
+/* mov dst, src (32-bit) */
+static inline void emit_mov_rr(int dst, int src) {
+  if (dst == src) return;
+  emit_rex(0, src, dst);
+  emit8(0x89);
+  emit8(0xc0 | ((src & 7) << 3) | (dst & 7));
+}
+
+static inline void emit_mov_ri(int r, uint32_t imm) {
+  emit_rex(0, 0, r);
+  emit8(0xb8 | (r & 7));
+  emit32(imm);
+}
+
+static inline void emit_load_mem(int r, const void *loc) {
+  emit_rex(0, r, R15);
+  emit8(0x8b);
+  emit_modrm_mem(r, loc);
+}
+
+static inline void emit_store_mem(const void *loc, int r) {
+  emit_rex(0, r, R15);
+  emit8(0x89);
+  emit_modrm_mem(r, loc);
+}
+
+static inline void emit_load(int r, const void *loc) {
+  int h = loc_hreg(loc);
+  if (h != -1) emit_mov_rr(r, h);
+  else emit_load_mem(r, loc);
+}
+
+static inline void emit_store(const void *loc, int r) {
+  int i;
+  for (i = 0; i < NR_HOST_REG; i ++) {
+    if (hreg_loc[i] == loc) {
+      emit_mov_rr(host_regs[i], r);
+      dirty |= 1u << i;
+      return;
+    }
+  }
+  emit_store_mem(loc, r);
+}
+
+static inline void emit_src(int r, JitIR *ir, int i) {
+  if (ir->is_const & JIT_SRC_CONST(i)) emit_mov_ri(r, ir->cval[i]);
+  else emit_load(r, ir->src[i]);
+}
+
+static inline void emit_writeback(bool clean) {
+  int i;
+  for (i = 0; i < NR_HOST_REG; i ++) {
+    if (dirty & (1u << i)) emit_store_mem(hreg_loc[i], host_regs[i]);
+  }
+  if (clean) dirty = 0;
+}
+
+static inline void emit_call(void *fn) {
+  emit_writeback(true);
+  emit8(0x48); emit8(0xb8); emit64((uintptr_t)fn);  // mov rax, fn
+  emit8(0xff); emit8(0xd0);                          // call rax
+}
+
+/* mov dword [cpu.pc], imm32 */
+/* mov dword [loc], imm */
+static inline void emit_store_imm(const void *loc, uint32_t imm) {
+  emit8(0x41); emit8(0xc7);
+  emit_modrm_mem(0, loc);
+  emit32(imm);
+}
+
+static inline void emit_set_pc(uint32_t pc) {
+  emit_store_imm(&cpu.pc, pc);
+}
+
+static inline void emit_prologue(void) {
+  emit8(0x53); emit8(0x55);                  // push rbx; push rbp
+  emit8(0x41); emit8(0x54);                  // push r12
+  emit8(0x41); emit8(0x55);                  // push r13
+  emit8(0x41); emit8(0x56);                  // push r14
+  emit8(0x41); emit8(0x57);                  // push r15
+  emit8(0x48); emit8(0x83); emit8(0xec); emit8(0x08);  // sub rsp, 8
+  emit8(0x49); emit8(0xbf); emit64(base);    // mov r15, base
+
+  int i;
+  for (i = 0; i < NR_HOST_REG; i ++) {
+    if (hreg_loc[i] != NULL) emit_load_mem(host_regs[i], hreg_loc[i]);
+  }
+  dirty = 0;
+}
+
+/* write back, return `nr_instr' and leave the block */
+static inline void emit_exit(int nr_instr) {
+  emit_writeback(false);
+  emit_mov_ri(EAX, nr_instr);
+  emit8(0x48); emit8(0x83); emit8(0xc4); emit8(0x08);  // add rsp, 8
+  emit8(0x41); emit8(0x5f);                  // pop r15
+  emit8(0x41); emit8(0x5e);                  // pop r14
+  emit8(0x41); emit8(0x5d);                  // pop r13
+  emit8(0x41); emit8(0x5c);                  // pop r12
+  emit8(0x5d); emit8(0x5b);                  // pop rbp; pop rbx
+  emit8(0xc3);                               // ret
+}
+
+static inline uint8_t relop_cc(uint32_t relop) {
+  switch (relop) {
+    case RELOP_EQ:  return 0x4;
+    case RELOP_NE:  return 0x5;
+    case RELOP_LT:  return 0xc;
+    case RELOP_LE:  return 0xe;
+    case RELOP_GT:  return 0xf;
+    case RELOP_GE:  return 0xd;
+    case RELOP_LTU: return 0x2;
+    case RELOP_LEU: return 0x6;
+    case RELOP_GTU: return 0x7;
+    case RELOP_GEU: return 0x3;
+    default: panic("unsupport relop = %d", relop);
+  }
+}
+
+static uint32_t jit_div(uint32_t op, uint32_t a, uint32_t b, uint32_t c) {
+  rtlreg_t r;
+  switch (op) {
+    case JIT_DIV_Q:    interpret_rtl_div_q(&r, &a, &b); break;
+    case JIT_DIV_R:    interpret_rtl_div_r(&r, &a, &b); break;
+    case JIT_IDIV_Q:   interpret_rtl_idiv_q(&r, &a, &b); break;
+    case JIT_IDIV_R:   interpret_rtl_idiv_r(&r, &a, &b); break;
+    case JIT_DIV64_Q:  interpret_rtl_div64_q(&r, &a, &b, &c); break;
+    case JIT_DIV64_R:  interpret_rtl_div64_r(&r, &a, &b, &c); break;
+    case JIT_IDIV64_Q: interpret_rtl_idiv64_q(&r, &a, &b, &c); break;
+    case JIT_IDIV64_R: interpret_rtl_idiv64_r(&r, &a, &b, &c); break;
+    default: panic("should not reach here");
+  }
+  return r;
+}
+
+static void emit_ir(JitIR *ir) {
+  switch (ir->op) {
+    case JIT_LI:
+      emit_mov_ri(EAX, ir->imm);
+      emit_store(ir->dest, EAX);
+      break;
+    case JIT_MV:
+      emit_src(EAX, ir, 0);
+      emit_store(ir->dest, EAX);
+      break;
+
+    case JIT_ADD: case JIT_SUB: case JIT_AND: case JIT_OR: case JIT_XOR:
+    case JIT_SHL: case JIT_SHR: case JIT_SAR:
+    case JIT_MUL_LO: case JIT_MUL_HI: case JIT_IMUL_LO: case JIT_IMUL_HI:
+      emit_src(EAX, ir, 0);
+      emit_src(ECX, ir, 1);
+      switch (ir->op) {
+        case JIT_ADD: emit8(0x01); emit8(0xc8); break;  // add eax, ecx
+        case JIT_SUB: emit8(0x29); emit8(0xc8); break;  // sub eax, ecx
+        case JIT_AND: emit8(0x21); emit8(0xc8); break;  // and eax, ecx
+        case JIT_OR:  emit8(0x09); emit8(0xc8); break;  // or eax, ecx
+        case JIT_XOR: emit8(0x31); emit8(0xc8); break;  // xor eax, ecx
+        case JIT_SHL: emit8(0xd3); emit8(0xe0); break;  // shl eax, cl
+        case JIT_SHR: emit8(0xd3); emit8(0xe8); break;  // shr eax, cl
+        case JIT_SAR: emit8(0xd3); emit8(0xf8); break;  // sar eax, cl
+        case JIT_MUL_LO: case JIT_IMUL_LO:
+          emit8(0x0f); emit8(0xaf); emit8(0xc1); break;  // imul eax, ecx
+        case JIT_MUL_HI:
+          emit8(0xf7); emit8(0xe1);                      // mul ecx
+          emit_mov_rr(EAX, EDX); break;
+        case JIT_IMUL_HI:
+          emit8(0xf7); emit8(0xe9);                      // imul ecx
+          emit_mov_rr(EAX, EDX); break;
+      }
+      emit_store(ir->dest, EAX);
+      break;
+
+    case JIT_DIV_Q: case JIT_DIV_R: case JIT_IDIV_Q: case JIT_IDIV_R:
+    case JIT_DIV64_Q: case JIT_DIV64_R: case JIT_IDIV64_Q: case JIT_IDIV64_R:
+      emit_src(ESI, ir, 0);
+      emit_src(EDX, ir, 1);
+      if (ir->src[2] != NULL) emit_src(ECX, ir, 2);
+      emit_mov_ri(EDI, ir->op);
+      emit_call(jit_div);
+      emit_store(ir->dest, EAX);
+      break;
+
+    case JIT_LM:
+      emit_src(EDI, ir, 0);
+      emit_mov_ri(ESI, ir->aux);
+      emit_call(isa_vaddr_read);
+      emit_store(ir->dest, EAX);
+      break;
+    case JIT_SM:
+      emit_src(EDI, ir, 0);
+      emit_src(ESI, ir, 1);
+      emit_mov_ri(EDX, ir->aux);
+      emit_call(isa_vaddr_write);
+      break;
+
+    case JIT_HOST_LM:
+      if (ir->is_const & JIT_SRC_CONST(0)) emit_mov_ri(EAX, ir->cval[0]);
+      else {
+        switch (ir->aux) {
+          case 4: emit_load_mem(EAX, ir->src[0]); break;
+          case 1: emit8(0x41); emit8(0x0f); emit8(0xb6); emit_modrm_mem(EAX, ir->src[0]); break;
+          case 2: emit8(0x41); emit8(0x0f); emit8(0xb7); emit_modrm_mem(EAX, ir->src[0]); break;
+          default: rec_fail = true; return;
+        }
+      }
+      emit_store(ir->dest, EAX);
+      break;
+    case JIT_HOST_SM:
+      emit_src(EAX, ir, 0);
+      switch (ir->aux) {
+        case 4: emit_store_mem(ir->dest, EAX); break;
+        case 1: emit8(0x41); emit8(0x88); emit_modrm_mem(EAX, ir->dest); break;
+        case 2: emit8(0x66); emit8(0x41); emit8(0x89); emit_modrm_mem(EAX, ir->dest); break;
+        default: rec_fail = true; return;
+      }
+      break;
+
+    case JIT_SETRELOP:
+      if (ir->aux == RELOP_FALSE || ir->aux == RELOP_TRUE) {
+        emit_mov_ri(EAX, ir->aux == RELOP_TRUE);
+      }
+      else {
+        emit_src(EAX, ir, 0);
+        emit_src(ECX, ir, 1);
+        emit8(0x39); emit8(0xc8);                          // cmp eax, ecx
+        emit8(0x0f); emit8(0x90 | relop_cc(ir->aux)); emit8(0xc0);  // setcc al
+        emit8(0x0f); emit8(0xb6); emit8(0xc0);             // movzx eax, al
+      }
+      emit_store(ir->dest, EAX);
+      break;
+
+    case JIT_J:
+      emit_set_pc(ir->imm);
+      break;
+    case JIT_JR:
+      emit_src(EAX, ir, 0);
+      emit_store_mem(&cpu.pc, EAX);
+      break;
+    case JIT_JRELOP:
+      if (ir->aux == RELOP_FALSE) break;
+      if (ir->aux == RELOP_TRUE) { emit_set_pc(ir->imm); break; }
+      emit_src(EAX, ir, 0);
+      emit_src(ECX, ir, 1);
+      emit8(0x39); emit8(0xc8);                            // cmp eax, ecx
+      emit8(0x70 | (relop_cc(ir->aux) ^ 1)); emit8(11);    // j!cc over the next one
+      emit_set_pc(ir->imm);                                // 11 bytes
+      break;
+
+    default: rec_fail = true; break;
+  }
+}
+
+/* ---------------- driver ---------------- */
+
+void jit_flush(void) {
+  code_ptr = code_cache;
+  nr_code_flush ++;
+}
+
+/* Stop recording, and compile the trace of a block with `nr_instr'
+ * instructions. `*full' is set if the code cache is out of space.
+ */
+JitCode jit_record_end(int nr_instr, bool *full) {
+  jit_recording = false;
+  *full = false;
+  if (rec_fail) { nr_rejected ++; return NULL; }
+
+  size_t need = (size_t)nr_ir * 128 + (size_t)nr_instr * 128 + 512;
+  if (code_ptr + need > code_cache + CODE_CACHE_SIZE) {
+    *full = true;
+    return NULL;
+  }
+
+  extern __thread bool block_stop;
+  extern __thread uint32_t block_instr_idx;
+  base = (uintptr_t)&cpu;
+  regalloc();
+
+  uint8_t *start = code_ptr;
+  p = code_ptr;
+  emit_prologue();
+
+  int i, k = 0, idx_set = -1;
+  bool has_sm = false;
+  vaddr_t seq_pc = 0;
+  for (i = 0; i < nr_ir && !rec_fail; i ++) {
+    JitIR *ir = &ir_buf[i];
+    if (ir->op == JIT_INSTR) {
+      if (has_sm) {
+        // a store may have modified cached code, in which case
+        // the block stops after that instruction, as the interpreter does
+        emit8(0x41); emit8(0x80); emit_modrm_mem(7, &block_stop); emit8(0x00);  // cmp byte [block_stop], 0
+        emit8(0x74); uint8_t *rel = p; emit8(0);          // je next
+        emit_set_pc(seq_pc);
+        emit_exit(k);
+        *rel = p - rel - 1;
+        has_sm = false;
+      }
+      k ++;
+      seq_pc = ir->cval[0];
+      // fall through to the next block unless a jump says otherwise
+      if (k == nr_instr) emit_set_pc(seq_pc);
+      continue;
+    }
+    if (ir->op == JIT_SM) has_sm = true;
+    if ((ir->op == JIT_LM || ir->op == JIT_SM) && idx_set != k - 1) {
+      // a device accessed by the helper may ask for cpu_nr_instr()
+      emit_store_imm(&block_instr_idx, k - 1);
+      idx_set = k - 1;
+    }
+    emit_ir(ir);
+  }
+
+  if (rec_fail || k != nr_instr) { nr_rejected ++; return NULL; }
+  emit_exit(nr_instr);
+
+  code_ptr = p;
+  nr_compiled ++;
+  return (JitCode)start;
+}
+
+bool jit_is_enabled(void) {
+  return jit_enabled;
+}
+
+void jit_statistic(void) {
+  if (!jit_enabled) return;
+  Log("jit: compiled = %ld, rejected = %ld, code cache flushed = %ld, code cache used = %ld KB",
+      nr_compiled, nr_rejected, nr_code_flush, (long)(code_ptr - code_cache) / 1024);
+}
+
+#endif
+
+void init_jit(bool enable) {
+  if (!enable) return;
+#ifdef JIT
+  code_cache = mmap(NULL, CODE_CACHE_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC,
+      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (code_cache == MAP_FAILED) {
+    Log("Can not allocate the code cache, JIT is disabled");
+    code_cache = NULL;
+    return;
+  }
+  code_ptr = code_cache;
+  jit_enabled = true;
+  Log("JIT: \33[1;32m%s\33[0m", "ON");
+#else
+  Log("JIT is not built in (it needs BLOCK_CACHE and an x86-64 host), ignored");
+#endif
+}
+
+void free_jit(void) {
+#ifdef JIT
+  if (code_cache != NULL) munmap(code_cache, CODE_CACHE_SIZE);
+  code_cache = code_ptr = NULL;
+  jit_enabled = false;
+#endif
+}
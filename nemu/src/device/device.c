@@ -2,39 +2,23 @@
 
 #ifdef HAS_IOE
 
-#include <sys/time.h>
-#include <signal.h>
+#include "device/event.h"
 #include <SDL2/SDL.h>
 
-#define TIMER_HZ 100
-#define VGA_HZ 50
-
-static struct itimerval it = {};
-static int device_update_flag = false;
+#define INPUT_HZ 100
 
 void init_serial();
 void init_timer();
 void init_vga();
 void init_i8042();
+void init_perfcnt();
+void init_mpe();
 
-void timer_intr();
 void send_key(uint8_t, bool);
 
-static void timer_sig_handler(int signum) {
-  timer_intr();
-
-  device_update_flag = true;
-
-  int ret = setitimer(ITIMER_VIRTUAL, &it, NULL);
-  Assert(ret == 0, "Can not set timer");
-}
-
-void device_update() {
-  if (!device_update_flag) {
-    return;
-  }
-  device_update_flag = false;
+#ifndef RENDER_THREAD
 
+static void input_update() {
   SDL_Event event;
   while (SDL_PollEvent(&event)) {
     switch (event.type) {
@@ -62,26 +46,106 @@ void sdl_clear_event_queue() {
   while (SDL_PollEvent(&event));
 }
 
-void init_device() {
+#else
+
+/* The render thread owns SDL. It presents the frames from VGA, and
+ * passes key events to the CPU thread through a lock-free queue.
+ */
+
+void init_screen();
+bool vga_render();
+
+#define EVENT_QUEUE_LEN 1024
+#define EVENT_KEYDOWN 0x100
+
+static uint16_t event_queue[EVENT_QUEUE_LEN];
+static uint32_t event_head = 0;  // written by the render thread
+static uint32_t event_tail = 0;  // written by the CPU thread
+static bool quit_request = false;
+
+static void poll_events() {
+  SDL_Event event;
+  while (SDL_PollEvent(&event)) {
+    switch (event.type) {
+      case SDL_QUIT: __atomic_store_n(&quit_request, true, __ATOMIC_RELEASE); break;
+      case SDL_KEYDOWN:
+      case SDL_KEYUP: {
+                        uint32_t head = event_head;
+                        if (head - __atomic_load_n(&event_tail, __ATOMIC_ACQUIRE) == EVENT_QUEUE_LEN) {
+                          // the CPU thread is far behind, drop the event
+                          break;
+                        }
+                        event_queue[head % EVENT_QUEUE_LEN] = (uint8_t)event.key.keysym.scancode |
+                          (event.key.type == SDL_KEYDOWN ? EVENT_KEYDOWN : 0);
+                        __atomic_store_n(&event_head, head + 1, __ATOMIC_RELEASE);
+                        break;
+                      }
+      default: break;
+    }
+  }
+}
+
+static int render_thread(void *arg) {
+  init_screen();
+  while (true) {
+    poll_events();
+    if (!vga_render()) SDL_Delay(1);
+  }
+  return 0;
+}
+
+static void input_update() {
+  uint32_t head = __atomic_load_n(&event_head, __ATOMIC_ACQUIRE);
+  for (; event_tail != head; event_tail ++) {
+    uint16_t e = event_queue[event_tail % EVENT_QUEUE_LEN];
+    send_key(e & 0xff, (e & EVENT_KEYDOWN) != 0);
+  }
+  __atomic_store_n(&event_tail, head, __ATOMIC_RELEASE);
+
+  if (__atomic_load_n(&quit_request, __ATOMIC_ACQUIRE)) {
+    void monitor_statistic();
+    monitor_statistic();
+    exit(0);
+  }
+}
+
+void sdl_clear_event_queue() {
+  __atomic_store_n(&event_tail, __atomic_load_n(&event_head, __ATOMIC_ACQUIRE), __ATOMIC_RELEASE);
+}
+
+#endif
+
+/* the devices without the screen and the keyboard */
+void init_device_headless() {
   init_serial();
   init_timer();
+  init_perfcnt();
+  init_mpe();
+}
+
+void init_device() {
+  init_device_headless();
   init_vga();
   init_i8042();
 
-  struct sigaction s;
-  memset(&s, 0, sizeof(s));
-  s.sa_handler = timer_sig_handler;
-  int ret = sigaction(SIGVTALRM, &s, NULL);
-  Assert(ret == 0, "Can not set signal handler");
+#ifdef RENDER_THREAD
+  SDL_Thread *t = SDL_CreateThread(render_thread, "render", NULL);
+  Assert(t != NULL, "Can not create the render thread");
+#endif
 
-  it.it_value.tv_sec = 0;
-  it.it_value.tv_usec = 1000000 / TIMER_HZ;
-  ret = setitimer(ITIMER_VIRTUAL, &it, NULL);
-  Assert(ret == 0, "Can not set timer");
+  add_event("input", INPUT_HZ, input_update);
 }
 #else
 
+void init_mpe();
+
+/* the harts are started on the MPE device */
+void init_device_headless() {
+  init_mpe();
+}
+
 void init_device() {
+  init_device_headless();
 }
 
 #endif	/* HAS_IOE */
@@ -0,0 +1,103 @@
+#include "common.h"
+#include "device/event.h"
+#include "monitor/snapshot.h"
+#include <sys/time.h>
+#include <signal.h>
+
+#define NR_EVENT 8
+
+typedef struct {
+  const char *name;
+  uint64_t period;    // in instructions, or in microseconds for the wall clock
+  uint64_t deadline;
+  event_callback_t callback;
+} Event;
+
+static __thread Event events[NR_EVENT];
+static __thread int nr_event = 0;
+static __thread bool wall_clock = false;
+
+__thread volatile uint64_t event_next = UINT64_MAX;
+
+static inline uint64_t host_us() {
+  struct timeval now;
+  gettimeofday(&now, NULL);
+  return now.tv_sec * 1000000ull + now.tv_usec;
+}
+
+uint64_t cpu_nr_instr(void);
+
+/* the guest time in microseconds */
+uint64_t event_clock_us(void) {
+  if (wall_clock) return host_us();
+  // also counts the instructions retired in the running block
+  return cpu_nr_instr() / (EVENT_CLOCK_HZ / 1000000);
+}
+
+static inline uint64_t event_now() {
+  return (wall_clock ? host_us() : cpu_nr_instr());
+}
+
+void add_event(const char *name, int hz, event_callback_t callback) {
+  assert(nr_event < NR_EVENT);
+  Event *e = &events[nr_event ++];
+  e->name = name;
+  e->period = (wall_clock ? 1000000 : EVENT_CLOCK_HZ) / hz;
+  e->deadline = event_now() + e->period;
+  e->callback = callback;
+  snapshot_add(name, &e->deadline, sizeof(e->deadline));
+  Log("Add event '%s' at %d Hz", name, hz);
+
+  if (!wall_clock && e->deadline < event_next) event_next = e->deadline;
+}
+
+void event_run(void) {
+  // in the wall-clock mode, wait for the next timer signal
+  event_next = UINT64_MAX;
+
+  uint64_t now = event_now(), next = UINT64_MAX;
+  int i;
+  for (i = 0; i < nr_event; i ++) {
+    Event *e = &events[i];
+    if (now >= e->deadline) {
+      e->callback();
+      e->deadline += e->period;
+      // do not try to catch up after falling behind
+      if (e->deadline <= now) e->deadline = now + e->period;
+    }
+    if (e->deadline < next) next = e->deadline;
+  }
+
+  if (!wall_clock) event_next = next;
+}
+
+static struct itimerval it = {};
+// the signal may be taken by any thread
+static volatile uint64_t *wall_clock_next = NULL;
+
+static void timer_sig_handler(int signum) {
+  *wall_clock_next = 0;
+
+  int ret = setitimer(ITIMER_VIRTUAL, &it, NULL);
+  Assert(ret == 0, "Can not set timer");
+}
+
+void init_event(bool is_wall_clock) {
+  wall_clock = is_wall_clock;
+  if (!wall_clock) return;
+
+  Log("Events are timed by the wall clock");
+  wall_clock_next = &event_next;
+
+  struct sigaction s;
+  memset(&s, 0, sizeof(s));
+  s.sa_handler = timer_sig_handler;
+  int ret = sigaction(SIGVTALRM, &s, NULL);
+  Assert(ret == 0, "Can not set signal handler");
+
+  // fast enough for the events of all devices
+  it.it_value.tv_sec = 0;
+  it.it_value.tv_usec = 1000000 / 100;
+  ret = setitimer(ITIMER_VIRTUAL, &it, NULL);
+  Assert(ret == 0, "Can not set timer");
+}
@@ -1,21 +1,31 @@
 #include "memory/memory.h"
 #include "device/map.h"
 #include "nemu.h"
+#include "monitor/snapshot.h"
+#include "monitor/machine.h"
 
-#define IO_SPACE_MAX (1024 * 1024)
-
-static uint8_t io_space[IO_SPACE_MAX] PG_ALIGN = {};
-static uint8_t *p_space = io_space;
+#define io_space (mctx->io_space)
+static __thread uint8_t *p_space = NULL;
 
 uint8_t* new_space(int size) {
+  if (p_space == NULL) p_space = io_space;
   uint8_t *p = p_space;
   // page aligned;
   size = (size + (PAGE_SIZE - 1)) & ~PAGE_MASK;
   p_space += size;
   assert(p_space - io_space < IO_SPACE_MAX);
+  snapshot_add("io space", p, size);
   return p;
 }
 
+IOMap* new_map(char *name, paddr_t addr, uint8_t *space, int len, io_callback_t callback) {
+  assert(mctx->nr_map < NR_IO_MAP);
+  IOMap *map = &mctx->maps[mctx->nr_map ++];
+  *map = (IOMap){ .name = name, .low = addr, .high = addr + len - 1,
+    .space = space, .callback = callback };
+  return map;
+}
+
 static inline void check_bound(IOMap *map, paddr_t addr) {
   Assert(map != NULL && addr <= map->high && addr >= map->low,
       "address (0x%08x) is out of bound {%s} [0x%08x, 0x%08x] at pc = 0x%08x",
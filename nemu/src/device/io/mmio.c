@@ -1,23 +1,71 @@
 #include "common.h"
 #include "device/map.h"
+#include "monitor/machine.h"
+#include <stdlib.h>
 
-#define NR_MAP 8
+/* MMIO maps are found through a two-level table indexed by the page
+ * number, like a page table. Each page with devices has a NULL-terminated
+ * list of the maps overlapping it, usually only one.
+ */
 
-static IOMap maps[NR_MAP] = {};
-static int nr_map = 0;
+#define mmio_table (mctx->mmio_table)
+
+static MMIOPage* mmio_page(paddr_t addr, bool create) {
+  uint32_t pn = addr >> MMIO_PAGE_SHIFT;
+  MMIOPage **l1 = &mmio_table[pn >> MMIO_L2_BITS];
+  if (*l1 == NULL) {
+    if (!create) return NULL;
+    *l1 = calloc(1 << MMIO_L2_BITS, sizeof(MMIOPage));
+    assert(*l1);
+  }
+  return &(*l1)[pn & ((1 << MMIO_L2_BITS) - 1)];
+}
+
+static void mmio_page_add(paddr_t addr, IOMap *map) {
+  MMIOPage *page = mmio_page(addr, true);
+  int n = 0;
+  if (*page != NULL) {
+    while ((*page)[n] != NULL) n ++;
+  }
+  *page = realloc(*page, sizeof(IOMap *) * (n + 2));
+  assert(*page);
+  (*page)[n] = map;
+  (*page)[n + 1] = NULL;
+}
 
 /* device interface */
 void add_mmio_map(char *name, paddr_t addr, uint8_t* space, int len, io_callback_t callback) {
-  assert(nr_map < NR_MAP);
-  maps[nr_map] = (IOMap){ .name = name, .low = addr, .high = addr + len - 1,
-    .space = space, .callback = callback };
-  Log("Add mmio map '%s' at [0x%08x, 0x%08x]", maps[nr_map].name, maps[nr_map].low, maps[nr_map].high);
+  IOMap *map = new_map(name, addr, space, len, callback);
+  Log("Add mmio map '%s' at [0x%08x, 0x%08x]", map->name, map->low, map->high);
 
-  nr_map ++;
+  uint64_t pn;
+  for (pn = map->low >> MMIO_PAGE_SHIFT; pn <= map->high >> MMIO_PAGE_SHIFT; pn ++) {
+    mmio_page_add(pn << MMIO_PAGE_SHIFT, map);
+  }
+}
+
+// called when the machine goes away
+void free_mmio_table(void) {
+  int i, j;
+  for (i = 0; i < (1 << MMIO_L1_BITS); i ++) {
+    if (mmio_table[i] == NULL) continue;
+    for (j = 0; j < (1 << MMIO_L2_BITS); j ++) free(mmio_table[i][j]);
+    free(mmio_table[i]);
+    mmio_table[i] = NULL;
+  }
 }
 
 /* bus interface */
 IOMap* fetch_mmio_map(paddr_t addr) {
-  int mapid = find_mapid_by_addr(maps, nr_map, addr);
-  return (mapid == -1 ? NULL : &maps[mapid]);
+  MMIOPage *page = mmio_page(addr, false);
+  if (page == NULL || *page == NULL) return NULL;
+
+  IOMap **map;
+  for (map = *page; *map != NULL; map ++) {
+    if (map_inside(*map, addr)) {
+      difftest_skip_ref();
+      return *map;
+    }
+  }
+  return NULL;
 }
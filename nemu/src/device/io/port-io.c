@@ -1,35 +1,43 @@
 #include "common.h"
 #include "device/map.h"
+#include "cpu/jit.h"
+#include "cpu/hart.h"
+#include "monitor/machine.h"
 
-#define PORT_IO_SPACE_MAX 65535
-
-#define NR_MAP 8
-static IOMap maps[NR_MAP] = {};
-static int nr_map = 0;
+/* the map of each port */
+#define port_map (mctx->port_map)
 
 /* device interface */
 void add_pio_map(char *name, ioaddr_t addr, uint8_t *space, int len, io_callback_t callback) {
-  assert(nr_map < NR_MAP);
   assert(addr + len <= PORT_IO_SPACE_MAX);
-  maps[nr_map] = (IOMap){ .name = name, .low = addr, .high = addr + len - 1,
-    .space = space, .callback = callback };
-  Log("Add port-io map '%s' at [0x%08x, 0x%08x]", maps[nr_map].name, maps[nr_map].low, maps[nr_map].high);
+  IOMap *map = new_map(name, addr, space, len, callback);
+  Log("Add port-io map '%s' at [0x%08x, 0x%08x]", map->name, map->low, map->high);
 
-  nr_map ++;
+  int i;
+  for (i = map->low; i <= map->high; i ++) {
+    Assert(port_map[i] == NULL, "port 0x%04x of '%s' is already used by '%s'", i, name, port_map[i]->name);
+    port_map[i] = map;
+  }
 }
 
-static inline uint32_t pio_read_common(ioaddr_t addr, int len) {
+static inline IOMap* fetch_pio_map(ioaddr_t addr, int len) {
   assert(addr + len - 1 < PORT_IO_SPACE_MAX);
-  int mapid = find_mapid_by_addr(maps, nr_map, addr);
-  assert(mapid != -1);
-  return map_read(addr, len, &maps[mapid]);
+  IOMap *map = port_map[addr];
+  assert(map != NULL);
+  difftest_skip_ref();
+  return map;
+}
+
+static inline uint32_t pio_read_common(ioaddr_t addr, int len) {
+  jit_barrier();
+  if (hart_id != 0) return hart_io_read(addr, len, true);
+  return map_read(addr, len, fetch_pio_map(addr, len));
 }
 
 static inline void pio_write_common(ioaddr_t addr, uint32_t data, int len) {
-  assert(addr + len - 1 < PORT_IO_SPACE_MAX);
-  int mapid = find_mapid_by_addr(maps, nr_map, addr);
-  assert(mapid != -1);
-  map_write(addr, data, len, &maps[mapid]);
+  jit_barrier();
+  if (hart_id != 0) { hart_io_write(addr, data, len, true); return; }
+  map_write(addr, data, len, fetch_pio_map(addr, len));
 }
 
 /* CPU interface */
@@ -1,12 +1,13 @@
 #include "device/map.h"
 #include "monitor/monitor.h"
+#include "monitor/snapshot.h"
 #include <SDL2/SDL.h>
 
 #define I8042_DATA_PORT 0x60
 #define I8042_DATA_MMIO 0xa1000060
 #define KEYBOARD_IRQ 1
 
-static uint32_t *i8042_data_port_base = NULL;
+static __thread uint32_t *i8042_data_port_base = NULL;
 
 // Note that this is not the standard
 #define _KEYS(f) \
@@ -31,8 +32,8 @@ static uint32_t keymap[256] = {
 };
 
 #define KEY_QUEUE_LEN 1024
-static int key_queue[KEY_QUEUE_LEN] = {};
-static int key_f = 0, key_r = 0;
+static __thread int key_queue[KEY_QUEUE_LEN] = {};
+static __thread int key_f = 0, key_r = 0;
 
 #define KEYDOWN_MASK 0x8000
 
@@ -63,4 +64,8 @@ void init_i8042() {
   i8042_data_port_base[0] = _KEY_NONE;
   add_pio_map("keyboard", I8042_DATA_PORT, (void *)i8042_data_port_base, 4, i8042_data_io_handler);
   add_mmio_map("keyboard", I8042_DATA_MMIO, (void *)i8042_data_port_base, 4, i8042_data_io_handler);
+
+  snapshot_add("key queue", key_queue, sizeof(key_queue));
+  snapshot_add("key front", &key_f, sizeof(key_f));
+  snapshot_add("key rear", &key_r, sizeof(key_r));
 }
@@ -0,0 +1,34 @@
+#include "device/map.h"
+#include "cpu/hart.h"
+
+/* The AM multi-processor extension. Reading NCPU or CPU returns the
+ * number of harts or the id of the hart reading it. Writing an entry
+ * to START starts all the other harts there, and writing STOP stops the
+ * hart writing it.
+ */
+
+#define MPE_PORT 0x300  // Note that this is not the standard
+#define MPE_MMIO 0xa1000300
+
+#define NCPU_OFFSET  0
+#define CPU_OFFSET   4
+#define START_OFFSET 8
+#define STOP_OFFSET  12
+
+static __thread uint32_t *mpe_base = NULL;
+
+static void mpe_io_handler(uint32_t offset, int len, bool is_write) {
+  switch (offset) {
+    case NCPU_OFFSET: mpe_base[0] = nr_hart; break;
+    case CPU_OFFSET: mpe_base[1] = hart_io_id(); break;
+    case START_OFFSET: if (is_write) hart_start(mpe_base[2]); break;
+    case STOP_OFFSET: if (is_write) hart_stop(hart_io_id()); break;
+  }
+}
+
+void init_mpe() {
+  int size = 16;
+  mpe_base = (void *)new_space(size);
+  add_pio_map("mpe", MPE_PORT, (void *)mpe_base, size, mpe_io_handler);
+  add_mmio_map("mpe", MPE_MMIO, (void *)mpe_base, size, mpe_io_handler);
+}
@@ -0,0 +1,65 @@
+#include "device/map.h"
+#include "device/perfcnt.h"
+#include "memory/cache.h"
+#include "cpu/bpred.h"
+
+/* The AM performance counter. Writing the control register latches all
+ * counters, which are then read as pairs of 32-bit words, low word first.
+ * Reading the control register returns which misses are modeled.
+ */
+
+#define PERFCNT_PORT 0x200  // Note that this is not the standard
+#define PERFCNT_MMIO 0xa1000200
+
+enum { PERFCNT_INSTR, PERFCNT_CYCLE, PERFCNT_LOAD, PERFCNT_STORE, PERFCNT_BRANCH,
+  PERFCNT_ICACHE_MISS, PERFCNT_DCACHE_MISS, PERFCNT_TLB_MISS, NR_PERFCNT };
+
+#define CTRL_OFFSET 0
+#define CNT_OFFSET 8
+#define PERFCNT_HAS_CACHE 0x1
+#define PERFCNT_HAS_TLB   0x2
+
+/* penalties in cycles of the modeled pipeline, which otherwise
+ * retires an instruction per cycle */
+#define LOAD_PENALTY   1
+#define BRANCH_PENALTY 2   // of a taken branch, without a branch predictor
+#define MISPREDICT_PENALTY 10
+#define TLB_PENALTY    20
+#define L1_MISS_PENALTY 10
+#define L2_MISS_PENALTY 100
+
+__thread PerfCnt perfcnt = {};
+
+static __thread uint32_t *perfcnt_base = NULL;
+
+uint64_t cpu_nr_instr(void);
+uint64_t tlb_nr_miss(void);
+
+static void perfcnt_io_handler(uint32_t offset, int len, bool is_write) {
+  if (offset != CTRL_OFFSET) return;
+  if (!is_write) {
+    perfcnt_base[0] = PERFCNT_HAS_TLB | (cache_enabled() ? PERFCNT_HAS_CACHE : 0);
+    return;
+  }
+
+  uint64_t cnt[NR_PERFCNT] = {};
+  cnt[PERFCNT_INSTR] = cpu_nr_instr();
+  cnt[PERFCNT_LOAD] = perfcnt.load;
+  cnt[PERFCNT_STORE] = perfcnt.store;
+  cnt[PERFCNT_BRANCH] = perfcnt.branch;
+  cnt[PERFCNT_TLB_MISS] = tlb_nr_miss();
+  cnt[PERFCNT_ICACHE_MISS] = cache_nr_miss(CACHE_L1I);
+  cnt[PERFCNT_DCACHE_MISS] = cache_nr_miss(CACHE_L1D);
+  cnt[PERFCNT_CYCLE] = cnt[PERFCNT_INSTR] + cnt[PERFCNT_LOAD] * LOAD_PENALTY +
+    (bpred_enabled() ? bpred_nr_miss() * MISPREDICT_PENALTY : cnt[PERFCNT_BRANCH] * BRANCH_PENALTY) + cnt[PERFCNT_TLB_MISS] * TLB_PENALTY +
+    (cnt[PERFCNT_ICACHE_MISS] + cnt[PERFCNT_DCACHE_MISS]) * L1_MISS_PENALTY +
+    cache_nr_miss(CACHE_L2) * L2_MISS_PENALTY;
+  memcpy(perfcnt_base + CNT_OFFSET / 4, cnt, sizeof(cnt));
+}
+
+void init_perfcnt() {
+  int size = CNT_OFFSET + NR_PERFCNT * 8;
+  perfcnt_base = (void *)new_space(size);
+  add_pio_map("perfcnt", PERFCNT_PORT, (void *)perfcnt_base, size, perfcnt_io_handler);
+  add_mmio_map("perfcnt", PERFCNT_MMIO, (void *)perfcnt_base, size, perfcnt_io_handler);
+}
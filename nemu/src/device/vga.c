@@ -3,6 +3,8 @@
 #ifdef HAS_IOE
 
 #include "device/map.h"
+#include "device/event.h"
+#include "monitor/snapshot.h"
 #include <SDL2/SDL.h>
 
 #define VMEM 0xa0000000
@@ -13,6 +15,7 @@
 #define SYNC_MMIO 0xa1000104
 #define SCREEN_H 300
 #define SCREEN_W 400
+#define VGA_HZ 50
 
 static SDL_Window *window = NULL;
 static SDL_Renderer *renderer = NULL;
@@ -21,19 +24,149 @@ static SDL_Texture *texture = NULL;
 static uint32_t (*vmem) [SCREEN_W] = NULL;
 static uint32_t *screensize_port_base = NULL;
 
-static inline void update_screen() {
-  SDL_UpdateTexture(texture, NULL, vmem, SCREEN_W * sizeof(vmem[0][0]));
+/* The columns written in a scanline, none if x0 > x1. */
+typedef struct {
+  int16_t x0, x1;
+} Damage;
+
+static Damage damage[SCREEN_H];
+static bool screen_damaged = false;
+static bool sync_pending = false;
+
+static inline void damage_pixel(uint32_t pixel) {
+  int y = pixel / SCREEN_W, x = pixel % SCREEN_W;
+  if (y >= SCREEN_H) return;
+  if (x < damage[y].x0) damage[y].x0 = x;
+  if (x > damage[y].x1) damage[y].x1 = x;
+  screen_damaged = true;
+}
+
+static inline void damage_all() {
+  int y;
+  for (y = 0; y < SCREEN_H; y ++) {
+    damage[y].x0 = 0;
+    damage[y].x1 = SCREEN_W - 1;
+  }
+  screen_damaged = true;
+}
+
+static void vmem_io_handler(uint32_t offset, int len, bool is_write) {
+  if (!is_write) return;
+  damage_pixel(offset / sizeof(uint32_t));
+  damage_pixel((offset + len - 1) / sizeof(uint32_t));
+}
+
+static inline void upload_rect(uint32_t (*pixels)[SCREEN_W], int x, int y, int w, int h) {
+  SDL_Rect rect = { .x = x, .y = y, .w = w, .h = h };
+  uint8_t *p;
+  int pitch, i;
+  SDL_LockTexture(texture, &rect, (void **)&p, &pitch);
+  for (i = 0; i < h; i ++) {
+    memcpy(p + i * pitch, &pixels[y + i][x], w * sizeof(pixels[0][0]));
+  }
+  SDL_UnlockTexture(texture);
+}
+
+/* Upload runs of damaged scanlines of `pixels', each as one rectangle,
+ * and clear the damage.
+ */
+static void upload_damage(Damage *d, uint32_t (*pixels)[SCREEN_W]) {
+  int y = 0;
+  while (y < SCREEN_H) {
+    if (d[y].x0 > d[y].x1) { y ++; continue; }
+
+    int y0 = y, x0 = d[y].x0, x1 = d[y].x1;
+    for (; y < SCREEN_H && d[y].x0 <= d[y].x1; y ++) {
+      if (d[y].x0 < x0) x0 = d[y].x0;
+      if (d[y].x1 > x1) x1 = d[y].x1;
+      d[y].x0 = SCREEN_W;
+      d[y].x1 = -1;
+    }
+    upload_rect(pixels, x0, y0, x1 - x0 + 1, y - y0);
+  }
+}
+
+static inline void present() {
   SDL_RenderClear(renderer);
   SDL_RenderCopy(renderer, texture, NULL, NULL);
   SDL_RenderPresent(renderer);
 }
 
+#ifdef RENDER_THREAD
+
+/* Frames go to the render thread through two buffers, without locks.
+ * A frame only carries the damaged part of the screen, since the
+ * texture keeps the rest.
+ */
+typedef struct {
+  Damage damage[SCREEN_H];
+  uint32_t pixels[SCREEN_H][SCREEN_W];
+} Frame;
+
+static Frame frame[2];
+static uint32_t frame_head = 0;  // next frame to fill, written by the CPU thread
+static uint32_t frame_tail = 0;  // next frame to present, written by the render thread
+
+static void update_screen() {
+  if (!screen_damaged) { sync_pending = false; return; }
+  if (frame_head - __atomic_load_n(&frame_tail, __ATOMIC_ACQUIRE) == 2) {
+    // both buffers are in use, retry at the next refresh instead of waiting
+    return;
+  }
+
+  Frame *f = &frame[frame_head % 2];
+  int y;
+  for (y = 0; y < SCREEN_H; y ++) {
+    f->damage[y] = damage[y];
+    if (damage[y].x0 <= damage[y].x1) {
+      memcpy(&f->pixels[y][damage[y].x0], &vmem[y][damage[y].x0],
+          (damage[y].x1 - damage[y].x0 + 1) * sizeof(vmem[0][0]));
+      damage[y].x0 = SCREEN_W;
+      damage[y].x1 = -1;
+    }
+  }
+  screen_damaged = false;
+  sync_pending = false;
+  __atomic_store_n(&frame_head, frame_head + 1, __ATOMIC_RELEASE);
+}
+
+/* called by the render thread, return whether a frame is presented */
+bool vga_render() {
+  uint32_t tail = frame_tail;
+  if (__atomic_load_n(&frame_head, __ATOMIC_ACQUIRE) == tail) return false;
+
+  Frame *f = &frame[tail % 2];
+  upload_damage(f->damage, f->pixels);
+  __atomic_store_n(&frame_tail, tail + 1, __ATOMIC_RELEASE);
+  present();
+  return true;
+}
+
+#else
+
+static inline void update_screen() {
+  sync_pending = false;
+  if (!screen_damaged) return;
+  upload_damage(damage, vmem);
+  screen_damaged = false;
+  present();
+}
+
+#endif
+
 static void vga_io_handler(uint32_t offset, int len, bool is_write) {
-  // TODO: call `update_screen()` when writing to the sync register
-  TODO();
+  // writing the sync register presents the frame at the next refresh
+  if (is_write && offset == 4) {
+    sync_pending = true;
+  }
 }
 
-void init_vga() {
+static void vga_refresh() {
+  if (sync_pending) update_screen();
+}
+
+/* called by the thread owning the screen */
+void init_screen() {
   char title[128];
   sprintf(title, "%s-NEMU", str(__ISA__));
 
@@ -41,7 +174,13 @@ void init_vga() {
   SDL_CreateWindowAndRenderer(SCREEN_W * 2, SCREEN_H * 2, 0, &window, &renderer);
   SDL_SetWindowTitle(window, title);
   texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888,
-      SDL_TEXTUREACCESS_STATIC, SCREEN_W, SCREEN_H);
+      SDL_TEXTUREACCESS_STREAMING, SCREEN_W, SCREEN_H);
+}
+
+void init_vga() {
+#ifndef RENDER_THREAD
+  init_screen();
+#endif
 
   screensize_port_base = (void *)new_space(8);
   screensize_port_base[0] = ((SCREEN_W) << 16) | (SCREEN_H);
@@ -49,6 +188,10 @@ void init_vga() {
   add_mmio_map("screen", SCREEN_MMIO, (void *)screensize_port_base, 8, vga_io_handler);
 
   vmem = (void *)new_space(0x80000);
-  add_mmio_map("vmem", VMEM, (void *)vmem, 0x80000, NULL);
+  add_mmio_map("vmem", VMEM, (void *)vmem, 0x80000, vmem_io_handler);
+  damage_all();
+  snapshot_add_hook(damage_all);
+
+  add_event("vga", VGA_HZ, vga_refresh);
 }
 #endif	/* HAS_IOE */
@@ -17,6 +17,7 @@ static inline make_DopHelper(r) {
   op->reg = val;
   if (load_val) {
     rtl_lr(&op->val, op->reg, 4);
+    op_reload_reg(op, 4);
   }
 
   print_Dop(op->str, OP_STR_SIZE, "%s", reg_name(op->reg, 4));
@@ -30,12 +31,28 @@ make_DHelper(IU) {
   print_Dop(id_src2->str, OP_STR_SIZE, "0x%x", decinfo.isa.instr.imm);
 }
 
+make_DHelper(J) {
+  // the delay slot is not modeled, the target is in the same 256MB region
+  decinfo.jmp_pc = ((cpu.pc + 4) & 0xf0000000) | (decinfo.isa.instr.jmp_target << 2);
+  decode_op_i(id_src, decinfo.jmp_pc, true);
+
+  print_Dop(id_src->str, OP_STR_SIZE, "0x%x", decinfo.jmp_pc);
+}
+
+make_DHelper(R) {
+  decode_op_r(id_src, decinfo.isa.instr.rs, true);
+  decode_op_r(id_src2, decinfo.isa.instr.rt, true);
+  decode_op_r(id_dest, decinfo.isa.instr.rd, false);
+}
+
 static inline make_DHelper(addr) {
   decode_op_r(id_src, decinfo.isa.instr.rs, true);
   decode_op_i(id_src2, decinfo.isa.instr.simm, true);
 
   print_Dop(id_src->str, OP_STR_SIZE, "%d(%s)", id_src2->val, reg_name(id_src->reg, 4));
 
+  // `addr' shares the storage with `reg'
+  op_reload_addr(id_src, id_src->reg, -1, 0, id_src2->val);
   rtl_add(&id_src->addr, &id_src->val, &id_src2->val);
 }
 
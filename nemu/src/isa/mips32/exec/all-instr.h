@@ -2,6 +2,10 @@
 
 make_EHelper(lui);
 
+make_EHelper(jal);
+make_EHelper(jr);
+make_EHelper(jalr);
+
 make_EHelper(ld);
 make_EHelper(st);
 
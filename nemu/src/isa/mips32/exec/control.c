@@ -1 +1,36 @@
 #include "cpu/exec.h"
+#include "monitor/ftrace.h"
+
+/* The delay slot is not modeled. Programs are compiled with
+ * -fno-delayed-branch, which leaves a nop there, so the return
+ * address skips it. `jr $ra' returns from a function. */
+#define R_RA 31
+
+make_EHelper(jal) {
+  // the target address is calculated at the decode stage
+  rtl_li(&s0, decinfo.seq_pc + 4);
+  rtl_sr(R_RA, &s0, 4);
+  bpred_call(decinfo.seq_pc + 4);
+  rtl_j(decinfo.jmp_pc);
+  ftrace_call(decinfo.jmp_pc, decinfo.seq_pc + 4);
+
+  print_asm("jal %s", id_src->str);
+}
+
+make_EHelper(jr) {
+  if (id_src->reg == R_RA) bpred_ret();
+  rtl_jr(&id_src->val);
+  if (id_src->reg == R_RA) ftrace_ret(id_src->val);
+
+  print_asm("jr %s", id_src->str);
+}
+
+make_EHelper(jalr) {
+  rtl_li(&s0, decinfo.seq_pc + 4);
+  rtl_sr(id_dest->reg, &s0, 4);
+  if (id_dest->reg == R_RA) bpred_call(decinfo.seq_pc + 4);
+  rtl_jr(&id_src->val);
+  if (id_dest->reg == R_RA) ftrace_call(id_src->val, decinfo.seq_pc + 4);
+
+  print_asm("jalr %s,%s", id_dest->str, id_src->str);
+}
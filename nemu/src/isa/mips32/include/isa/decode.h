@@ -35,6 +35,8 @@ struct ISADecodeInfo {
 };
 
 make_DHelper(IU);
+make_DHelper(J);
+make_DHelper(R);
 make_DHelper(ld);
 make_DHelper(st);
 
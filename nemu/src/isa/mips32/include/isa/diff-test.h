@@ -3,4 +3,7 @@
 
 #define DIFFTEST_REG_SIZE (sizeof(uint32_t) * 38) // GRPs + status + lo + hi + badvaddr + cause + pc
 
+#define isa_difftest_regs_out()
+#define isa_difftest_regs_in()
+
 #endif
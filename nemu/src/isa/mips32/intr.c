@@ -1,7 +1,10 @@
 #include "rtl/rtl.h"
+#include "cpu/jit.h"
 #include <setjmp.h>
 
 void raise_intr(uint32_t NO, vaddr_t epc) {
+  jit_barrier();
+
   /* TODO: Trigger an interrupt/exception with ``NO''.
    * That is, use ``NO'' to index the IDT.
    */
@@ -11,7 +14,7 @@ bool isa_query_intr(void) {
   return false;
 }
 
-jmp_buf intr_buf;
+__thread jmp_buf intr_buf;
 
 void longjmp_raise_intr(uint32_t NO) {
   longjmp(intr_buf, NO + 1);
@@ -1,13 +1,44 @@
 #include "nemu.h"
+#include "memory/tlb.h"
+
+void raise_intr(uint32_t NO, vaddr_t epc);
 
 static inline paddr_t va2pa(vaddr_t addr, bool write) {
   return addr;
 }
 
+/* Called by the software TLB on a miss. Modifying the translation used
+ * by va2pa() must call tlb_flush().
+ */
+paddr_t isa_tlb_walk(vaddr_t vaddr, int type, int *perm) {
+  *perm = TLB_R | TLB_W | TLB_X;
+  return va2pa(vaddr, type == TLB_W);
+}
+
+/* Called by the TLB when an access faults, with the cause of a TLB
+ * exception on a load or a fetch (TLBL), or on a store (TLBS).
+ * `vaddr' goes to BadVAddr once it is kept.
+ */
+void isa_tlb_fault(vaddr_t vaddr, int type, vaddr_t pc) {
+  raise_intr(type == TLB_W ? 3 : 2, pc);
+}
+
 uint32_t isa_vaddr_read(vaddr_t addr, int len) {
-  return paddr_read(va2pa(addr, false), len);
+  return tlb_read(addr, len, TLB_R);
+}
+
+uint32_t isa_vaddr_ifetch(vaddr_t addr, int len) {
+  return tlb_read(addr, len, TLB_X);
 }
 
 void isa_vaddr_write(vaddr_t addr, uint32_t data, int len) {
-  paddr_write(va2pa(addr, true), data, len);
+  tlb_write(addr, data, len);
+}
+
+uint32_t isa_vaddr_atomic(vaddr_t addr, uint32_t data, int len, int op) {
+  return tlb_atomic(addr, data, len, op);
+}
+
+bool isa_vaddr_cas(vaddr_t addr, uint32_t expect, uint32_t data) {
+  return tlb_cas(addr, expect, data);
 }
@@ -10,6 +10,18 @@ const char *regsl[] = {
 void isa_reg_display() {
 }
 
+/* Return where the register named `s' is kept, or NULL if there is no such register. */
+rtlreg_t* isa_reg_str2ptr(const char *s) {
+  int i;
+  if (strcmp(s, "pc") == 0) return &cpu.pc;
+  for (i = 0; i < 32; i ++) {
+    if (strcmp(s, regsl[i]) == 0) return &reg_l(i);
+  }
+  return NULL;
+}
+
 uint32_t isa_reg_str2val(const char *s, bool *success) {
-  return 0;
+  rtlreg_t *p = isa_reg_str2ptr(s);
+  *success = (p != NULL);
+  return (p ? *p : 0);
 }
@@ -17,6 +17,7 @@ static inline make_DopHelper(r) {
   op->reg = val;
   if (load_val) {
     rtl_lr(&op->val, op->reg, 4);
+    op_reload_reg(op, 4);
   }
 
   print_Dop(op->str, OP_STR_SIZE, "%s", reg_name(op->reg, 4));
@@ -29,12 +30,30 @@ make_DHelper(U) {
   print_Dop(id_src->str, OP_STR_SIZE, "0x%x", decinfo.isa.instr.imm31_12);
 }
 
+make_DHelper(I) {
+  decode_op_r(id_src, decinfo.isa.instr.rs1, true);
+  decode_op_i(id_src2, decinfo.isa.instr.simm11_0, true);
+  decode_op_r(id_dest, decinfo.isa.instr.rd, false);
+}
+
+make_DHelper(J) {
+  int32_t offset = (decinfo.isa.instr.simm20 << 20) | (decinfo.isa.instr.imm19_12 << 12) |
+    (decinfo.isa.instr.imm11_ << 11) | (decinfo.isa.instr.imm10_1 << 1);
+  decinfo.jmp_pc = cpu.pc + offset;
+  decode_op_i(id_src, decinfo.jmp_pc, true);
+  decode_op_r(id_dest, decinfo.isa.instr.rd, false);
+
+  print_Dop(id_src->str, OP_STR_SIZE, "0x%x", decinfo.jmp_pc);
+}
+
 make_DHelper(ld) {
   decode_op_r(id_src, decinfo.isa.instr.rs1, true);
   decode_op_i(id_src2, decinfo.isa.instr.simm11_0, true);
 
   print_Dop(id_src->str, OP_STR_SIZE, "%d(%s)", id_src2->val, reg_name(id_src->reg, 4));
 
+  // `addr' shares the storage with `reg'
+  op_reload_addr(id_src, id_src->reg, -1, 0, id_src2->val);
   rtl_add(&id_src->addr, &id_src->val, &id_src2->val);
 
   decode_op_r(id_dest, decinfo.isa.instr.rd, false);
@@ -47,7 +66,17 @@ make_DHelper(st) {
 
   print_Dop(id_src->str, OP_STR_SIZE, "%d(%s)", id_src2->val, reg_name(id_src->reg, 4));
 
+  // `addr' shares the storage with `reg'
+  op_reload_addr(id_src, id_src->reg, -1, 0, id_src2->val);
   rtl_add(&id_src->addr, &id_src->val, &id_src2->val);
 
   decode_op_r(id_dest, decinfo.isa.instr.rs2, true);
 }
+
+make_DHelper(amo) {
+  decode_op_r(id_src, decinfo.isa.instr.rs1, true);
+  decode_op_r(id_src2, decinfo.isa.instr.rs2, true);
+  decode_op_r(id_dest, decinfo.isa.instr.rd, false);
+
+  print_Dop(id_src->str, OP_STR_SIZE, "(%s)", reg_name(id_src->reg, 4));
+}
@@ -2,8 +2,23 @@
 
 make_EHelper(lui);
 
+make_EHelper(jal);
+make_EHelper(jalr);
+
 make_EHelper(ld);
 make_EHelper(st);
 
+make_EHelper(lr);
+make_EHelper(sc);
+make_EHelper(amoswap);
+make_EHelper(amoadd);
+make_EHelper(amoxor);
+make_EHelper(amoand);
+make_EHelper(amoor);
+make_EHelper(amomin);
+make_EHelper(amomax);
+make_EHelper(amominu);
+make_EHelper(amomaxu);
+
 make_EHelper(inv);
 make_EHelper(nemu_trap);
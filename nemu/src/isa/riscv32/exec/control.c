@@ -1 +1,31 @@
 #include "cpu/exec.h"
+#include "monitor/ftrace.h"
+
+/* By the calling convention, a call links to ra, and
+ * `jalr x0, 0(ra)' returns from a function. */
+#define R_RA 1
+
+make_EHelper(jal) {
+  // the target address is calculated at the decode stage
+  rtl_li(&s0, decinfo.seq_pc);
+  rtl_sr(id_dest->reg, &s0, 4);
+  if (id_dest->reg == R_RA) bpred_call(decinfo.seq_pc);
+  rtl_j(decinfo.jmp_pc);
+  if (id_dest->reg == R_RA) ftrace_call(decinfo.jmp_pc, decinfo.seq_pc);
+
+  print_asm_template2(jal);
+}
+
+make_EHelper(jalr) {
+  rtl_add(&s0, &id_src->val, &id_src2->val);
+  rtl_andi(&s0, &s0, ~0x1u);
+  rtl_li(&s1, decinfo.seq_pc);
+  rtl_sr(id_dest->reg, &s1, 4);
+  if (id_dest->reg == R_RA) bpred_call(decinfo.seq_pc);
+  else if (id_dest->reg == 0 && id_src->reg == R_RA) bpred_ret();
+  rtl_jr(&s0);
+  if (id_dest->reg == R_RA) ftrace_call(s0, decinfo.seq_pc);
+  else if (id_dest->reg == 0 && id_src->reg == R_RA) ftrace_ret(s0);
+
+  print_asm("jalr %d(%s),%s", id_src2->val, id_src->str, id_dest->str);
+}
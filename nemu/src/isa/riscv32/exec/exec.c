@@ -19,11 +19,25 @@ static make_EHelper(store) {
   idex(pc, &store_table[decinfo.isa.instr.funct3]);
 }
 
+static OpcodeEntry amo_table [32] = {
+  /* b00 */ EX(amoadd), EX(amoswap), EX(lr), EX(sc), EX(amoxor), EMPTY, EMPTY, EMPTY,
+  /* b01 */ EX(amoor), EMPTY, EMPTY, EMPTY, EX(amoand), EMPTY, EMPTY, EMPTY,
+  /* b10 */ EX(amomin), EMPTY, EMPTY, EMPTY, EX(amomax), EMPTY, EMPTY, EMPTY,
+  /* b11 */ EX(amominu), EMPTY, EMPTY, EMPTY, EX(amomaxu), EMPTY, EMPTY, EMPTY,
+};
+
+static make_EHelper(amo) {
+  // only the word width of RV32A
+  assert(decinfo.isa.instr.funct3 == 2);
+  decinfo.width = 4;
+  idex(pc, &amo_table[decinfo.isa.instr.funct7 >> 2]);
+}
+
 static OpcodeEntry opcode_table [32] = {
   /* b00 */ IDEX(ld, load), EMPTY, EMPTY, EMPTY, EMPTY, EMPTY, EMPTY, EMPTY,
-  /* b01 */ IDEX(st, store), EMPTY, EMPTY, EMPTY, EMPTY, IDEX(U, lui), EMPTY, EMPTY,
+  /* b01 */ IDEX(st, store), EMPTY, EMPTY, IDEX(amo, amo), EMPTY, IDEX(U, lui), EMPTY, EMPTY,
   /* b10 */ EMPTY, EMPTY, EMPTY, EMPTY, EMPTY, EMPTY, EMPTY, EMPTY,
-  /* b11 */ EMPTY, EMPTY, EX(nemu_trap), EMPTY, EMPTY, EMPTY, EMPTY, EMPTY,
+  /* b11 */ EMPTY, IDEX(I, jalr), EX(nemu_trap), IDEX(J, jal), EMPTY, EMPTY, EMPTY, EMPTY,
 };
 
 void isa_exec(vaddr_t *pc) {
@@ -1,4 +1,6 @@
 #include "cpu/exec.h"
+#include "cpu/jit.h"
+#include "memory/tlb.h"
 
 make_EHelper(ld) {
   rtl_lm(&s0, &id_src->addr, decinfo.width);
@@ -22,3 +24,48 @@ make_EHelper(st) {
     default: assert(0);
   }
 }
+
+/* The reservation of lr.w. sc.w succeeds if the word still holds the
+ * value loaded, which other harts may have stored in the meantime. */
+static __thread bool lr_valid = false;
+static __thread vaddr_t lr_addr;
+static __thread uint32_t lr_val;
+
+make_EHelper(lr) {
+  jit_barrier();
+  rtl_lm(&s0, &id_src->val, 4);
+  lr_valid = true;
+  lr_addr = id_src->val;
+  lr_val = s0;
+  rtl_sr(id_dest->reg, &s0, 4);
+
+  print_asm("lr.w %s,%s", id_dest->str, id_src->str);
+}
+
+make_EHelper(sc) {
+  jit_barrier();
+  bool ok = lr_valid && lr_addr == id_src->val && vaddr_cas(id_src->val, lr_val, id_src2->val);
+  lr_valid = false;
+  rtl_li(&s0, !ok);
+  rtl_sr(id_dest->reg, &s0, 4);
+
+  print_asm("sc.w %s,%s,%s", id_dest->str, id_src2->str, id_src->str);
+}
+
+#define make_amo_EHelper(name, op) \
+  make_EHelper(name) { \
+    jit_barrier(); \
+    s0 = vaddr_atomic(id_src->val, id_src2->val, 4, op); \
+    rtl_sr(id_dest->reg, &s0, 4); \
+    print_asm(str(name) ".w %s,%s,%s", id_dest->str, id_src2->str, id_src->str); \
+  }
+
+make_amo_EHelper(amoswap, ATOMIC_SWAP)
+make_amo_EHelper(amoadd, ATOMIC_ADD)
+make_amo_EHelper(amoxor, ATOMIC_XOR)
+make_amo_EHelper(amoand, ATOMIC_AND)
+make_amo_EHelper(amoor, ATOMIC_OR)
+make_amo_EHelper(amomin, ATOMIC_MIN)
+make_amo_EHelper(amomax, ATOMIC_MAX)
+make_amo_EHelper(amominu, ATOMIC_MINU)
+make_amo_EHelper(amomaxu, ATOMIC_MAXU)
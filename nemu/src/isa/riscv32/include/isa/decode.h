@@ -53,7 +53,10 @@ struct ISADecodeInfo {
 };
 
 make_DHelper(U);
+make_DHelper(I);
+make_DHelper(J);
 make_DHelper(ld);
 make_DHelper(st);
+make_DHelper(amo);
 
 #endif
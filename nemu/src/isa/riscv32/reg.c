@@ -13,18 +13,22 @@ void isa_reg_display() {
   }
 }
 
-uint32_t isa_reg_str2val(const char *s, bool *success) {
-int regNum = sizeof(regsl)/sizeof(regsl[0]);
+/* Return where the register named `s' is kept, or NULL if there is no such register. */
+rtlreg_t* isa_reg_str2ptr(const char *s) {
+  int regNum = sizeof(regsl)/sizeof(regsl[0]);
   if(strcmp(s, "pc") == 0){
-    *success = true;
-    return cpu.pc;
+    return &cpu.pc;
   }
   for(int i = 0; i < regNum; i++){
     if(strcmp(s, regsl[i]) == 0){
-      *success = true;
-      return reg_l(i);
+      return &reg_l(i);
     }
   }
-  *success = false;
-  return 0;
+  return NULL;
+}
+
+uint32_t isa_reg_str2val(const char *s, bool *success) {
+  rtlreg_t *p = isa_reg_str2ptr(s);
+  *success = (p != NULL);
+  return (p ? *p : 0);
 }
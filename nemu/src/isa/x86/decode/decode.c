@@ -47,6 +47,7 @@ static inline make_DopHelper(a) {
   op->reg = R_EAX;
   if (load_val) {
     rtl_lr(&op->val, R_EAX, op->width);
+    op_reload_reg(op, op->width);
   }
 
   print_Dop(op->str, OP_STR_SIZE, "%%%s", reg_name(R_EAX, op->width));
@@ -61,6 +62,7 @@ static inline make_DopHelper(r) {
   op->reg = decinfo.opcode & 0x7;
   if (load_val) {
     rtl_lr(&op->val, op->reg, op->width);
+    op_reload_reg(op, op->width);
   }
 
   print_Dop(op->str, OP_STR_SIZE, "%%%s", reg_name(op->reg, op->width));
@@ -86,6 +88,7 @@ static inline make_DopHelper(O) {
   rtl_li(&op->addr, instr_fetch(pc, 4));
   if (load_val) {
     rtl_lm(&op->val, &op->addr, op->width);
+    op_reload_mem(op);
   }
 
   print_Dop(op->str, OP_STR_SIZE, "0x%x", op->addr);
@@ -219,6 +222,7 @@ make_DHelper(gp2_cl2E) {
   id_src->type = OP_TYPE_REG;
   id_src->reg = R_CL;
   rtl_lr(&id_src->val, R_CL, 1);
+  op_reload_reg(id_src, 1);
 
   print_Dop(id_src->str, OP_STR_SIZE, "%%cl");
 }
@@ -244,6 +248,7 @@ make_DHelper(cl_G2E) {
   id_src->type = OP_TYPE_REG;
   id_src->reg = R_CL;
   rtl_lr(&id_src->val, R_CL, 1);
+  op_reload_reg(id_src, 1);
 
   print_Dop(id_src->str, OP_STR_SIZE, "%%cl");
 }
@@ -278,6 +283,7 @@ make_DHelper(in_dx2a) {
   id_src->type = OP_TYPE_REG;
   id_src->reg = R_DX;
   rtl_lr(&id_src->val, R_DX, 2);
+  op_reload_reg(id_src, 2);
 
   print_Dop(id_src->str, OP_STR_SIZE, "(%%dx)");
 
@@ -296,6 +302,7 @@ make_DHelper(out_a2dx) {
   id_dest->type = OP_TYPE_REG;
   id_dest->reg = R_DX;
   rtl_lr(&id_dest->val, R_DX, 2);
+  op_reload_reg(id_dest, 2);
 
   print_Dop(id_dest->str, OP_STR_SIZE, "(%%dx)");
 }
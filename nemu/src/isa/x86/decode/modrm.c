@@ -44,6 +44,7 @@ void load_addr(vaddr_t *pc, ModR_M *m, Operand *rm) {
     rtl_add(&s0, &s0, &s1);
   }
   rtl_mv(&rm->addr, &s0);
+  op_reload_addr(rm, base_reg, index_reg, scale, disp);
 
 #ifdef DEBUG
   char disp_buf[16];
@@ -86,6 +87,7 @@ void read_ModR_M(vaddr_t *pc, Operand *rm, bool load_rm_val, Operand *reg, bool
     reg->reg = m.reg;
     if (load_reg_val) {
       rtl_lr(&reg->val, reg->reg, reg->width);
+      op_reload_reg(reg, reg->width);
     }
 
 #ifdef DEBUG
@@ -98,6 +100,7 @@ void read_ModR_M(vaddr_t *pc, Operand *rm, bool load_rm_val, Operand *reg, bool
     rm->reg = m.R_M;
     if (load_rm_val) {
       rtl_lr(&rm->val, m.R_M, rm->width);
+      op_reload_reg(rm, rm->width);
     }
 
 #ifdef DEBUG
@@ -108,6 +111,7 @@ void read_ModR_M(vaddr_t *pc, Operand *rm, bool load_rm_val, Operand *reg, bool
     load_addr(pc, &m, rm);
     if (load_rm_val) {
       rtl_lm(&rm->val, &rm->addr, rm->width);
+      op_reload_mem(rm);
     }
   }
 }
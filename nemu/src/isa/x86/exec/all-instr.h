@@ -1,8 +1,15 @@
 #include "cpu/exec.h"
 
 make_EHelper(mov);
+make_EHelper(xchg);
+
+make_EHelper(call);
+make_EHelper(call_rm);
+make_EHelper(ret);
+make_EHelper(ret_imm);
 
 make_EHelper(operand_size);
+make_EHelper(lock);
 
 make_EHelper(inv);
 make_EHelper(nemu_trap);
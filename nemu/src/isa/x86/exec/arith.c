@@ -1,37 +1,55 @@
 #include "cpu/exec.h"
 
 make_EHelper(add) {
-  TODO();
+  rtl_add(&s0, &id_dest->val, &id_src->val);
+  operand_write(id_dest, &s0);
+  rtl_set_cc_add(&s0, &id_dest->val, id_dest->width);
 
   print_asm_template2(add);
 }
 
 make_EHelper(sub) {
-  TODO();
+  rtl_sub(&s0, &id_dest->val, &id_src->val);
+  operand_write(id_dest, &s0);
+  rtl_set_cc_sub(&s0, &id_dest->val, &id_src->val, id_dest->width);
 
   print_asm_template2(sub);
 }
 
 make_EHelper(cmp) {
-  TODO();
+  rtl_sub(&s0, &id_dest->val, &id_src->val);
+  rtl_set_cc_sub(&s0, &id_dest->val, &id_src->val, id_dest->width);
 
   print_asm_template2(cmp);
 }
 
 make_EHelper(inc) {
-  TODO();
+  rtl_addi(&s0, &id_dest->val, 1);
+  operand_write(id_dest, &s0);
+  // CF is not affected
+  rtl_get_CF(&s1);
+  rtl_set_cc_add(&s0, &id_dest->val, id_dest->width);
+  rtl_set_CF(&s1);
 
   print_asm_template1(inc);
 }
 
 make_EHelper(dec) {
-  TODO();
+  rtl_subi(&s0, &id_dest->val, 1);
+  operand_write(id_dest, &s0);
+  // CF is not affected, and OF is the same as that of adding -1
+  rtl_get_CF(&s1);
+  rtl_set_cc_add(&s0, &id_dest->val, id_dest->width);
+  rtl_set_CF(&s1);
 
   print_asm_template1(dec);
 }
 
 make_EHelper(neg) {
-  TODO();
+  rtl_li(&s1, 0);
+  rtl_sub(&s0, &s1, &id_dest->val);
+  operand_write(id_dest, &s0);
+  rtl_set_cc_sub(&s0, &s1, &id_dest->val, id_dest->width);
 
   print_asm_template1(neg);
 }
@@ -11,17 +11,28 @@ void rtl_setcc(rtlreg_t* dest, uint8_t subcode) {
     CC_L, CC_NL, CC_LE, CC_NLE
   };
 
-  // TODO: Query EFLAGS to determine whether the condition code is satisfied.
   // dest <- ( cc is satisfied ? 1 : 0)
+  // The flags are derived from the lazy state, see isa/rtl.h.
   switch (subcode & 0xe) {
-    case CC_O:
-    case CC_B:
-    case CC_E:
+    case CC_O: rtl_get_OF(dest); break;
+    case CC_B: rtl_get_CF(dest); break;
+    case CC_E: rtl_get_ZF(dest); break;
     case CC_BE:
-    case CC_S:
+      rtl_get_CF(dest);
+      rtl_get_ZF(&t1);
+      rtl_or(dest, dest, &t1);
+      break;
+    case CC_S: rtl_get_SF(dest); break;
     case CC_L:
     case CC_LE:
-      TODO();
+      rtl_get_SF(dest);
+      rtl_get_OF(&t1);
+      rtl_xor(dest, dest, &t1);
+      if ((subcode & 0xe) == CC_LE) {
+        rtl_get_ZF(&t1);
+        rtl_or(dest, dest, &t1);
+      }
+      break;
     default: panic("should not reach here");
     case CC_P: panic("n86 does not have PF");
   }
@@ -1,5 +1,6 @@
 #include "cpu/exec.h"
 #include "cc.h"
+#include "monitor/ftrace.h"
 
 make_EHelper(jmp) {
   // the target address is calculated at the decode stage
@@ -26,25 +27,40 @@ make_EHelper(jmp_rm) {
 
 make_EHelper(call) {
   // the target address is calculated at the decode stage
-  TODO();
+  rtl_li(&s0, decinfo.seq_pc);
+  rtl_push(&s0);
+  bpred_call(decinfo.seq_pc);
+  rtl_j(decinfo.jmp_pc);
+  ftrace_call(decinfo.jmp_pc, decinfo.seq_pc);
 
   print_asm("call %x", decinfo.jmp_pc);
 }
 
 make_EHelper(ret) {
-  TODO();
+  rtl_pop(&s0);
+  bpred_ret();
+  rtl_jr(&s0);
+  ftrace_ret(s0);
 
   print_asm("ret");
 }
 
 make_EHelper(ret_imm) {
-  TODO();
+  rtl_pop(&s0);
+  rtl_add(&reg_l(R_ESP), &reg_l(R_ESP), &id_dest->val);
+  bpred_ret();
+  rtl_jr(&s0);
+  ftrace_ret(s0);
 
   print_asm("ret %s", id_dest->str);
 }
 
 make_EHelper(call_rm) {
-  TODO();
+  rtl_li(&s0, decinfo.seq_pc);
+  rtl_push(&s0);
+  bpred_call(decinfo.seq_pc);
+  rtl_jr(&id_dest->val);
+  ftrace_call(id_dest->val, decinfo.seq_pc);
 
   print_asm("call *%s", id_dest->str);
 }
@@ -1,10 +1,26 @@
 #include "cpu/exec.h"
+#include "cpu/jit.h"
+#include "memory/tlb.h"
 
 make_EHelper(mov) {
   operand_write(id_dest, &id_src->val);
   print_asm_template2(mov);
 }
 
+/* With a memory operand, xchg is atomic even without the lock prefix. */
+make_EHelper(xchg) {
+  if (id_dest->type == OP_TYPE_MEM) {
+    jit_barrier();
+    s0 = vaddr_atomic(id_dest->addr, id_src->val, id_dest->width, ATOMIC_SWAP);
+  }
+  else {
+    rtl_lr(&s0, id_dest->reg, id_dest->width);
+    operand_write(id_dest, &id_src->val);
+  }
+  operand_write(id_src, &s0);
+  print_asm_template2(xchg);
+}
+
 make_EHelper(push) {
   TODO();
 
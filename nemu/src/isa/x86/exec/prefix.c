@@ -7,3 +7,13 @@ make_EHelper(operand_size) {
   isa_exec(pc);
   decinfo.isa.is_operand_size_16 = false;
 }
+
+/* Only lock xchg is supported, whose atomicity does not depend on the
+ * prefix. Other read-modify-write instructions would not be atomic. */
+make_EHelper(lock) {
+  // peek at the opcode, nothing should be executed if it is not supported
+  uint32_t opcode = vaddr_ifetch(*pc, 1);
+  Assert(opcode == 0x86 || opcode == 0x87,
+      "lock prefix with opcode 0x%x is not supported at pc = 0x%08x", opcode, cpu.pc);
+  isa_exec(pc);
+}
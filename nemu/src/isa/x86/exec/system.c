@@ -1,19 +1,37 @@
 #include "cpu/exec.h"
+#include "cpu/jit.h"
+#include "memory/tlb.h"
 
 make_EHelper(lidt) {
+  jit_barrier();
   TODO();
 
   print_asm_template1(lidt);
 }
 
 make_EHelper(mov_r2cr) {
-  TODO();
+  jit_barrier();
+  switch (id_dest->reg) {
+    case 0: cpu.cr0.val = id_src->val; break;
+    case 2: cpu.cr2 = id_src->val; break;
+    case 3: cpu.cr3.val = id_src->val; break;
+    default: panic("invalid control register %d", id_dest->reg);
+  }
+  // the translation may change with CR0 and CR3
+  if (id_dest->reg != 2) tlb_flush();
 
   print_asm("movl %%%s,%%cr%d", reg_name(id_src->reg, 4), id_dest->reg);
 }
 
 make_EHelper(mov_cr2r) {
-  TODO();
+  jit_barrier();
+  switch (id_src->reg) {
+    case 0: s0 = cpu.cr0.val; break;
+    case 2: s0 = cpu.cr2; break;
+    case 3: s0 = cpu.cr3.val; break;
+    default: panic("invalid control register %d", id_src->reg);
+  }
+  operand_write(id_dest, &s0);
 
   print_asm("movl %%cr%d,%%%s", id_src->reg, reg_name(id_dest->reg, 4));
 
@@ -29,6 +47,7 @@ make_EHelper(int) {
 }
 
 make_EHelper(iret) {
+  jit_barrier();
   TODO();
 
   print_asm("iret");
@@ -1,6 +1,14 @@
 #ifndef __X86_DIFF_TEST_H__
 #define __X86_DIFF_TEST_H__
 
-#define DIFFTEST_REG_SIZE (sizeof(uint32_t) * 9) // GRPs + EIP
+#define DIFFTEST_REG_SIZE (sizeof(uint32_t) * 10) // GRPs + EIP + EFLAGS
+
+/* EFLAGS is evaluated lazily, see isa/rtl.h */
+void eflags_sync(void);
+void eflags_load(void);
+
+// before the registers are read, and after they are written
+#define isa_difftest_regs_out() eflags_sync()
+#define isa_difftest_regs_in() eflags_load()
 
 #endif
@@ -2,6 +2,7 @@
 #define __X86_REG_H__
 
 #include "common.h"
+#include "isa/mmu.h"
 
 #define PC_START IMAGE_START
 
@@ -9,6 +10,12 @@ enum { R_EAX, R_ECX, R_EDX, R_EBX, R_ESP, R_EBP, R_ESI, R_EDI };
 enum { R_AX, R_CX, R_DX, R_BX, R_SP, R_BP, R_SI, R_DI };
 enum { R_AL, R_CL, R_DL, R_BL, R_AH, R_CH, R_DH, R_BH };
 
+/* bit positions in EFLAGS */
+enum { EFLAGS_CF = 0, EFLAGS_ZF = 6, EFLAGS_SF = 7, EFLAGS_IF = 9, EFLAGS_DF = 10, EFLAGS_OF = 11 };
+
+/* the flags evaluated lazily, see isa/rtl.h */
+#define EFLAGS_LAZY_MASK ((1u << EFLAGS_CF) | (1u << EFLAGS_ZF) | (1u << EFLAGS_SF) | (1u << EFLAGS_OF))
+
 /* TODO: Re-organize the `CPU_state' structure to match the register
  * encoding scheme in i386 instruction format. For example, if we
  * access cpu.gpr[3]._16, we will get the `bx' register; if we access
@@ -32,6 +39,21 @@ typedef struct {
 
   vaddr_t pc;
 
+  /* The bits in EFLAGS_LAZY_MASK are up to date only after eflags_sync().
+   * The others are always valid.
+   */
+  rtlreg_t eflags;
+
+  /* the last flag-producing operation, see isa/rtl.h */
+  struct {
+    rtlreg_t res, a, b, fix;
+  } cc;
+
+  /* the control registers, written by mov_r2cr */
+  CR0 cr0;
+  vaddr_t cr2;  // the address of the last page fault
+  CR3 cr3;
+
 } CPU_state;
 
 static inline int check_reg_index(int index) {
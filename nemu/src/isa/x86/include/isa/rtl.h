@@ -26,65 +26,192 @@ static inline void rtl_sr(int r, const rtlreg_t* src1, int width) {
 static inline void rtl_push(const rtlreg_t* src1) {
   // esp <- esp - 4
   // M[esp] <- src1
-  TODO();
+  rtl_subi(&reg_l(R_ESP), &reg_l(R_ESP), 4);
+  rtl_sm(&reg_l(R_ESP), src1, 4);
 }
 
 static inline void rtl_pop(rtlreg_t* dest) {
   // dest <- M[esp]
   // esp <- esp + 4
-  TODO();
+  rtl_lm(dest, &reg_l(R_ESP), 4);
+  rtl_addi(&reg_l(R_ESP), &reg_l(R_ESP), 4);
 }
 
 static inline void rtl_is_sub_overflow(rtlreg_t* dest,
     const rtlreg_t* res, const rtlreg_t* src1, const rtlreg_t* src2, int width) {
   // dest <- is_overflow(src1 - src2)
-  TODO();
+  rtl_xor(&t0, src1, src2);
+  rtl_xor(&t1, src1, res);
+  rtl_and(dest, &t0, &t1);
+  rtl_msb(dest, dest, width);
 }
 
 static inline void rtl_is_sub_carry(rtlreg_t* dest,
     const rtlreg_t* res, const rtlreg_t* src1) {
   // dest <- is_carry(src1 - src2)
-  TODO();
+  rtl_setrelop(RELOP_GTU, dest, res, src1);
 }
 
 static inline void rtl_is_add_overflow(rtlreg_t* dest,
     const rtlreg_t* res, const rtlreg_t* src1, const rtlreg_t* src2, int width) {
   // dest <- is_overflow(src1 + src2)
-  TODO();
+  rtl_xor(&t0, src1, res);
+  rtl_xor(&t1, src2, res);
+  rtl_and(dest, &t0, &t1);
+  rtl_msb(dest, dest, width);
 }
 
 static inline void rtl_is_add_carry(rtlreg_t* dest,
     const rtlreg_t* res, const rtlreg_t* src1) {
   // dest <- is_carry(src1 + src2)
-  TODO();
+  rtl_setrelop(RELOP_LTU, dest, res, src1);
+}
+
+/* Lazy EFLAGS. Instead of computing CF, ZF, SF and OF after every
+ * instruction, a flag-producing instruction records
+ *
+ *   cc.res  its result,
+ *   cc.a    and cc.b, such that CF = (a <u b) and OF = is_overflow(a - b),
+ *   cc.fix  zero,
+ *
+ * all shifted left so that the sign bit of the operation is bit 31.
+ * The flags are then derived by whoever reads them:
+ *
+ *   CF = (a <u b) ^ fix[0]        ZF = (res == 0)
+ *   SF = res[31] ^ fix[7]         OF = is_overflow(a - b) ^ fix[11]
+ *
+ * For `sub' and `cmp', (a, b) are the operands. For `add', (a, b) are
+ * (result, src1), since result - src1 = src2. Logical instructions use
+ * (0, 0). `fix' holds the flags which can not be expressed this way,
+ * such as a CF preserved by `inc' or a value loaded by `popf'. The bits
+ * of `fix' are at the positions of the flags in EFLAGS.
+ *
+ * The other bits of EFLAGS are kept in cpu.eflags. The helpers below use
+ * t0 and t1 as temporaries.
+ */
+
+static inline void rtl_set_cc(const rtlreg_t* res, const rtlreg_t* a, const rtlreg_t* b, int width) {
+  if (width == 4) {
+    rtl_mv(&cpu.cc.a, a);
+    rtl_mv(&cpu.cc.b, b);
+    rtl_mv(&cpu.cc.res, res);
+  }
+  else {
+    rtl_shli(&cpu.cc.a, a, 32 - width * 8);
+    rtl_shli(&cpu.cc.b, b, 32 - width * 8);
+    rtl_shli(&cpu.cc.res, res, 32 - width * 8);
+  }
+  rtl_li(&cpu.cc.fix, 0);
+}
+
+// flags of res = src1 + src2
+static inline void rtl_set_cc_add(const rtlreg_t* res, const rtlreg_t* src1, int width) {
+  rtl_set_cc(res, res, src1, width);
+}
+
+// flags of res = src1 - src2
+static inline void rtl_set_cc_sub(const rtlreg_t* res, const rtlreg_t* src1, const rtlreg_t* src2, int width) {
+  rtl_set_cc(res, src1, src2, width);
+}
+
+// flags of a logical instruction, with CF = OF = 0
+static inline void rtl_set_cc_logic(const rtlreg_t* res, int width) {
+  if (width == 4) rtl_mv(&cpu.cc.res, res);
+  else rtl_shli(&cpu.cc.res, res, 32 - width * 8);
+  rtl_li(&cpu.cc.a, 0);
+  rtl_li(&cpu.cc.b, 0);
+  rtl_li(&cpu.cc.fix, 0);
+}
+
+// flags before applying `fix'
+static inline void rtl_cc_CF(rtlreg_t* dest) {
+  rtl_setrelop(RELOP_LTU, dest, &cpu.cc.a, &cpu.cc.b);
+}
+
+static inline void rtl_cc_SF(rtlreg_t* dest) {
+  rtl_shri(dest, &cpu.cc.res, 31);
+}
+
+static inline void rtl_cc_OF(rtlreg_t* dest) {
+  rtl_sub(&t1, &cpu.cc.a, &cpu.cc.b);
+  rtl_is_sub_overflow(dest, &t1, &cpu.cc.a, &cpu.cc.b, 4);
+}
+
+static inline void rtl_get_ZF(rtlreg_t* dest) {
+  rtl_setrelopi(RELOP_EQ, dest, &cpu.cc.res, 0);
+}
+
+static inline void rtl_set_ZF(const rtlreg_t* src) {
+  // keep SF, which also depends on cc.res
+  rtl_cc_SF(&t0);
+  rtl_setrelopi(RELOP_EQ, &cpu.cc.res, src, 0);
+  rtl_shli(&t0, &t0, EFLAGS_SF);
+  rtl_xor(&cpu.cc.fix, &cpu.cc.fix, &t0);
 }
 
 #define make_rtl_setget_eflags(f) \
-  static inline void concat(rtl_set_, f) (const rtlreg_t* src) { \
-    TODO(); \
-  } \
   static inline void concat(rtl_get_, f) (rtlreg_t* dest) { \
-    TODO(); \
+    concat(rtl_cc_, f) (&t0); \
+    rtl_shri(dest, &cpu.cc.fix, concat(EFLAGS_, f)); \
+    rtl_andi(dest, dest, 0x1); \
+    rtl_xor(dest, dest, &t0); \
+  } \
+  static inline void concat(rtl_set_, f) (const rtlreg_t* src) { \
+    concat(rtl_cc_, f) (&t0); \
+    rtl_xor(&t0, &t0, src); \
+    rtl_shli(&t0, &t0, concat(EFLAGS_, f)); \
+    rtl_andi(&cpu.cc.fix, &cpu.cc.fix, ~(1u << concat(EFLAGS_, f))); \
+    rtl_or(&cpu.cc.fix, &cpu.cc.fix, &t0); \
   }
 
 make_rtl_setget_eflags(CF)
 make_rtl_setget_eflags(OF)
-make_rtl_setget_eflags(ZF)
 make_rtl_setget_eflags(SF)
 
 static inline void rtl_update_ZF(const rtlreg_t* result, int width) {
   // eflags.ZF <- is_zero(result[width * 8 - 1 .. 0])
-  TODO();
+  rtl_shli(&t1, result, 32 - width * 8);
+  rtl_setrelopi(RELOP_EQ, &t1, &t1, 0);
+  rtl_set_ZF(&t1);
 }
 
 static inline void rtl_update_SF(const rtlreg_t* result, int width) {
   // eflags.SF <- is_sign(result[width * 8 - 1 .. 0])
-  TODO();
+  rtl_msb(&t1, result, width);
+  rtl_set_SF(&t1);
 }
 
 static inline void rtl_update_ZFSF(const rtlreg_t* result, int width) {
-  rtl_update_ZF(result, width);
-  rtl_update_SF(result, width);
+  // both are derived from cc.res only
+  rtl_shli(&cpu.cc.res, result, 32 - width * 8);
+  rtl_andi(&cpu.cc.fix, &cpu.cc.fix, ~(1u << EFLAGS_SF));
+}
+
+/* The whole EFLAGS, as used by pushf and popf. `dest' must not be t0 or t1. */
+static inline void rtl_get_eflags(rtlreg_t* dest) {
+  rtl_get_OF(dest);
+  rtl_shli(dest, dest, EFLAGS_OF);
+  rtl_get_SF(&t1);
+  rtl_shli(&t1, &t1, EFLAGS_SF);
+  rtl_or(dest, dest, &t1);
+  rtl_get_ZF(&t1);
+  rtl_shli(&t1, &t1, EFLAGS_ZF);
+  rtl_or(dest, dest, &t1);
+  rtl_get_CF(&t1);
+  rtl_or(dest, dest, &t1);
+  rtl_andi(&t1, &cpu.eflags, ~EFLAGS_LAZY_MASK);
+  rtl_or(dest, dest, &t1);
+}
+
+static inline void rtl_set_eflags(const rtlreg_t* src) {
+  rtl_mv(&cpu.eflags, src);
+  // cc.res = !ZF, and the other flags go to `fix'
+  rtl_shri(&t0, src, EFLAGS_ZF);
+  rtl_andi(&t0, &t0, 0x1);
+  rtl_xori(&cpu.cc.res, &t0, 0x1);
+  rtl_li(&cpu.cc.a, 0);
+  rtl_li(&cpu.cc.b, 0);
+  rtl_andi(&cpu.cc.fix, src, EFLAGS_LAZY_MASK & ~(1u << EFLAGS_ZF));
 }
 
 #endif
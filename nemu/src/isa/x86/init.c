@@ -16,6 +16,11 @@ const long isa_default_img_size = sizeof(isa_default_img);
 static void restart() {
   /* Set the initial program counter. */
   cpu.pc = PC_START;
+
+  /* Set the initial EFLAGS, with the reserved bit 1 set. */
+  cpu.eflags = 0x2;
+  void eflags_load(void);
+  eflags_load();
 }
 
 void init_isa(void) {
@@ -1,6 +1,9 @@
 #include "rtl/rtl.h"
+#include "cpu/jit.h"
 
 void raise_intr(uint32_t NO, vaddr_t ret_addr) {
+  jit_barrier();
+
   /* TODO: Trigger an interrupt/exception with ``NO''.
    * That is, use ``NO'' to index the IDT.
    */
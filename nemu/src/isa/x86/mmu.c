@@ -1,9 +1,42 @@
 #include "nemu.h"
+#include "memory/tlb.h"
+
+void raise_intr(uint32_t NO, vaddr_t epc);
+
+/* Called by the TLB on a miss. Without paging, a virtual address is a
+ * physical one. With CR0.PG set, walk the page directory at CR3 here,
+ * and grant TLB_W only for a write, after setting the dirty bit.
+ * Writing CR0 or CR3 must call tlb_flush().
+ */
+paddr_t isa_tlb_walk(vaddr_t vaddr, int type, int *perm) {
+  *perm = TLB_R | TLB_W | TLB_X;
+  return vaddr;
+}
+
+/* Called by the TLB when an access faults. The address goes to CR2
+ * for the handler of the page fault.
+ */
+void isa_tlb_fault(vaddr_t vaddr, int type, vaddr_t pc) {
+  cpu.cr2 = vaddr;
+  raise_intr(14, pc);
+}
 
 uint32_t isa_vaddr_read(vaddr_t addr, int len) {
-  return paddr_read(addr, len);
+  return tlb_read(addr, len, TLB_R);
+}
+
+uint32_t isa_vaddr_ifetch(vaddr_t addr, int len) {
+  return tlb_read(addr, len, TLB_X);
 }
 
 void isa_vaddr_write(vaddr_t addr, uint32_t data, int len) {
-  paddr_write(addr, data, len);
+  tlb_write(addr, data, len);
+}
+
+uint32_t isa_vaddr_atomic(vaddr_t addr, uint32_t data, int len, int op) {
+  return tlb_atomic(addr, data, len, op);
+}
+
+bool isa_vaddr_cas(vaddr_t addr, uint32_t expect, uint32_t data) {
+  return tlb_cas(addr, expect, data);
 }
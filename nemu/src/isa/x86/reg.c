@@ -40,9 +40,51 @@ void reg_test() {
   assert(pc_sample == cpu.pc);
 }
 
+/* Materialize the lazy flags into cpu.eflags, see isa/rtl.h. */
+void eflags_sync(void) {
+  uint32_t a = cpu.cc.a, b = cpu.cc.b, fix = cpu.cc.fix;
+  uint32_t CF = (a < b);
+  uint32_t ZF = (cpu.cc.res == 0);
+  uint32_t SF = (cpu.cc.res >> 31);
+  uint32_t OF = (((a ^ b) & (a ^ (a - b))) >> 31);
+
+  cpu.eflags = (cpu.eflags & ~EFLAGS_LAZY_MASK) | ((fix & EFLAGS_LAZY_MASK) ^
+    ((CF << EFLAGS_CF) | (ZF << EFLAGS_ZF) | (SF << EFLAGS_SF) | (OF << EFLAGS_OF)));
+}
+
+/* Set up the lazy flags from cpu.eflags. */
+void eflags_load(void) {
+  cpu.cc.res = !(cpu.eflags & (1u << EFLAGS_ZF));
+  cpu.cc.a = cpu.cc.b = 0;
+  cpu.cc.fix = cpu.eflags & EFLAGS_LAZY_MASK & ~(1u << EFLAGS_ZF);
+}
+
 void isa_reg_display() {
+  int i;
+  for (i = R_EAX; i <= R_EDI; i ++) {
+    printf("%-8s0x%08x\t%d\n", regsl[i], reg_l(i), reg_l(i));
+  }
+  printf("%-8s0x%08x\n", "pc", cpu.pc);
+
+  eflags_sync();
+  printf("%-8s0x%08x\t[%s%s%s%s ]\n", "eflags", cpu.eflags,
+      (cpu.eflags & (1u << EFLAGS_CF) ? " CF" : ""), (cpu.eflags & (1u << EFLAGS_ZF) ? " ZF" : ""),
+      (cpu.eflags & (1u << EFLAGS_SF) ? " SF" : ""), (cpu.eflags & (1u << EFLAGS_OF) ? " OF" : ""));
+}
+
+/* Return where the register named `s' is kept, or NULL if there is no such register.
+ * Only the 32-bit registers can be named. */
+rtlreg_t* isa_reg_str2ptr(const char *s) {
+  int i;
+  if (strcmp(s, "pc") == 0) return &cpu.pc;
+  for (i = R_EAX; i <= R_EDI; i ++) {
+    if (strcmp(s, regsl[i]) == 0) return &reg_l(i);
+  }
+  return NULL;
 }
 
 uint32_t isa_reg_str2val(const char *s, bool *success) {
-  return 0;
+  rtlreg_t *p = isa_reg_str2ptr(s);
+  *success = (p != NULL);
+  return (p ? *p : 0);
 }
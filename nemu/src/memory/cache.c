@@ -0,0 +1,256 @@
+#include "nemu.h"
+#include "memory/cache.h"
+
+#ifdef CACHE_SIM
+
+#include <stdlib.h>
+
+enum { POLICY_LRU, POLICY_PLRU, POLICY_RANDOM, NR_POLICY };
+static const char *policy_name[] = { "lru", "plru", "random" };
+
+typedef struct {
+  paddr_t line;   // address of the line divided by the line size
+  bool valid, dirty;
+  uint64_t last_use;
+} CacheLine;
+
+typedef struct Cache {
+  const char *name;
+  int size, line_size, assoc, policy;
+  int nr_set, line_shift;
+  CacheLine *lines;     // nr_set * assoc
+  uint64_t *plru;       // tree bits of each set
+  uint64_t clock;
+  struct Cache *next;   // the level below, or NULL for the memory
+  uint64_t nr_access, nr_miss, nr_writeback;
+} Cache;
+
+// the configuration, shared by the machines of a pool and by the harts
+static Cache config[NR_CACHE] = {
+  [CACHE_L1I] = { .name = "L1I", .size = 32 * 1024, .line_size = 64, .assoc = 8, .policy = POLICY_LRU },
+  [CACHE_L1D] = { .name = "L1D", .size = 32 * 1024, .line_size = 64, .assoc = 8, .policy = POLICY_LRU },
+  [CACHE_L2]  = { .name = "L2",  .size = 256 * 1024, .line_size = 64, .assoc = 8, .policy = POLICY_LRU },
+};
+
+static __thread Cache caches[NR_CACHE];
+
+// the line of the last fetch, which is kept in the fetch buffer
+static __thread paddr_t fetch_line = -1;
+static __thread uint32_t seed = 1;
+
+static inline bool is_pow2(int x) {
+  return x > 0 && (x & (x - 1)) == 0;
+}
+
+static inline void touch(Cache *c, int set, int way) {
+  c->lines[set * c->assoc + way].last_use = ++ c->clock;
+  if (c->policy == POLICY_PLRU) {
+    // make each node on the path point away from `way'
+    int node = 1, bit, level;
+    for (level = c->assoc >> 1; level > 0; level >>= 1) {
+      bit = (way & level) != 0;
+      if (bit) c->plru[set] &= ~(1ull << node);
+      else c->plru[set] |= (1ull << node);
+      node = node * 2 + bit;
+    }
+  }
+}
+
+static inline int victim(Cache *c, int set) {
+  CacheLine *l = &c->lines[set * c->assoc];
+  int i, way = 0;
+  for (i = 0; i < c->assoc; i ++) {
+    if (!l[i].valid) return i;
+  }
+
+  switch (c->policy) {
+    case POLICY_LRU:
+      for (i = 1; i < c->assoc; i ++) {
+        if (l[i].last_use < l[way].last_use) way = i;
+      }
+      return way;
+    case POLICY_PLRU: {
+      int node = 1, level;
+      for (level = c->assoc >> 1; level > 0; level >>= 1) {
+        int bit = (c->plru[set] >> node) & 1;
+        if (bit) way |= level;
+        node = node * 2 + bit;
+      }
+      return way;
+    }
+    default:
+      seed ^= seed << 13; seed ^= seed >> 17; seed ^= seed << 5;
+      return seed % c->assoc;
+  }
+}
+
+static void access_line(Cache *c, paddr_t addr, bool is_write) {
+  c->nr_access ++;
+  if (c->nr_set == 0) { c->nr_miss ++; return; }
+
+  paddr_t line = addr >> c->line_shift;
+  int set = line & (c->nr_set - 1);
+  CacheLine *l = &c->lines[set * c->assoc];
+  int way;
+  for (way = 0; way < c->assoc; way ++) {
+    if (l[way].valid && l[way].line == line) {
+      if (is_write) l[way].dirty = true;
+      touch(c, set, way);
+      return;
+    }
+  }
+
+  c->nr_miss ++;
+  way = victim(c, set);
+  if (l[way].valid && l[way].dirty) {
+    c->nr_writeback ++;
+    if (c->next) access_line(c->next, l[way].line << c->line_shift, true);
+  }
+  if (c->next) access_line(c->next, addr, false);
+  l[way].line = line;
+  l[way].valid = true;
+  l[way].dirty = is_write;
+  touch(c, set, way);
+}
+
+void cache_access(paddr_t addr, int len, int type) {
+  Cache *c = &caches[type == CACHE_FETCH ? CACHE_L1I : CACHE_L1D];
+  paddr_t first = addr >> c->line_shift, last = (addr + len - 1) >> c->line_shift;
+  paddr_t line;
+  for (line = first; line <= last; line ++) {
+    if (type == CACHE_FETCH) {
+      // the bytes of an instruction and the instructions after it
+      // are taken from the same line without accessing the cache
+      if (line == fetch_line) continue;
+      fetch_line = line;
+    }
+    access_line(c, line << c->line_shift, type == CACHE_WRITE);
+  }
+}
+
+static int parse_size(const char *s) {
+  char *end;
+  long size = strtol(s, &end, 0);
+  if (*end == 'K' || *end == 'k') { size *= 1024; end ++; }
+  else if (*end == 'M' || *end == 'm') { size *= 1024 * 1024; end ++; }
+  if (*end != '\0' || size < 0) panic("invalid size '%s' in the cache spec", s);
+  return size;
+}
+
+static void parse_spec(const char *spec) {
+  char *buf = strdup(spec), *p = buf, *level;
+  while ((level = strsep(&p, ",")) != NULL) {
+    char *field[5] = {};
+    int i;
+    for (i = 0; i < 5 && level != NULL; i ++) field[i] = strsep(&level, ":");
+
+    Cache *c = NULL;
+    for (i = 0; i < NR_CACHE; i ++) {
+      if (strcasecmp(field[0], config[i].name) == 0) c = &config[i];
+    }
+    if (c == NULL) panic("unknown cache '%s'", field[0]);
+
+    if (field[1] && field[1][0]) c->size = parse_size(field[1]);
+    if (field[2] && field[2][0]) c->line_size = parse_size(field[2]);
+    if (field[3] && field[3][0]) c->assoc = parse_size(field[3]);
+    if (field[4] && field[4][0]) {
+      for (i = 0; i < NR_POLICY; i ++) {
+        if (strcmp(field[4], policy_name[i]) == 0) break;
+      }
+      if (i == NR_POLICY) panic("unknown replacement policy '%s'", field[4]);
+      c->policy = i;
+    }
+  }
+  free(buf);
+}
+
+void init_cache(const char *spec) {
+  if (spec != NULL) parse_spec(spec);
+
+  int i;
+  for (i = 0; i < NR_CACHE; i ++) {
+    Cache *c = &config[i];
+    Assert(is_pow2(c->line_size) && is_pow2(c->assoc) && c->assoc <= 64,
+        "%s: the line size and the associativity must be powers of 2", c->name);
+    c->line_shift = __builtin_ctz(c->line_size);
+    c->nr_set = c->size / c->line_size / c->assoc;
+    if (c->size == 0) {
+      Log("%s: none", c->name);
+      continue;
+    }
+    Assert(is_pow2(c->nr_set) && c->nr_set * c->line_size * c->assoc == c->size,
+        "%s: the number of sets must be a power of 2", c->name);
+    Log("%s: %dB, %dB lines, %d-way, %s", c->name, c->size, c->line_size, c->assoc, policy_name[c->policy]);
+  }
+
+  init_cache_state();
+}
+
+/* Set up the empty caches of the current thread, as configured by
+ * init_cache(). */
+void init_cache_state(void) {
+  int i;
+  for (i = 0; i < NR_CACHE; i ++) {
+    Cache *c = &caches[i];
+    *c = config[i];
+    if (c->size == 0) continue;
+    c->lines = calloc(c->nr_set * c->assoc, sizeof(CacheLine));
+    c->plru = calloc(c->nr_set, sizeof(uint64_t));
+    assert(c->lines && c->plru);
+  }
+  caches[CACHE_L1I].next = caches[CACHE_L1D].next = &caches[CACHE_L2];
+  fetch_line = -1;
+}
+
+void free_cache_state(void) {
+  int i;
+  for (i = 0; i < NR_CACHE; i ++) {
+    free(caches[i].lines);
+    free(caches[i].plru);
+    caches[i].lines = NULL;
+    caches[i].plru = NULL;
+  }
+}
+
+bool cache_enabled(void) {
+  return true;
+}
+
+uint64_t cache_nr_miss(int level) {
+  return caches[level].nr_miss;
+}
+
+void cache_statistic(void) {
+  int i;
+  for (i = 0; i < NR_CACHE; i ++) {
+    Cache *c = &caches[i];
+    Log("cache %s: access = %ld, miss = %ld, miss rate = %.2f%%, writeback = %ld",
+        c->name, c->nr_access, c->nr_miss,
+        (c->nr_access ? c->nr_miss * 100.0 / c->nr_access : 0.0), c->nr_writeback);
+  }
+}
+
+#else
+
+void init_cache(const char *spec) {
+  if (spec != NULL) Log("cache simulation is not enabled in include/common.h, '%s' ignored", spec);
+}
+
+void init_cache_state(void) {
+}
+
+void free_cache_state(void) {
+}
+
+bool cache_enabled(void) {
+  return false;
+}
+
+uint64_t cache_nr_miss(int level) {
+  return 0;
+}
+
+void cache_statistic(void) {
+}
+
+#endif
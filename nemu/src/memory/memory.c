@@ -1,14 +1,39 @@
 #include "nemu.h"
 #include "device/map.h"
+#include "cpu/decode-cache.h"
+#include "memory/cache.h"
+#include "monitor/watchpoint.h"
+#include "monitor/snapshot.h"
+#include "cpu/hart.h"
 
-uint8_t pmem[PMEM_SIZE] PG_ALIGN = {};
+#include <sys/mman.h>
 
-static IOMap pmem_map = {
+__thread uint8_t *pmem = NULL;
+
+static __thread IOMap pmem_map = {
   .name = "pmem",
-  .space = pmem,
   .callback = NULL
 };
 
+/* Each machine has its memory of its own, whose pages are only
+ * allocated by the host when they are touched. */
+void init_mem(void) {
+  pmem = mmap(NULL, PMEM_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  Assert(pmem != MAP_FAILED, "Can not allocate the memory of the machine");
+  pmem_map.space = pmem;
+}
+
+/* Share the memory of another machine, for the harts of a machine. */
+void attach_mem(uint8_t *mem) {
+  pmem = mem;
+  pmem_map.space = pmem;
+}
+
+void free_mem(void) {
+  munmap(pmem, PMEM_SIZE);
+  pmem = NULL;
+}
+
 void register_pmem(paddr_t base) {
   pmem_map.low = base;
   pmem_map.high = base + PMEM_SIZE - 1;
@@ -18,14 +43,28 @@ void register_pmem(paddr_t base) {
 
 IOMap* fetch_mmio_map(paddr_t addr);
 
+/* Return the host address of `addr', or NULL if it is not in pmem. */
+uint8_t* paddr_host(paddr_t addr) {
+  return map_inside(&pmem_map, addr) ? pmem + (addr - pmem_map.low) : NULL;
+}
+
+/* Return the physical address of `host' in pmem. */
+paddr_t host_paddr(const uint8_t *host) {
+  return pmem_map.low + (host - pmem);
+}
+
 /* Memory accessing interfaces */
 
 uint32_t paddr_read(paddr_t addr, int len) {
   if (map_inside(&pmem_map, addr)) {
     uint32_t offset = addr - pmem_map.low;
+#ifdef CACHE_SIM
+    cache_access(addr, len, CACHE_READ);
+#endif
     return *(uint32_t *)(pmem + offset) & (~0u >> ((4 - len) << 3));
   }
   else {
+    if (hart_id != 0) return hart_io_read(addr, len, false);
     return map_read(addr, len, fetch_mmio_map(addr));
   }
 }
@@ -33,9 +72,16 @@ uint32_t paddr_read(paddr_t addr, int len) {
 void paddr_write(paddr_t addr, uint32_t data, int len) {
   if (map_inside(&pmem_map, addr)) {
     uint32_t offset = addr - pmem_map.low;
+#ifdef CACHE_SIM
+    cache_access(addr, len, CACHE_WRITE);
+#endif
     memcpy(pmem + offset, &data, len);
+    snapshot_mark_dirty(offset, len);
+    dcache_check_write(addr, len);
+    wp_watch_write(addr, len);
   }
   else {
+    if (hart_id != 0) { hart_io_write(addr, data, len, false); return; }
     return map_write(addr, data, len, fetch_mmio_map(addr));
   }
 }
@@ -0,0 +1,204 @@
+#include "nemu.h"
+#include "memory/tlb.h"
+#include "cpu/decode-cache.h"
+#include "device/perfcnt.h"
+#include "memory/cache.h"
+#include "monitor/watchpoint.h"
+#include "monitor/snapshot.h"
+
+#define TLB_ENTRY_NUM 1024
+#define TLB_IDX(addr) (((addr) / PAGE_SIZE) % TLB_ENTRY_NUM)
+
+typedef struct {
+  vaddr_t vpn;
+  int perm;       // 0 if the entry is invalid
+  uint8_t *host;  // host address of the physical page
+} TLBEntry;
+
+static __thread TLBEntry tlb[TLB_ENTRY_NUM];
+
+static __thread uint64_t nr_hit = 0, nr_miss = 0, nr_flush = 0, nr_fault = 0;
+
+uint8_t* paddr_host(paddr_t addr);
+paddr_t host_paddr(const uint8_t *host);
+void cpu_fault(vaddr_t vaddr, int type);
+
+void tlb_flush(void) {
+  memset(tlb, 0, sizeof(tlb));
+  nr_flush ++;
+  // decoded instructions are looked up by vaddr, too
+  dcache_flush_all();
+}
+
+/* Walk the page table and refill the entry of `addr'. Return false if
+ * the access faults. Otherwise `*e' is the entry, or NULL if the page
+ * can only be accessed by physical address.
+ */
+static bool tlb_fill(vaddr_t addr, int type, TLBEntry **e, paddr_t *paddr) {
+  int perm;
+  nr_miss ++;
+  *paddr = isa_tlb_walk(addr, type, &perm);
+  if (!(perm & type)) return false;
+
+  uint8_t *host = paddr_host(*paddr & ~PAGE_MASK);
+  if (host == NULL) { *e = NULL; return true; }
+
+  *e = &tlb[TLB_IDX(addr)];
+  (*e)->vpn = addr / PAGE_SIZE;
+  (*e)->perm = perm;
+  (*e)->host = host;
+  return true;
+}
+
+/* The instruction being executed is abandoned, and the ISA raises the
+ * exception. This only returns for an access from the monitor, such
+ * as the `x' command, which then reads 0 and writes nothing.
+ */
+static void tlb_fault(vaddr_t addr, int type) {
+  nr_fault ++;
+  cpu_fault(addr, type);
+}
+
+static inline TLBEntry* tlb_lookup(vaddr_t addr, int type) {
+  TLBEntry *e = &tlb[TLB_IDX(addr)];
+  if (e->vpn == addr / PAGE_SIZE && (e->perm & type)) {
+    nr_hit ++;
+    return e;
+  }
+  return NULL;
+}
+
+static uint32_t tlb_read_page(vaddr_t addr, int len, int type) {
+  TLBEntry *e = tlb_lookup(addr, type);
+  if (e == NULL) {
+    paddr_t paddr;
+    if (!tlb_fill(addr, type, &e, &paddr)) { tlb_fault(addr, type); return 0; }
+    if (e == NULL) {
+      if (type == TLB_X) dcache_fetch(paddr, len);
+      return paddr_read(paddr, len);
+    }
+  }
+  uint8_t *p = e->host + (addr & PAGE_MASK);
+  if (type == TLB_X) dcache_fetch(host_paddr(p), len);
+#ifdef CACHE_SIM
+  cache_access(host_paddr(p), len, (type == TLB_X ? CACHE_FETCH : CACHE_READ));
+#endif
+  return *(uint32_t *)p & (~0u >> ((4 - len) << 3));
+}
+
+uint32_t tlb_read(vaddr_t addr, int len, int type) {
+  if (type == TLB_R) perfcnt.load ++;
+
+  if ((addr & PAGE_MASK) + len > PAGE_SIZE) {
+    // crossing a page boundary, which is rare
+    uint32_t data = 0;
+    int i;
+    for (i = 0; i < len; i ++) {
+      data |= tlb_read_page(addr + i, 1, type) << (i * 8);
+    }
+    return data;
+  }
+  return tlb_read_page(addr, len, type);
+}
+
+static void tlb_write_page(vaddr_t addr, uint32_t data, int len) {
+  TLBEntry *e = tlb_lookup(addr, TLB_W);
+  if (e == NULL) {
+    paddr_t paddr;
+    if (!tlb_fill(addr, TLB_W, &e, &paddr)) { tlb_fault(addr, TLB_W); return; }
+    if (e == NULL) { paddr_write(paddr, data, len); return; }
+  }
+  uint8_t *p = e->host + (addr & PAGE_MASK);
+#ifdef CACHE_SIM
+  cache_access(host_paddr(p), len, CACHE_WRITE);
+#endif
+  memcpy(p, &data, len);
+  snapshot_mark_dirty(p - pmem, len);
+  dcache_check_write(host_paddr(p), len);
+  wp_watch_write(host_paddr(p), len);
+}
+
+void tlb_write(vaddr_t addr, uint32_t data, int len) {
+  perfcnt.store ++;
+
+  if ((addr & PAGE_MASK) + len > PAGE_SIZE) {
+    int i;
+    for (i = 0; i < len; i ++) {
+      tlb_write_page(addr + i, data >> (i * 8), 1);
+    }
+    return;
+  }
+  tlb_write_page(addr, data, len);
+}
+
+static uint8_t* tlb_atomic_host(vaddr_t addr, int len) {
+  Assert((addr & (len - 1)) == 0, "misaligned atomic access at vaddr = 0x%08x", addr);
+  perfcnt.load ++;
+  perfcnt.store ++;
+
+  TLBEntry *e = tlb_lookup(addr, TLB_W);
+  if (e == NULL) {
+    paddr_t paddr;
+    if (!tlb_fill(addr, TLB_W, &e, &paddr)) {
+      tlb_fault(addr, TLB_W);
+      panic("atomic access faults at vaddr = 0x%08x", addr);
+    }
+    Assert(e != NULL, "atomic access out of pmem at paddr = 0x%08x", paddr);
+  }
+  uint8_t *p = e->host + (addr & PAGE_MASK);
+#ifdef CACHE_SIM
+  cache_access(host_paddr(p), len, CACHE_WRITE);
+#endif
+  snapshot_mark_dirty(p - pmem, len);
+  dcache_check_write(host_paddr(p), len);
+  wp_watch_write(host_paddr(p), len);
+  return p;
+}
+
+uint32_t tlb_atomic(vaddr_t addr, uint32_t data, int len, int op) {
+  uint8_t *p = tlb_atomic_host(addr, len);
+  if (op == ATOMIC_SWAP) {
+    switch (len) {
+      case 4: return __atomic_exchange_n((uint32_t *)p, data, __ATOMIC_SEQ_CST);
+      case 2: return __atomic_exchange_n((uint16_t *)p, data, __ATOMIC_SEQ_CST);
+      case 1: return __atomic_exchange_n(p, data, __ATOMIC_SEQ_CST);
+      default: assert(0);
+    }
+  }
+
+  assert(len == 4);
+  uint32_t *w = (uint32_t *)p;
+  switch (op) {
+    case ATOMIC_ADD: return __atomic_fetch_add(w, data, __ATOMIC_SEQ_CST);
+    case ATOMIC_AND: return __atomic_fetch_and(w, data, __ATOMIC_SEQ_CST);
+    case ATOMIC_OR:  return __atomic_fetch_or (w, data, __ATOMIC_SEQ_CST);
+    case ATOMIC_XOR: return __atomic_fetch_xor(w, data, __ATOMIC_SEQ_CST);
+  }
+
+  uint32_t old = __atomic_load_n(w, __ATOMIC_SEQ_CST), new;
+  do {
+    switch (op) {
+      case ATOMIC_MIN:  new = ((int32_t)old < (int32_t)data ? old : data); break;
+      case ATOMIC_MAX:  new = ((int32_t)old > (int32_t)data ? old : data); break;
+      case ATOMIC_MINU: new = (old < data ? old : data); break;
+      case ATOMIC_MAXU: new = (old > data ? old : data); break;
+      default: panic("invalid atomic operation %d", op);
+    }
+  } while (!__atomic_compare_exchange_n(w, &old, new, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST));
+  return old;
+}
+
+bool tlb_cas(vaddr_t addr, uint32_t expect, uint32_t data) {
+  uint32_t *w = (uint32_t *)tlb_atomic_host(addr, 4);
+  return __atomic_compare_exchange_n(w, &expect, data, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+
+uint64_t tlb_nr_miss(void) {
+  return nr_miss;
+}
+
+void tlb_statistic(void) {
+  uint64_t total = nr_hit + nr_miss;
+  Log("tlb: hit = %ld, miss = %ld, hit rate = %.2f%%, flush = %ld, fault = %ld",
+      nr_hit, nr_miss, (total ? nr_hit * 100.0 / total : 0.0), nr_flush, nr_fault);
+}
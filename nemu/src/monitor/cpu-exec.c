@@ -1,6 +1,10 @@
 #include "nemu.h"
 #include "monitor/monitor.h"
 #include "monitor/watchpoint.h"
+#include "monitor/itrace.h"
+#include "device/event.h"
+#include "cpu/hart.h"
+#include <setjmp.h>
 
 /* The assembly code of instructions executed is only output to the screen
  * when the number of instructions executed is less than this value.
@@ -9,70 +13,162 @@
  */
 #define MAX_INSTR_TO_PRINT 10
 
-/* restrict the size of log file */
-#define LOG_MAX (1024 * 1024)
-
-NEMUState nemu_state = {.state = NEMU_STOP};
+__thread NEMUState nemu_state = {.state = NEMU_STOP};
 
 void interpret_rtl_exit(int state, vaddr_t halt_pc, uint32_t halt_ret) {
   nemu_state = (NEMUState) { .state = state, .halt_pc = halt_pc, .halt_ret = halt_ret };
+#ifdef BLOCK_CACHE
+  void block_break(void);
+  block_break();
+#endif
 }
 
 vaddr_t exec_once(void);
+uint64_t block_exec(uint64_t n);
 void difftest_step(vaddr_t ori_pc, vaddr_t next_pc);
-void asm_print(vaddr_t ori_pc, int instr_len, bool print_flag);
-void log_clearbuf(void);
+void difftest_block(vaddr_t ori_pc, uint64_t n);
+uint64_t difftest_block_budget(void);
+void asm_print(void);
+
+__thread uint64_t g_nr_guest_instr = 0;
 
-static uint64_t g_nr_guest_instr = 0;
+void dcache_statistic(void);
+void tlb_statistic(void);
+void cache_statistic(void);
+void bpred_statistic(void);
+void block_statistic(void);
+void profile_statistic(void);
+void ftrace_statistic(void);
 
 void monitor_statistic(void) {
   Log("total guest instructions = %ld", g_nr_guest_instr);
+  dcache_statistic();
+  tlb_statistic();
+  cache_statistic();
+  bpred_statistic();
+  block_statistic();
+  hart_statistic();
+  profile_statistic();
+  ftrace_statistic();
 }
 
-/* Simulate how the CPU works. */
-void cpu_exec(uint64_t n) {
-  switch (nemu_state.state) {
-    case NEMU_END: case NEMU_ABORT:
-      printf("Program execution has ended. To restart the program, exit NEMU and run again.\n");
-      return;
-    default: nemu_state.state = NEMU_RUNNING;
+/* A memory access of the instruction being executed faults. The
+ * instruction is abandoned, in the interpreter or in code from the JIT,
+ * and execute() goes on after raising the exception. Outside execute(),
+ * the access comes from the monitor, and this returns.
+ */
+static __thread jmp_buf *fault_buf = NULL;
+static __thread vaddr_t fault_vaddr;
+static __thread int fault_type;
+
+void cpu_fault(vaddr_t vaddr, int type) {
+  if (fault_buf == NULL) return;
+  fault_vaddr = vaddr;
+  fault_type = type;
+  longjmp(*fault_buf, 1);
+}
+
+uint64_t cpu_raise_fault(vaddr_t vaddr, int type, vaddr_t *pc);
+
+/* Execute at most `n' instructions on the current hart, until the
+ * state of NEMU changes. */
+void execute(uint64_t n) {
+  jmp_buf buf;
+  uint64_t end = (n > UINT64_MAX - g_nr_guest_instr ? UINT64_MAX : g_nr_guest_instr + n);
+#if defined(DIFF_TEST) && defined(BLOCK_CACHE)
+  volatile vaddr_t ori_pc = cpu.pc;
+#endif
+
+  if (setjmp(buf) != 0) {
+    fault_buf = NULL;
+    __attribute__((unused)) vaddr_t pc;
+    uint64_t nr = cpu_raise_fault(fault_vaddr, fault_type, &pc);
+#ifdef DIFF_TEST
+#ifdef BLOCK_CACHE
+    difftest_block(ori_pc, nr);
+#else
+    difftest_step(pc, cpu.pc);
+#endif
+#endif
+    g_nr_guest_instr += nr;
+    if (g_nr_guest_instr >= event_next) { event_run(); hart_check(); }
+    if (nemu_state.state != NEMU_RUNNING) return;
   }
+  fault_buf = &buf;
+  n = end - g_nr_guest_instr;
+
+#ifdef BLOCK_CACHE
+  /* Run by blocks. The per-instruction checks below are only
+   * needed at the block boundaries. Blocks stop at the next event. */
+  while (n > 0) {
+    uint64_t budget = n;
+    if (event_next > g_nr_guest_instr && event_next - g_nr_guest_instr < budget) {
+      budget = event_next - g_nr_guest_instr;
+    }
+#ifdef DIFF_TEST
+    if (difftest_block_budget() < budget) budget = difftest_block_budget();
+    ori_pc = cpu.pc;
+#endif
+    uint64_t nr = block_exec(budget);
+#ifdef DIFF_TEST
+    difftest_block(ori_pc, nr);
+#endif
+    n -= nr;
+    g_nr_guest_instr += nr;
 
+    if (g_nr_guest_instr >= event_next) { event_run(); hart_check(); }
+
+    if (nemu_state.state != NEMU_RUNNING) break;
+  }
+#else
   for (; n > 0; n --) {
     __attribute__((unused)) vaddr_t ori_pc = cpu.pc;
 
+#ifdef DEBUG
+    // the last instructions of `si n' are printed
+    extern __thread bool log_asm_enable;
+    log_asm_enable = (n < MAX_INSTR_TO_PRINT);
+    itrace_begin(ori_pc);
+#endif
+
     /* Execute one instruction, including instruction fetch,
      * instruction decode, and the actual execution. */
-    __attribute__((unused)) vaddr_t seq_pc = exec_once();
+    exec_once();
 
 #if defined(DIFF_TEST)
   difftest_step(ori_pc, cpu.pc);
 #endif
 
 #ifdef DEBUG
-  if (g_nr_guest_instr < LOG_MAX) {
-    asm_print(ori_pc, seq_pc - ori_pc, n < MAX_INSTR_TO_PRINT);
-  }
-  else if (g_nr_guest_instr == LOG_MAX) {
-    log_write("\n[Warning] To restrict the size of log file, "
-              "we do not record more instruction trace beyond this point.\n"
-              "To capture more trace, you can modify the LOG_MAX macro in %s\n\n", __FILE__);
-  }
-  log_clearbuf();
-
-    /* TODO: check watchpoints here. */
+  if (log_asm_enable) asm_print();
+  itrace_end();
 
+  if (wp_check() && nemu_state.state == NEMU_RUNNING) nemu_state.state = NEMU_STOP;
 #endif
 
   g_nr_guest_instr ++;
 
-#ifdef HAS_IOE
-    extern void device_update();
-    device_update();
-#endif
+    if (g_nr_guest_instr >= event_next) { event_run(); hart_check(); }
 
     if (nemu_state.state != NEMU_RUNNING) break;
   }
+#endif
+
+  fault_buf = NULL;
+}
+
+/* Simulate how the CPU works. */
+void cpu_exec(uint64_t n) {
+  switch (nemu_state.state) {
+    case NEMU_END: case NEMU_ABORT:
+      printf("Program execution has ended. To restart the program, exit NEMU and run again.\n");
+      return;
+    default: nemu_state.state = NEMU_RUNNING;
+  }
+
+  hart_resume();
+  execute(n);
+  hart_pause();
 
   switch (nemu_state.state) {
     case NEMU_RUNNING: nemu_state.state = NEMU_STOP; break;
@@ -82,6 +178,10 @@ void cpu_exec(uint64_t n) {
           (nemu_state.state == NEMU_ABORT ? "\33[1;31mABORT" :
            (nemu_state.halt_ret == 0 ? "\33[1;32mHIT GOOD TRAP" : "\33[1;31mHIT BAD TRAP")),
           nemu_state.halt_pc);
+      if (nemu_state.state == NEMU_ABORT || nemu_state.halt_ret != 0) {
+        itrace_dump(NULL);
+      }
       monitor_statistic();
+      log_flush();
   }
 }
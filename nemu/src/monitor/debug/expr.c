@@ -1,270 +1,294 @@
 #include "nemu.h"
+#include "monitor/expr.h"
 
-/* We use the POSIX regex functions to process regular expressions.
- * Type 'man regex' for more information about POSIX regex functions.
+rtlreg_t* isa_reg_str2ptr(const char *s);
+uint8_t* paddr_host(paddr_t addr);
+
+enum {
+  TK_NOTYPE = 256, TK_EQ, TK_NEQ, TK_AND, TK_OR, TK_REG, TK_HEX, TK_NUM, TK_END,
+};
+
+/* The lexer is a DFA driven by the tables below. It takes the longest
+ * prefix of the input which ends in an accepting state as the next token,
+ * so the input is scanned once without trying rules one by one.
  */
-#include <sys/types.h>
-#include <regex.h>
 
 enum {
-  TK_NOTYPE = 256, TK_EQ, TK_NEQ, TK_AND, TK_OR, TK_REG, TK_HEX, TK_NUM,TK_NEGATIVE,TK_DEREFERENCE,
+  C_OTHER, C_SPACE, C_ZERO, C_DIGIT, C_HEXL, C_X, C_ALPHA, C_DOLLAR,
+  C_PLUS, C_MINUS, C_STAR, C_SLASH, C_LP, C_RP, C_EQ, C_BANG, C_AMP, C_BAR,
+  NR_CLASS
+};
 
-  /* TODO: Add more token types */
+static const uint8_t cclass[256] = {
+  [' '] = C_SPACE, ['\t'] = C_SPACE,
+  ['0'] = C_ZERO, ['1' ... '9'] = C_DIGIT,
+  ['a' ... 'f'] = C_HEXL, ['A' ... 'F'] = C_HEXL, ['x'] = C_X, ['X'] = C_X,
+  ['g' ... 'w'] = C_ALPHA, ['y'] = C_ALPHA, ['z'] = C_ALPHA,
+  ['G' ... 'W'] = C_ALPHA, ['Y'] = C_ALPHA, ['Z'] = C_ALPHA, ['_'] = C_ALPHA,
+  ['$'] = C_DOLLAR, ['+'] = C_PLUS, ['-'] = C_MINUS, ['*'] = C_STAR, ['/'] = C_SLASH,
+  ['('] = C_LP, [')'] = C_RP, ['='] = C_EQ, ['!'] = C_BANG, ['&'] = C_AMP, ['|'] = C_BAR,
+};
 
+enum {
+  S_ERR, S_START, S_SPACE, S_ZERO, S_DEC, S_HEX0, S_HEX, S_DOLLAR, S_REG,
+  S_PLUS, S_MINUS, S_STAR, S_SLASH, S_LP, S_RP,
+  S_EQ1, S_EQ, S_BANG, S_NEQ, S_AMP1, S_AND, S_BAR1, S_OR,
+  NR_STATE
 };
 
-static struct rule {
-  char *regex;
-  int token_type;
-} rules[] = {
+#define NAME_CHARS(s) [C_ZERO] = s, [C_DIGIT] = s, [C_HEXL] = s, [C_X] = s, [C_ALPHA] = s
 
-  /* TODO: Add more rules.
-   * Pay attention to the precedence level of different rules.
-   */
+static const uint8_t dfa[NR_STATE][NR_CLASS] = {
+  [S_START] = {
+    [C_SPACE] = S_SPACE, [C_ZERO] = S_ZERO, [C_DIGIT] = S_DEC, [C_DOLLAR] = S_DOLLAR,
+    [C_PLUS] = S_PLUS, [C_MINUS] = S_MINUS, [C_STAR] = S_STAR, [C_SLASH] = S_SLASH,
+    [C_LP] = S_LP, [C_RP] = S_RP, [C_EQ] = S_EQ1, [C_BANG] = S_BANG,
+    [C_AMP] = S_AMP1, [C_BAR] = S_BAR1,
+  },
+  [S_SPACE]  = { [C_SPACE] = S_SPACE },
+  [S_ZERO]   = { [C_ZERO] = S_DEC, [C_DIGIT] = S_DEC, [C_X] = S_HEX0 },
+  [S_DEC]    = { [C_ZERO] = S_DEC, [C_DIGIT] = S_DEC },
+  [S_HEX0]   = { [C_ZERO] = S_HEX, [C_DIGIT] = S_HEX, [C_HEXL] = S_HEX },
+  [S_HEX]    = { [C_ZERO] = S_HEX, [C_DIGIT] = S_HEX, [C_HEXL] = S_HEX },
+  [S_DOLLAR] = { NAME_CHARS(S_REG), [C_DOLLAR] = S_REG },  // `$$0' is riscv32 x0
+  [S_REG]    = { NAME_CHARS(S_REG) },
+  [S_EQ1]    = { [C_EQ] = S_EQ },
+  [S_BANG]   = { [C_EQ] = S_NEQ },
+  [S_AMP1]   = { [C_AMP] = S_AND },
+  [S_BAR1]   = { [C_BAR] = S_OR },
+};
 
-  {" +", TK_NOTYPE},    // spaces
-  {"\\+", '+'},         // plus
-  {"==", TK_EQ},       // equal
-  {"-", '-'},         // minus
-  {"\\*", '*'},         // multiply
-  {"/", '/'},         // divide
-  {"\\(", '('},         // left bracket
-  {"\\)", ')'},         // right bracket
-  {"!=", TK_NEQ},       // not equal
-  {"&&", TK_AND},       // and
-  {"\\|\\|", TK_OR},    // or
-   {"\\$(\\$0|ra|[sgt]p|t[0-6]|a[0-7]|s([0-9]|1[0-1]))", TK_REG},//registers
-  {"0[xX][0-9a-fA-F]+",TK_HEX},    //hex numbers
-  {"[0-9]+", TK_NUM},   // numbers
+// the token recognized in each accepting state
+static const uint16_t accept[NR_STATE] = {
+  [S_SPACE] = TK_NOTYPE, [S_ZERO] = TK_NUM, [S_DEC] = TK_NUM, [S_HEX] = TK_HEX, [S_REG] = TK_REG,
+  [S_PLUS] = '+', [S_MINUS] = '-', [S_STAR] = '*', [S_SLASH] = '/', [S_LP] = '(', [S_RP] = ')',
+  [S_EQ] = TK_EQ, [S_BANG] = '!', [S_NEQ] = TK_NEQ, [S_AND] = TK_AND, [S_OR] = TK_OR,
 };
 
-#define NR_REGEX (sizeof(rules) / sizeof(rules[0]) )
+// the state of the lexer and the parser is per thread, so that
+// tools/gen-expr can run the compiler in parallel
+static __thread const char *lex_input = NULL, *lex_p = NULL;
+static __thread int tok;
+static __thread const char *tok_str;
+static __thread int tok_len;
 
-static regex_t re[NR_REGEX] = {};
+static bool next_token(void) {
+  while (true) {
+    const char *s = lex_p, *end = NULL;
+    int state = S_START, last = S_ERR;
+    if (*s == '\0') { tok = TK_END; return true; }
 
-/* Rules are used for many times.
- * Therefore we compile them only once before any usage.
- */
-void init_regex() {
-  int i;
-  char error_msg[128];
-  int ret;
+    while ((state = dfa[state][cclass[(uint8_t)*s]]) != S_ERR) {
+      s ++;
+      if (accept[state]) { last = state; end = s; }
+    }
 
-  for (i = 0; i < NR_REGEX; i ++) {
-    ret = regcomp(&re[i], rules[i].regex, REG_EXTENDED);
-    if (ret != 0) {
-      regerror(ret, &re[i], error_msg, 128);
-      panic("regex compilation failed: %s\n%s", error_msg, rules[i].regex);
+    if (last == S_ERR) {
+      int position = lex_p - lex_input;
+      printf("no match at position %d\n%s\n%*.s^\n", position, lex_input, position, "");
+      return false;
     }
+
+    tok_str = lex_p;
+    tok_len = end - lex_p;
+    lex_p = end;
+    if (accept[last] != TK_NOTYPE) { tok = accept[last]; return true; }
   }
 }
 
-typedef struct token {
-  int type;
-  char str[32];
-} Token;
+/* The parser climbs the precedence of binary operators, and builds a
+ * tree whose constant subtrees are folded as soon as they are built.
+ */
 
-static Token tokens[32] __attribute__((used)) = {};
-static int nr_token __attribute__((used))  = 0;
+typedef struct Node {
+  uint32_t type;
+  uint32_t imm;
+  void *ptr;
+  struct Node *l, *r;
+} Node;
 
-static bool make_token(char *e) {
-  int position = 0;
-  int i;
-  regmatch_t pmatch;
+#define NR_NODE 256
 
-  nr_token = 0;
+static __thread Node node_pool[NR_NODE];
+static __thread int nr_node = 0;
 
-  while (e[position] != '\0') {
-    /* Try all rules one by one. */
-    for (i = 0; i < NR_REGEX; i ++) {
-      if (regexec(&re[i], e + position, 1, &pmatch, 0) == 0 && pmatch.rm_so == 0) {
-        char *substr_start = e + position;
-        int substr_len = pmatch.rm_eo;
+static inline bool calc(uint32_t type, uint32_t a, uint32_t b, uint32_t *res) {
+  switch (type) {
+    case EXPR_ADD: *res = a + b; return true;
+    case EXPR_SUB: *res = a - b; return true;
+    case EXPR_MUL: *res = a * b; return true;
+    case EXPR_DIV:
+      if (b == 0) return false;
+      *res = a / b;
+      return true;
+    case EXPR_EQ: *res = (a == b); return true;
+    case EXPR_NEQ: *res = (a != b); return true;
+    case EXPR_AND: *res = (a && b); return true;
+    case EXPR_OR: *res = (a || b); return true;
+    default: assert(0);
+  }
+}
 
-        Log("match rules[%d] = \"%s\" at position %d with len %d: %.*s",
-            i, rules[i].regex, position, substr_len, substr_len, substr_start);
-        position += substr_len;
+static Node* new_node(uint32_t type, uint32_t imm, Node *l, Node *r) {
+  if (nr_node == NR_NODE) { printf("expression too long\n"); return NULL; }
+  Node *n = &node_pool[nr_node ++];
+  n->type = type;
+  n->imm = imm;
+  n->ptr = NULL;
+  n->l = l;
+  n->r = r;
+  return n;
+}
 
-        /* TODO: Now a new token is recognized with rules[i]. Add codes
-         * to record the token in the array `tokens'. For certain types
-         * of tokens, some extra actions should be performed.
-         */
-        
-        switch (rules[i].token_type) {
-          case TK_NOTYPE: break;
-          case '+': tokens[nr_token].type = '+'; nr_token++; break;
-          case '-': tokens[nr_token].type = '-'; nr_token++; break;
-          case '*': tokens[nr_token].type = '*'; nr_token++; break;
-          case '/': tokens[nr_token].type = '/'; nr_token++; break;
-          case '(': tokens[nr_token].type = '('; nr_token++; break;
-          case ')': tokens[nr_token].type = ')'; nr_token++; break;
-          case TK_EQ: tokens[nr_token].type = TK_EQ; nr_token++; break;
-          case TK_NEQ: tokens[nr_token].type = TK_NEQ; nr_token++; break;
-          case TK_AND: tokens[nr_token].type = TK_AND; nr_token++; break;
-          case TK_OR: tokens[nr_token].type = TK_OR; nr_token++; break;
-          case TK_REG: tokens[nr_token].type = TK_REG;
-                        strncpy(tokens[nr_token].str, substr_start, substr_len);
-                        nr_token++; break;
-          case TK_HEX: tokens[nr_token].type = TK_HEX;
-                        if(substr_len > 32) assert(0);
-                        strncpy(tokens[nr_token].str, substr_start, substr_len);
-                        nr_token++; break;
-          case TK_NUM: tokens[nr_token].type = TK_NUM;
-                        if(substr_len > 32) assert(0);
-                        strncpy(tokens[nr_token].str, substr_start, substr_len);
-                        nr_token++; break;
-          default:  //TODO();
-                    assert(0);
+static Node* new_unary(uint32_t type, Node *l) {
+  if (l == NULL) return NULL;
+  if (l->type == EXPR_IMM) {
+    switch (type) {
+      case EXPR_NEG: l->imm = -l->imm; return l;
+      case EXPR_NOT: l->imm = !l->imm; return l;
+      case EXPR_DEREF: {
+        // a constant address in pmem is read from the host directly
+        uint8_t *host = paddr_host(l->imm);
+        if (host != NULL && paddr_host(l->imm + 3) != NULL) {
+          l->type = EXPR_MEM;
+          l->ptr = host;
+          return l;
         }
-
-        break;
       }
     }
-
-    if (i == NR_REGEX) {
-      printf("no match at position %d\n%s\n%*.s^\n", position, e, position, "");
-      return false;
-    }
   }
-
-  return true;
+  return new_node(type, 0, l, NULL);
 }
 
-bool check_parentheses(int p, int q){
-  if(tokens[p].type != '(' || tokens[q].type != ')') return false;
-  int i, cnt = 0;
-  for(i = p + 1; i < q; i++){
-    if(tokens[i].type == '(') cnt++;
-    else if(tokens[i].type == ')') cnt--;
-    if(cnt < 0) return false;
+static Node* new_binary(uint32_t type, Node *l, Node *r) {
+  if (l == NULL || r == NULL) return NULL;
+  uint32_t res;
+  if (l->type == EXPR_IMM && r->type == EXPR_IMM && calc(type, l->imm, r->imm, &res)) {
+    l->imm = res;
+    return l;
   }
-  if(cnt == 0) return true;
-  else return false;
+  return new_node(type, 0, l, r);
 }
 
-uint32_t expr(char *e, bool *success) {
-  if (!make_token(e)) {
-    *success = false;
-    return 0;
-  }
-  for(int i = 0; i < nr_token; i++){
-    if(tokens[i].type == '*' && (i==0 || (tokens[i-1].type == '+')|| (tokens[i-1].type == '-')|| (tokens[i-1].type == '(') || (tokens[i-1].type == '*'))){
-      tokens[i].type = TK_DEREFERENCE;
-    }
-    if(tokens[i].type == '-' && (i==0 || (tokens[i-1].type == '+')|| (tokens[i-1].type == '-')|| (tokens[i-1].type == '('))){
-      tokens[i].type = TK_NEGATIVE;
+static Node* parse_expr(int min_prec);
+
+static Node* parse_unary(void) {
+  Node *n;
+  int i;
+  uint32_t val = 0;
+  switch (tok) {
+    case '-': if (!next_token()) return NULL; return new_unary(EXPR_NEG, parse_unary());
+    case '*': if (!next_token()) return NULL; return new_unary(EXPR_DEREF, parse_unary());
+    case '!': if (!next_token()) return NULL; return new_unary(EXPR_NOT, parse_unary());
+    case '(':
+      if (!next_token()) return NULL;
+      n = parse_expr(1);
+      if (n == NULL || tok != ')') return NULL;
+      return (next_token() ? n : NULL);
+    case TK_NUM:
+      // always decimal, a leading 0 does not mean octal
+      for (i = 0; i < tok_len; i ++) val = val * 10 + (tok_str[i] - '0');
+      n = new_node(EXPR_IMM, val, NULL, NULL);
+      return (next_token() ? n : NULL);
+    case TK_HEX:
+      for (i = 2; i < tok_len; i ++) {
+        char c = tok_str[i] | 0x20;
+        val = (val << 4) + (c <= '9' ? c - '0' : c - 'a' + 10);
+      }
+      n = new_node(EXPR_IMM, val, NULL, NULL);
+      return (next_token() ? n : NULL);
+    case TK_REG: {
+      char name[16];
+      if (tok_len > sizeof(name)) return NULL;
+      memcpy(name, tok_str + 1, tok_len - 1);
+      name[tok_len - 1] = '\0';
+      rtlreg_t *reg = isa_reg_str2ptr(name);
+      if (reg == NULL) { printf("unknown register '%s'\n", name); return NULL; }
+      n = new_node(EXPR_REG, 0, NULL, NULL);
+      if (n != NULL) n->ptr = reg;
+      return (next_token() ? n : NULL);
     }
+    default: return NULL;
   }
-  return eval(0, nr_token-1, success);
 }
 
-int eval(int i, int j, bool *success){
-  if(i > j){
-    *success = false;
-    return 0;
+// return the precedence of the binary operator `tok', or 0 for others
+static inline int binary_op(int tok, uint32_t *type) {
+  switch (tok) {
+    case TK_OR:  *type = EXPR_OR;  return 1;
+    case TK_AND: *type = EXPR_AND; return 2;
+    case TK_EQ:  *type = EXPR_EQ;  return 3;
+    case TK_NEQ: *type = EXPR_NEQ; return 3;
+    case '+':    *type = EXPR_ADD; return 4;
+    case '-':    *type = EXPR_SUB; return 4;
+    case '*':    *type = EXPR_MUL; return 5;
+    case '/':    *type = EXPR_DIV; return 5;
+    default: return 0;
   }
-  else if(i == j){
-    if(tokens[i].type != TK_NUM && tokens[i].type != TK_HEX && tokens[i].type != TK_REG){
-      *success = false;
-      return 0;
-    }
-    int number;
-    *success = true;
+}
 
-    if(tokens[i].type == TK_REG)
-      number = isa_reg_str2val(&(tokens[i].str[1]), success);
-    else if(tokens[i].type == TK_NUM)
-      sscanf(tokens[i].str, "%d", &number);
-    else
-      sscanf(&(tokens[i].str[2]), "%x", &number); 
-    return number;
-  }
-  else if(check_parentheses(i,j)){
-    return eval(i+1, j-1, success);
+static Node* parse_expr(int min_prec) {
+  Node *l = parse_unary();
+  uint32_t type;
+  int prec;
+  while (l != NULL && (prec = binary_op(tok, &type)) >= min_prec && prec > 0) {
+    if (!next_token()) return NULL;
+    l = new_binary(type, l, parse_expr(prec + 1));
   }
-  else{
-    int bracketNum = 0, op = -1; // op is the position of main opcode
-    int flag = 6; // flag is 1 only when the main opcode is * or /
-    bool success1, success2;
-    int value1, value2;
-    // &&  <   !=,==  <  *,/  <  +,-
-    for(int k = i; k <=j; k++){
-      if(tokens[k].type == '('){
-        bracketNum++;
-      }
-      else if(tokens[k].type == ')'){
-        bracketNum--;
-      }
-      else if(bracketNum == 0){
-        if(tokens[k].type == '+' || tokens[k].type == '-'){
-          op = k;
-          flag = 1;
-        }
-        if(flag>1 && (tokens[k].type == '*' || tokens[k].type == '/')){
-          op = k;
-          flag = 2;
-        }
-        if(flag > 2 && (tokens[k].type == TK_EQ || tokens[k].type == TK_NEQ)){
-          op = k;
-          flag = 3;
-        }
-        if(flag >= 4 && (tokens[k].type == TK_AND)){
-          op = k;
-          flag = 4;
-        }
-        if(flag >= 5 &&(tokens[k].type == TK_DEREFERENCE)){
-            op = k;
-            flag = 5;
-        }
-        if(flag >= 6 &&(tokens[k].type == TK_NEGATIVE)){
-            op = k;
-            flag = 6;
-        }
-      }
-    }
+  return l;
+}
 
-    if(op == -1){
-      *success = false;
-      return 0;
-    }
+static bool flatten(Node *n, ExprCode *code) {
+  if (n->l != NULL && !flatten(n->l, code)) return false;
+  if (n->r != NULL && !flatten(n->r, code)) return false;
+  if (code->nr_op == EXPR_MAX_OP) { printf("expression too long\n"); return false; }
+  ExprOp *op = &code->op[code->nr_op ++];
+  op->type = n->type;
+  op->imm = n->imm;
+  op->ptr = n->ptr;
+  return true;
+}
 
-    if(flag == 5){
-        int addr = eval(i+1, j, success);
-        if(!(*success)){
-          return 0;
-        }
-        return paddr_read(addr, 4);
-    }
+bool expr_compile(const char *e, ExprCode *code) {
+  lex_input = lex_p = e;
+  nr_node = 0;
+  code->nr_op = 0;
+  if (!next_token()) return false;
+  Node *root = parse_expr(1);
+  if (root == NULL || tok != TK_END) return false;
+  return flatten(root, code);
+}
 
-    if(flag == 6){
-        int val = eval(i+1, j, success);
-        if(!(*success)){
-          return 0;
-        }
-        return -val;
+uint32_t expr_eval(const ExprCode *code, bool *success) {
+  uint32_t stack[EXPR_MAX_OP];
+  int sp = 0, i;
+  *success = true;
+  for (i = 0; i < code->nr_op; i ++) {
+    const ExprOp *op = &code->op[i];
+    switch (op->type) {
+      case EXPR_IMM: stack[sp ++] = op->imm; continue;
+      case EXPR_REG: stack[sp ++] = *(rtlreg_t *)op->ptr; continue;
+      case EXPR_MEM: stack[sp ++] = *(uint32_t *)op->ptr; continue;
+      case EXPR_DEREF: stack[sp - 1] = paddr_read(stack[sp - 1], 4); continue;
+      case EXPR_NEG: stack[sp - 1] = -stack[sp - 1]; continue;
+      case EXPR_NOT: stack[sp - 1] = !stack[sp - 1]; continue;
     }
 
-    value1 = eval(i, op-1, &success1);
-    value2 = eval(op+1, j, &success2);
-    if(!success1 || !success2){
+    sp --;
+    if (!calc(op->type, stack[sp - 1], stack[sp], &stack[sp - 1])) {
+      printf("Divide 0!\n");
       *success = false;
       return 0;
     }
-    *success = true;
-    switch(tokens[op].type){
-      case '+': return value1 + value2;
-      case '-': return value1 - value2;
-      case '*': return value1*value2;
-      case '/':
-        if(value2 == 0){
-          printf("Divide 0!\n");
-          assert(0);
-        }
-        return value1/value2;
-      case TK_EQ: return (value1 == value2);
-      case TK_NEQ: return (value1 != value2);
-      case TK_AND: return (value1 && value2);
-      default: assert(0);
-    }
   }
-}
\ No newline at end of file
+  return stack[0];
+}
+
+uint32_t expr(char *e, bool *success) {
+  ExprCode code;
+  if (!expr_compile(e, &code)) {
+    *success = false;
+    return 0;
+  }
+  return expr_eval(&code, success);
+}
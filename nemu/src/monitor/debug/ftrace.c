@@ -0,0 +1,208 @@
+#include "nemu.h"
+#include "monitor/ftrace.h"
+#include "monitor/symbol.h"
+#include <stdlib.h>
+
+#define FTRACE_STACK_SIZE 4096
+#define FTRACE_TOP 20
+
+__thread bool ftrace_enable = false;
+FtraceRecord ftrace_buf[FTRACE_BUF_SIZE];
+int ftrace_nr = 0;
+
+/* A node of the calling context tree is a function called along
+ * a particular path from the root. Children are created after
+ * their parents, so a parent always has a smaller index. */
+typedef struct {
+  vaddr_t func;
+  int parent, child, sibling;
+  uint64_t self;      // instructions executed in the function itself
+  uint64_t nr_call;
+} Node;
+
+static Node *node = NULL;
+static int nr_node = 0, max_node = 0;
+
+typedef struct {
+  int node;           // the caller
+  vaddr_t link;
+} Frame;
+
+static Frame stack[FTRACE_STACK_SIZE];
+static int sp = 0;
+static int cur = 0;
+static uint64_t last_icount = 0;
+
+static char *folded_file = NULL;
+
+/* functions are identified by their entries */
+static inline vaddr_t func_of(vaddr_t addr) {
+  int sym = symbol_find(addr);
+  return (sym >= 0 ? symbol_addr(sym) : addr);
+}
+
+static int new_node(vaddr_t func, int parent) {
+  if (nr_node == max_node) {
+    max_node = (max_node == 0 ? 1024 : max_node * 2);
+    node = realloc(node, sizeof(Node) * max_node);
+    assert(node);
+  }
+  node[nr_node] = (Node) { .func = func, .parent = parent, .child = -1, .sibling = -1 };
+  if (parent >= 0) {
+    node[nr_node].sibling = node[parent].child;
+    node[parent].child = nr_node;
+  }
+  return nr_node ++;
+}
+
+static int find_child(int parent, vaddr_t func) {
+  int i, prev = -1;
+  for (i = node[parent].child; i >= 0; prev = i, i = node[i].sibling) {
+    if (node[i].func == func) {
+      // move to front, since calls from a context tend to repeat
+      if (prev >= 0) {
+        node[prev].sibling = node[i].sibling;
+        node[i].sibling = node[parent].child;
+        node[parent].child = i;
+      }
+      return i;
+    }
+  }
+  return new_node(func, parent);
+}
+
+/* replay the records into the calling context tree */
+void ftrace_process(void) {
+  int i;
+  for (i = 0; i < ftrace_nr; i ++) {
+    FtraceRecord *r = &ftrace_buf[i];
+    node[cur].self += r->icount - last_icount;
+    last_icount = r->icount;
+
+    if (r->type == FTRACE_CALL) {
+      if (sp == FTRACE_STACK_SIZE) {
+        // too deep, forget the outermost frame
+        memmove(stack, stack + 1, sizeof(Frame) * (FTRACE_STACK_SIZE - 1));
+        sp --;
+      }
+      stack[sp ++] = (Frame) { .node = cur, .link = r->link };
+      cur = find_child(cur, func_of(r->target));
+      node[cur].nr_call ++;
+    }
+    else {
+      // unwind to the frame returned to, which is not always
+      // the innermost one (e.g. longjmp() and context switches)
+      int k;
+      for (k = sp - 1; k >= 0; k --) {
+        if (stack[k].link == r->target) break;
+      }
+      if (k >= 0) {
+        cur = stack[k].node;
+        sp = k;
+      }
+    }
+  }
+  ftrace_nr = 0;
+}
+
+void init_ftrace(bool enable, const char *log_file) {
+  if (!enable) return;
+  ftrace_enable = true;
+  new_node(func_of(cpu.pc), -1);
+
+  if (log_file != NULL) {
+    const char *suffix = ".ftrace.folded";
+    folded_file = malloc(strlen(log_file) + strlen(suffix) + 1);
+    assert(folded_file);
+    strcpy(folded_file, log_file);
+    strcat(folded_file, suffix);
+  }
+}
+
+static const char* func_name(vaddr_t func) {
+  static char buf[16];
+  int sym = symbol_find(func);
+  if (sym >= 0) return symbol_name(sym);
+  snprintf(buf, sizeof(buf), "0x%08x", func);
+  return buf;
+}
+
+static void print_path(FILE *fp, int n) {
+  if (node[n].parent >= 0) {
+    print_path(fp, node[n].parent);
+    fputc(';', fp);
+  }
+  fputs(func_name(node[n].func), fp);
+}
+
+typedef struct {
+  vaddr_t func;
+  uint64_t incl, excl, nr_call;
+} FuncStat;
+
+static int func_cmp(const void *a, const void *b) {
+  vaddr_t x = ((const FuncStat *)a)->func, y = ((const FuncStat *)b)->func;
+  return (x < y ? -1 : (x > y));
+}
+
+static int incl_cmp(const void *a, const void *b) {
+  uint64_t x = ((const FuncStat *)a)->incl, y = ((const FuncStat *)b)->incl;
+  return (x > y ? -1 : (x < y));
+}
+
+void ftrace_statistic(void) {
+  if (!ftrace_enable) return;
+  ftrace_process();
+  uint64_t now = cpu_nr_instr();
+  node[cur].self += now - last_icount;
+  last_icount = now;
+
+  // instructions in each subtree
+  uint64_t *total = malloc(sizeof(uint64_t) * nr_node);
+  assert(total);
+  int i, j;
+  for (i = 0; i < nr_node; i ++) total[i] = node[i].self;
+  for (i = nr_node - 1; i > 0; i --) total[node[i].parent] += total[i];
+
+  // merge the contexts of each function
+  FuncStat *f = calloc(nr_node, sizeof(FuncStat));
+  assert(f);
+  for (i = 0; i < nr_node; i ++) f[i].func = node[i].func;
+  qsort(f, nr_node, sizeof(FuncStat), func_cmp);
+  int nr_func = 0;
+  for (i = 0; i < nr_node; i ++) {
+    if (nr_func == 0 || f[nr_func - 1].func != f[i].func) f[nr_func ++].func = f[i].func;
+  }
+  for (i = 0; i < nr_node; i ++) {
+    FuncStat key = { .func = node[i].func };
+    FuncStat *s = bsearch(&key, f, nr_func, sizeof(FuncStat), func_cmp);
+    s->excl += node[i].self;
+    s->nr_call += node[i].nr_call;
+    // a recursive call is already included by the outer one
+    for (j = node[i].parent; j >= 0 && node[j].func != node[i].func; j = node[j].parent);
+    if (j < 0) s->incl += total[i];
+  }
+  qsort(f, nr_func, sizeof(FuncStat), incl_cmp);
+
+  Log("ftrace: %d functions in %d calling contexts, %ld instructions", nr_func, nr_node, total[0]);
+  Log("%10s %10s %10s  %s", "inclusive", "exclusive", "calls", "function");
+  for (i = 0; i < nr_func && i < FTRACE_TOP; i ++) {
+    Log("%10ld %10ld %10ld  %s", f[i].incl, f[i].excl, f[i].nr_call, func_name(f[i].func));
+  }
+
+  if (folded_file != NULL) {
+    FILE *fp = fopen(folded_file, "w");
+    if (fp != NULL) {
+      for (i = 0; i < nr_node; i ++) {
+        if (node[i].self == 0) continue;
+        print_path(fp, i);
+        fprintf(fp, " %ld\n", node[i].self);
+      }
+      fclose(fp);
+      Log("ftrace: collapsed stacks are written to %s", folded_file);
+    }
+  }
+
+  free(f);
+  free(total);
+}
@@ -0,0 +1,53 @@
+#include "nemu.h"
+#include "monitor/itrace.h"
+#include <stdlib.h>
+
+__thread ItraceRecord itrace_ring[ITRACE_SIZE] = {};
+__thread uint64_t itrace_nr = 0;
+
+static char *default_file = NULL;
+
+/* the trace goes next to the log file, or to the current directory */
+void init_itrace(const char *log_file) {
+  const char *suffix = ".itrace";
+  if (log_file == NULL) log_file = "nemu";
+  default_file = malloc(strlen(log_file) + strlen(suffix) + 1);
+  assert(default_file);
+  strcpy(default_file, log_file);
+  strcat(default_file, suffix);
+}
+
+#ifdef DEBUG
+
+void itrace_dump(const char *file) {
+  if (file == NULL) file = default_file;
+  if (file == NULL) return;
+
+  FILE *fp = fopen(file, "wb");
+  if (fp == NULL) {
+    printf("Can not open '%s'\n", file);
+    return;
+  }
+
+  uint32_t nr = (itrace_nr < ITRACE_SIZE ? itrace_nr : ITRACE_SIZE);
+  ItraceHeader h = { .magic = "ITRC", .nr_record = nr, .record_size = sizeof(ItraceRecord) };
+  strncpy(h.isa, str(__ISA__), sizeof(h.isa) - 1);
+  fwrite(&h, sizeof(h), 1, fp);
+
+  // the ring wraps around at the oldest record
+  uint32_t oldest = (itrace_nr - nr) & (ITRACE_SIZE - 1);
+  uint32_t nr_tail = (nr < ITRACE_SIZE - oldest ? nr : ITRACE_SIZE - oldest);
+  fwrite(&itrace_ring[oldest], sizeof(ItraceRecord), nr_tail, fp);
+  fwrite(&itrace_ring[0], sizeof(ItraceRecord), nr - nr_tail, fp);
+  fclose(fp);
+
+  printf("The last %d instructions are written to '%s'\n", nr, file);
+}
+
+#else
+
+void itrace_dump(const char *file) {
+  printf("The instruction trace is only available with DEBUG defined in include/common.h\n");
+}
+
+#endif
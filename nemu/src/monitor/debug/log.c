@@ -1,17 +1,123 @@
 #include "common.h"
+#include "monitor/itrace.h"
 #include <stdarg.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sched.h>
+#include <pthread.h>
+
+/* The log is appended to an in-memory buffer, and a background thread
+ * writes it to the log file in large chunks. A message is copied into
+ * the space reserved by a fetch-and-add on `log_reserve', and becomes
+ * visible to the writer when `log_commit' reaches its end. Producers
+ * commit in the order of reservation.
+ */
+
+#define LOG_BUF_SIZE (1 << 20)  // must be a power of 2
+#define LOG_DRAIN_US 10000
 
 FILE *log_fp = NULL;
+__thread bool log_quiet = false;
+
+static char log_buf[LOG_BUF_SIZE];
+static uint64_t log_reserve = 0;  // bytes reserved by producers
+static uint64_t log_commit = 0;   // bytes completely copied by producers
+static uint64_t log_drain = 0;    // bytes written to the file
+static int log_flush_request = 0;
+static bool log_thread_started = false;
+
+static void log_drain_once(void) {
+  uint64_t commit = __atomic_load_n(&log_commit, __ATOMIC_ACQUIRE);
+  while (log_drain != commit) {
+    uint32_t off = log_drain & (LOG_BUF_SIZE - 1);
+    uint32_t n = commit - log_drain;
+    if (off + n > LOG_BUF_SIZE) n = LOG_BUF_SIZE - off;
+    ssize_t ret = write(fileno(log_fp), log_buf + off, n);
+    if (ret <= 0) { ret = n; }  // the log is lost, but never block the producers
+    __atomic_store_n(&log_drain, log_drain + ret, __ATOMIC_RELEASE);
+  }
+}
+
+static void* log_writer(void *arg) {
+  while (true) {
+    // wait for more messages to batch them, unless someone is waiting
+    uint64_t pending = __atomic_load_n(&log_commit, __ATOMIC_ACQUIRE) - log_drain;
+    if (pending < LOG_BUF_SIZE / 4 && !__atomic_load_n(&log_flush_request, __ATOMIC_ACQUIRE)) {
+      usleep(LOG_DRAIN_US);
+    }
+    log_drain_once();
+  }
+  return NULL;
+}
+
+static void log_append(const char *str, uint32_t len) {
+  if (len > LOG_BUF_SIZE) len = LOG_BUF_SIZE;
+  uint64_t pos = __atomic_fetch_add(&log_reserve, len, __ATOMIC_RELAXED);
+
+  // wait for the writer to make room
+  while (pos + len - __atomic_load_n(&log_drain, __ATOMIC_ACQUIRE) > LOG_BUF_SIZE) {
+    sched_yield();
+  }
+
+  uint32_t off = pos & (LOG_BUF_SIZE - 1);
+  uint32_t n = (off + len > LOG_BUF_SIZE ? LOG_BUF_SIZE - off : len);
+  memcpy(log_buf + off, str, n);
+  memcpy(log_buf, str + n, len - n);
+
+  while (__atomic_load_n(&log_commit, __ATOMIC_ACQUIRE) != pos) {
+    sched_yield();
+  }
+  __atomic_store_n(&log_commit, pos + len, __ATOMIC_RELEASE);
+}
+
+void log_printf(const char *fmt, ...) {
+  char buf[1024];
+  va_list ap;
+  va_start(ap, fmt);
+  int len = vsnprintf(buf, sizeof(buf), fmt, ap);
+  va_end(ap);
+  if (len < 0) return;
+  if (len < sizeof(buf)) {
+    log_append(buf, len);
+    return;
+  }
+
+  char *p = malloc(len + 1);
+  assert(p);
+  va_start(ap, fmt);
+  vsnprintf(p, len + 1, fmt, ap);
+  va_end(ap);
+  log_append(p, len);
+  free(p);
+}
+
+/* return after everything logged so far is in the log file */
+void log_flush(void) {
+  if (!log_thread_started) return;
+  uint64_t commit = __atomic_load_n(&log_commit, __ATOMIC_ACQUIRE);
+  __atomic_fetch_add(&log_flush_request, 1, __ATOMIC_RELEASE);
+  while (__atomic_load_n(&log_drain, __ATOMIC_ACQUIRE) < commit) {
+    usleep(100);
+  }
+  __atomic_fetch_sub(&log_flush_request, 1, __ATOMIC_RELEASE);
+}
 
 void init_log(const char *log_file) {
   if (log_file == NULL) return;
   log_fp = fopen(log_file, "w");
   Assert(log_fp, "Can not open '%s'", log_file);
+
+  pthread_t thread;
+  int ret = pthread_create(&thread, NULL, log_writer, NULL);
+  Assert(ret == 0, "Can not create the log writer");
+  pthread_detach(thread);
+  log_thread_started = true;
+  atexit(log_flush);
 }
 
-char log_bytebuf[80] = {};
-char log_asmbuf[80] = {};
-static char tempbuf[256] = {};
+__thread bool log_asm_enable = false;
+__thread char log_asmbuf[80] = {};
+static __thread char tempbuf[256] = {};
 
 void strcatf(char *buf, const char *fmt, ...) {
   va_list ap;
@@ -21,16 +127,22 @@ void strcatf(char *buf, const char *fmt, ...) {
   strcat(buf, tempbuf);
 }
 
-void asm_print(vaddr_t ori_pc, int instr_len, bool print_flag) {
-  snprintf(tempbuf, sizeof(tempbuf), "%8x:   %s%*.s%s", ori_pc, log_bytebuf,
-      50 - (12 + 3 * instr_len), "", log_asmbuf);
-  log_write("%s\n", tempbuf);
-  if (print_flag) {
-    puts(tempbuf);
+#ifdef DEBUG
+/* print the instruction just executed, whose bytes are
+ * taken from the newest record of the instruction trace */
+void asm_print(void) {
+  ItraceRecord *r = itrace_cur();
+  char bytebuf[3 * ITRACE_MAX_LEN + 1];
+  int i;
+  for (i = 0; i < r->len; i ++) {
+    sprintf(bytebuf + 3 * i, "%02x ", r->bytes[i]);
   }
-}
+  bytebuf[3 * i] = '\0';
 
-void log_clearbuf(void) {
-  log_bytebuf[0] = '\0';
+  snprintf(tempbuf, sizeof(tempbuf), "%8x:   %s%*.s%s", r->pc, bytebuf,
+      50 - (12 + 3 * r->len), "", log_asmbuf);
+  log_write("%s\n", tempbuf);
+  puts(tempbuf);
   log_asmbuf[0] = '\0';
 }
+#endif
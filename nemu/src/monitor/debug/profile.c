@@ -0,0 +1,102 @@
+#include "nemu.h"
+#include "monitor/symbol.h"
+#include "device/event.h"
+#include <stdlib.h>
+
+/* The sampling profiler. Every `period' guest instructions (or at the
+ * same rate of the host time in the wall-clock mode), cpu.pc is counted
+ * in a hash histogram. The samples are resolved to guest functions at
+ * the end.
+ */
+
+#define PROF_HASH_SIZE (1 << 16)
+#define PROF_PROBE 16
+#define PROF_TOP 20
+
+typedef struct {
+  vaddr_t pc;
+  uint32_t count;
+} ProfEntry;
+
+static ProfEntry *hist = NULL;
+static uint64_t nr_sample = 0, nr_lost = 0;
+static char *folded_file = NULL;
+
+static void profile_sample(void) {
+  vaddr_t pc = cpu.pc;
+  uint32_t h = (pc >> 1) * 2654435761u;
+  int i;
+  nr_sample ++;
+  for (i = 0; i < PROF_PROBE; i ++) {
+    ProfEntry *e = &hist[(h + i) & (PROF_HASH_SIZE - 1)];
+    if (e->count == 0) e->pc = pc;
+    if (e->pc == pc) { e->count ++; return; }
+  }
+  nr_lost ++;
+}
+
+void init_profile(int period, const char *log_file) {
+  if (period <= 0) return;
+  hist = calloc(PROF_HASH_SIZE, sizeof(ProfEntry));
+  assert(hist);
+
+  // the collapsed stacks go next to the log file
+  if (log_file != NULL) {
+    const char *suffix = ".folded";
+    folded_file = malloc(strlen(log_file) + strlen(suffix) + 1);
+    assert(folded_file);
+    strcpy(folded_file, log_file);
+    strcat(folded_file, suffix);
+  }
+
+  int hz = EVENT_CLOCK_HZ / period;
+  add_event("profile", (hz > 0 ? hz : 1), profile_sample);
+}
+
+typedef struct {
+  int sym;    // -1 for samples outside any function
+  uint64_t count;
+} ProfFunc;
+
+static int func_cmp(const void *a, const void *b) {
+  uint64_t x = ((const ProfFunc *)a)->count, y = ((const ProfFunc *)b)->count;
+  return (x > y ? -1 : (x < y));
+}
+
+static inline const char* func_name(int sym) {
+  return (sym >= 0 ? symbol_name(sym) : "[unknown]");
+}
+
+void profile_statistic(void) {
+  if (hist == NULL || nr_sample == 0) return;
+
+  // functions are indexed by their symbols, the last one is for unknown pc
+  int nr_func = symbol_count() + 1;
+  ProfFunc *func = calloc(nr_func, sizeof(ProfFunc));
+  assert(func);
+  int i;
+  for (i = 0; i < nr_func; i ++) func[i].sym = (i == nr_func - 1 ? -1 : i);
+  for (i = 0; i < PROF_HASH_SIZE; i ++) {
+    if (hist[i].count == 0) continue;
+    int sym = symbol_find(hist[i].pc);
+    func[sym >= 0 ? sym : nr_func - 1].count += hist[i].count;
+  }
+  qsort(func, nr_func, sizeof(ProfFunc), func_cmp);
+
+  Log("profile: %ld samples, %ld lost in a full hash bucket", nr_sample, nr_lost);
+  for (i = 0; i < nr_func && i < PROF_TOP && func[i].count > 0; i ++) {
+    Log("%6.2f%% %10ld  %s", 100.0 * func[i].count / nr_sample, func[i].count, func_name(func[i].sym));
+  }
+
+  if (folded_file != NULL) {
+    FILE *fp = fopen(folded_file, "w");
+    if (fp != NULL) {
+      for (i = 0; i < nr_func && func[i].count > 0; i ++) {
+        fprintf(fp, "%s %ld\n", func_name(func[i].sym), func[i].count);
+      }
+      fclose(fp);
+      Log("profile: collapsed stacks are written to %s", folded_file);
+    }
+  }
+  free(func);
+}
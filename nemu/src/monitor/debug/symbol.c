@@ -0,0 +1,121 @@
+#include "common.h"
+#include "monitor/symbol.h"
+#include <stdlib.h>
+#include <elf.h>
+
+typedef struct {
+  vaddr_t addr;
+  uint32_t size;
+  char *name;
+} Symbol;
+
+static Symbol *symtab = NULL;
+static int nr_symbol = 0;
+
+static int symbol_cmp(const void *a, const void *b) {
+  vaddr_t x = ((const Symbol *)a)->addr, y = ((const Symbol *)b)->addr;
+  return (x < y ? -1 : (x > y));
+}
+
+static inline bool section_inside(const Elf32_Shdr *sh, long size) {
+  return (uint64_t)sh->sh_offset + sh->sh_size <= size;
+}
+
+static void free_symbol(void) {
+  int i;
+  for (i = 0; i < nr_symbol; i ++) free(symtab[i].name);
+  free(symtab);
+  symtab = NULL;
+  nr_symbol = 0;
+}
+
+void init_symbol(const char *elf_file) {
+  if (elf_file == NULL) return;
+
+  FILE *fp = fopen(elf_file, "rb");
+  if (fp == NULL) {
+    Log("Can not open '%s', guest functions are not symbolized", elf_file);
+    return;
+  }
+  fseek(fp, 0, SEEK_END);
+  long size = ftell(fp);
+  fseek(fp, 0, SEEK_SET);
+  if (size < (long)sizeof(Elf32_Ehdr)) {
+    Log("'%s' is not a 32-bit ELF file", elf_file);
+    fclose(fp);
+    return;
+  }
+  uint8_t *buf = malloc(size);
+  assert(buf);
+  int ret = fread(buf, size, 1, fp);
+  fclose(fp);
+  assert(ret == 1);
+
+  Elf32_Ehdr *eh = (void *)buf;
+  if (memcmp(eh->e_ident, ELFMAG, SELFMAG) != 0 ||
+      eh->e_ident[EI_CLASS] != ELFCLASS32 || eh->e_shoff + eh->e_shnum * sizeof(Elf32_Shdr) > size) {
+    Log("'%s' is not a 32-bit ELF file", elf_file);
+    free(buf);
+    return;
+  }
+
+  Elf32_Shdr *sh = (void *)(buf + eh->e_shoff);
+  int i;
+  for (i = 0; i < eh->e_shnum; i ++) {
+    if (sh[i].sh_type != SHT_SYMTAB || sh[i].sh_link >= eh->e_shnum) continue;
+    const Elf32_Shdr *str = &sh[sh[i].sh_link];
+    // the string table should end with '\0', so that every name ends in it
+    if (!section_inside(&sh[i], size) || !section_inside(str, size) ||
+        str->sh_size == 0 || buf[str->sh_offset + str->sh_size - 1] != '\0') goto bad;
+    Elf32_Sym *sym = (void *)(buf + sh[i].sh_offset);
+    int nr = sh[i].sh_size / sizeof(Elf32_Sym);
+    const char *strtab = (void *)(buf + str->sh_offset);
+    if (nr == 0) continue;
+
+    symtab = realloc(symtab, sizeof(Symbol) * (nr_symbol + nr));
+    assert(symtab);
+    int j;
+    for (j = 0; j < nr; j ++) {
+      if (ELF32_ST_TYPE(sym[j].st_info) != STT_FUNC) continue;
+      if (sym[j].st_name >= str->sh_size) goto bad;
+      symtab[nr_symbol ++] = (Symbol) { .addr = sym[j].st_value, .size = sym[j].st_size,
+        .name = strdup(strtab + sym[j].st_name) };
+    }
+  }
+  free(buf);
+
+  qsort(symtab, nr_symbol, sizeof(Symbol), symbol_cmp);
+  Log("Load %d function symbols from %s", nr_symbol, elf_file);
+  return;
+
+bad:
+  Log("The symbol table of '%s' is malformed, guest functions are not symbolized", elf_file);
+  free_symbol();
+  free(buf);
+}
+
+int symbol_find(vaddr_t addr) {
+  // the last function starting at or before `addr'
+  int l = 0, r = nr_symbol - 1, idx = -1;
+  while (l <= r) {
+    int m = (l + r) / 2;
+    if (symtab[m].addr <= addr) { idx = m; l = m + 1; }
+    else r = m - 1;
+  }
+  if (idx < 0) return -1;
+  // a function without size extends to the next one
+  if (symtab[idx].size != 0 && addr - symtab[idx].addr >= symtab[idx].size) return -1;
+  return idx;
+}
+
+int symbol_count(void) {
+  return nr_symbol;
+}
+
+const char* symbol_name(int idx) {
+  return symtab[idx].name;
+}
+
+vaddr_t symbol_addr(int idx) {
+  return symtab[idx].addr;
+}
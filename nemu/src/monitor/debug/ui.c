@@ -1,6 +1,8 @@
 #include "monitor/monitor.h"
 #include "monitor/expr.h"
 #include "monitor/watchpoint.h"
+#include "monitor/itrace.h"
+#include "monitor/snapshot.h"
 #include "nemu.h"
 
 #include <stdlib.h>
@@ -8,7 +10,6 @@
 #include <readline/history.h>
 
 void cpu_exec(uint64_t);
-extern WP *head;
 
 /* We use the `readline' library to provide more flexibility to read from stdin. */
 static char* rl_gets() {
@@ -58,11 +59,8 @@ static int cmd_info(char *args) {
   if (strcmp(args, "r") == 0) {
     isa_reg_display();
   }
-  if(strcmp(args, "w") == 0){
-    printf("%-6s%-20s%-10s\n","Num", "Experssion", "Result");
-    for(WP* tmp = NULL;tmp;tmp = tmp->next){
-      printf("%-6d%-20s%-6d\n", tmp->NO, tmp->expr, tmp->value);
-    }
+  else if(strcmp(args, "w") == 0){
+    wp_display();
   }
   else {
     printf("Unknown argument '%s'\n", args);
@@ -118,16 +116,9 @@ static int cmd_w(char *args) {
     printf("No argument given\n");
     return 0;
   }
-  bool success = true;
-  uint32_t result = expr(args, &success);
-  if (success) {
-    WP *wp = new_wp();
-    strcpy(wp->expr, args);
-    wp->value = result;
-    printf("Watchpoint %d: %s\n", wp->NO, wp->expr);
-  }
-  else {
-    printf("Invalid expression\n");
+  int NO = wp_add(args);
+  if (NO >= 0) {
+    printf("Watchpoint %d: %s\n", NO, args);
   }
   return 0;
 }
@@ -139,12 +130,35 @@ static int cmd_d(char *args) {
     return 0;
   }
   int n = atoi(args);
-  for(WP* tmp = NULL; tmp; tmp = tmp->next){
-    if(tmp->NO == n){
-      free_wp(tmp);
-      return 0;
-    }
+  if (!wp_delete(n)) {
+    printf("No watchpoint number %d\n", n);
+  }
+  return 0;
+}
+
+// Dump the instruction trace
+static int cmd_itrace(char *args) {
+  itrace_dump(args);
+  return 0;
+}
+
+// Save the machine to a snapshot
+static int cmd_save(char *args) {
+  if (args == NULL) {
+    printf("No argument given\n");
+    return 0;
+  }
+  snapshot_save(args);
+  return 0;
+}
+
+// Restore the machine from a snapshot
+static int cmd_load(char *args) {
+  if (args == NULL) {
+    printf("No argument given\n");
+    return 0;
   }
+  snapshot_load(args);
   return 0;
 }
 
@@ -164,6 +178,9 @@ static struct {
   { "p", "Evaluate expression", cmd_p },
   { "w", "Set watchpoint", cmd_w },
   { "d", "Delete watchpoint", cmd_d },
+  { "itrace", "Dump the recent instructions to a file", cmd_itrace },
+  { "save", "Save the machine to a snapshot", cmd_save },
+  { "load", "Restore the machine from a snapshot", cmd_load },
 };
 
 #define NR_CMD (sizeof(cmd_table) / sizeof(cmd_table[0]))
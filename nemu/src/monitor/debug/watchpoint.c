@@ -1,11 +1,23 @@
+#include "nemu.h"
+#include "monitor/monitor.h"
 #include "monitor/watchpoint.h"
 #include "monitor/expr.h"
+#include "cpu/hart.h"
+#include <stdlib.h>
+#include <pthread.h>
 
 #define NR_WP 32
 
+/* Shared by the harts, and only changed by the monitor while they are
+ * parked. A machine in a pool has no monitor, and no watchpoints. */
 static WP wp_pool[NR_WP] = {};
 static WP *head = NULL, *free_ = NULL;
 
+int wp_nr_mem = 0;
+
+// the harts may write the same watched memory at once
+static pthread_mutex_t wp_lock = PTHREAD_MUTEX_INITIALIZER;
+
 void init_wp_pool() {
   int i;
   for (i = 0; i < NR_WP; i ++) {
@@ -18,11 +30,9 @@ void init_wp_pool() {
   free_ = wp_pool;
 }
 
-/* TODO: Implement the functionality of watchpoint */
-WP* new_wp(){
+static WP* new_wp(){
   if(free_==NULL){
-    printf("No more watchpoints!\n");
-    assert(0);
+    return NULL;
   }
   WP* new=free_;
   free_=free_->next;
@@ -31,11 +41,7 @@ WP* new_wp(){
   return new;
 }
 
-void free_wp(WP* wp){
-  if(wp==NULL){
-    printf("No such watchpoint!\n");
-    assert(0);
-  }
+static void free_wp(WP* wp){
   if(wp==head){
     head=head->next;
   }
@@ -50,4 +56,93 @@ void free_wp(WP* wp){
   free_=wp;
 }
 
+/* Return the number of the new watchpoint, or -1 on failure. */
+int wp_add(char *e) {
+  ExprCode code;
+  bool success;
+  if (!expr_compile(e, &code)) {
+    printf("Invalid expression\n");
+    return -1;
+  }
+  uint32_t value = expr_eval(&code, &success);
+  if (!success) {
+    printf("Invalid expression\n");
+    return -1;
+  }
 
+  WP *wp = new_wp();
+  if (wp == NULL) {
+    printf("No more watchpoints!\n");
+    return -1;
+  }
+  wp->expr = strdup(e);
+  wp->code = code;
+  wp->value = value;
+  wp->is_mem = (code.nr_op == 1 && code.op[0].type == EXPR_MEM);
+  wp->addr = code.op[0].imm;
+  if (wp->is_mem) wp_nr_mem ++;
+  return wp->NO;
+}
+
+bool wp_delete(int NO) {
+  WP *wp;
+  for (wp = head; wp != NULL; wp = wp->next) {
+    if (wp->NO == NO) {
+      if (wp->is_mem) wp_nr_mem --;
+      free(wp->expr);
+      free_wp(wp);
+      return true;
+    }
+  }
+  return false;
+}
+
+void wp_display(void) {
+  WP *wp;
+  printf("%-6s%-20s%-10s\n", "Num", "Expression", "Value");
+  for (wp = head; wp != NULL; wp = wp->next) {
+    printf("%-6d%-20s0x%08x%s\n", wp->NO, wp->expr, wp->value, (wp->is_mem ? "  (memory)" : ""));
+  }
+}
+
+static bool wp_update(WP *wp) {
+  bool success;
+  uint32_t value = expr_eval(&wp->code, &success);
+  if (!success || value == wp->value) return false;
+  printf("Watchpoint %d: %s\n\nOld value = 0x%08x\nNew value = 0x%08x\n",
+      wp->NO, wp->expr, wp->value, value);
+  wp->value = value;
+  return true;
+}
+
+/* Check the watchpoints on expressions after an instruction.
+ * Return whether any of them has changed. They are evaluated on
+ * hart 0 only. */
+bool wp_check(void) {
+  if (hart_id != 0) return false;
+  bool hit = false;
+  WP *wp;
+  for (wp = head; wp != NULL; wp = wp->next) {
+    if (!wp->is_mem && wp_update(wp)) hit = true;
+  }
+  return hit;
+}
+
+void wp_check_write(paddr_t addr, int len) {
+  bool hit = false;
+  WP *wp;
+  pthread_mutex_lock(&wp_lock);
+  for (wp = head; wp != NULL; wp = wp->next) {
+    if (wp->is_mem && addr < wp->addr + 4 && wp->addr < addr + len && wp_update(wp)) hit = true;
+  }
+  pthread_mutex_unlock(&wp_lock);
+  if (hit && nemu_state.state == NEMU_RUNNING) {
+    // stop after the current instruction
+    nemu_state.state = NEMU_STOP;
+    if (hart_id != 0) hart_request_stop();
+#ifdef BLOCK_CACHE
+    void block_break(void);
+    block_break();
+#endif
+  }
+}
@@ -2,19 +2,78 @@
 
 #include "nemu.h"
 #include "monitor/monitor.h"
+#include "monitor/snapshot.h"
+#include "memory/tlb.h"
+#include "cpu/decode.h"
+#include "isa/diff-test.h"
+#include "device/event.h"
+#include <stdlib.h>
 
 void (*ref_difftest_memcpy_from_dut)(paddr_t dest, void *src, size_t n) = NULL;
+void (*ref_difftest_memcpy_to_dut)(paddr_t src, void *dest, size_t n) = NULL;
 void (*ref_difftest_getregs)(void *c) = NULL;
 void (*ref_difftest_setregs)(const void *c) = NULL;
 void (*ref_difftest_exec)(uint64_t n) = NULL;
+int (*ref_difftest_memcmp_pages)(const paddr_t *addr, const uint64_t *sum, int n) = NULL;
 
 static bool is_skip_ref = false;
 static int skip_dut_nr_instr = 0;
 static bool is_detach = false;
 
+/* REF and DUT run `interval' instructions, or a basic block if it is 0,
+ * before they are compared. The registers are compared, and so are the
+ * pages written by DUT, by their checksums or by copying them out of
+ * REF, if REF can do either. With the block engine, a run of blocks
+ * stops after `interval' instructions, or after a block if it is 0, and
+ * an interval of 1 runs the blocks one instruction at a time.
+ * A checkpoint of DUT is kept at the last check, with a copy of pmem,
+ * whose pages written since then are found by their dirty bits. When
+ * REF and DUT disagree, both are rolled back to it, and the first
+ * instruction they disagree on is bisected. Memory written only by REF
+ * is not found.
+ */
+
+#define NR_PAGE (PMEM_SIZE / PAGE_SIZE)
+#define MAX_PENDING 1024   // instructions in a basic block at most
+
+static int interval = 1;
+static uint8_t *shadow = NULL;     // pmem at the checkpoint
+static CPU_state ckpt_cpu;         // the registers at the checkpoint
+static CPU_state last_cpu;         // the registers before the current instruction
+static uint64_t nr_pending = 0;    // instructions run by DUT since the checkpoint
+
+vaddr_t exec_once(void);
+paddr_t host_paddr(const uint8_t *host);
+uint8_t* paddr_host(paddr_t addr);
+static bool catch_up(bool check_mem);
+
+#ifdef BLOCK_CACHE
+void block_break(void);
+uint64_t cpu_nr_instr(void);
+
+/* The block engine runs many instructions before difftest_block() is
+ * called. It is stopped after an instruction REF can not run, and
+ * REF catches up with DUT before it, as saved here. */
+static void block_skip(void) {
+  if (is_detach || is_skip_ref || skip_dut_nr_instr > 0) return;
+  isa_difftest_regs_out();
+  last_cpu = cpu;
+  block_break();
+}
+#endif
+
+#ifdef DECODE_CACHE
+void dcache_flush_all(void);
+#else
+#define dcache_flush_all()
+#endif
+
 // this is used to let ref skip instructions which
 // can not produce consistent behavior with NEMU
 void difftest_skip_ref() {
+#ifdef BLOCK_CACHE
+  block_skip();
+#endif
   is_skip_ref = true;
   // If such an instruction is one of the instruction packing in QEMU
   // (see below), we end the process of catching up with QEMU's pc to
@@ -33,6 +92,19 @@ void difftest_skip_ref() {
 //   Let REF run `nr_ref` instructions first.
 //   We expect that DUT will catch up with REF within `nr_dut` instructions.
 void difftest_skip_dut(int nr_ref, int nr_dut) {
+#ifdef BLOCK_CACHE
+  if (interval != 1 && skip_dut_nr_instr == 0) {
+    // REF has not run the instructions of the current run before this
+    // one. After it, DUT runs one instruction at a time until it
+    // catches up with REF.
+    nr_pending += cpu_nr_instr() - g_nr_guest_instr;
+    block_skip();
+  }
+#endif
+
+  // the registers of DUT may be partly written here
+  if (interval != 1 && !catch_up(false)) return;
+  nr_pending = 0;
   skip_dut_nr_instr += nr_dut;
 
   while (nr_ref -- > 0) {
@@ -42,8 +114,154 @@ void difftest_skip_dut(int nr_ref, int nr_dut) {
 
 bool isa_difftest_checkregs(CPU_state *ref_r, vaddr_t pc);
 void isa_difftest_attach(void);
+void isa_reg_display(void);
+
+static inline bool page_is_zero(const uint8_t *p) {
+  const uint64_t *q = (const uint64_t *)p;
+  int i;
+  for (i = 0; i < PAGE_SIZE / sizeof(uint64_t); i ++) {
+    if (q[i] != 0) return false;
+  }
+  return true;
+}
+
+/* Take a checkpoint of DUT, which REF agrees with. */
+static void checkpoint(void) {
+  int i;
+  for (i = 0; i < NR_PAGE; i ++) {
+    if (snapshot_dirty[i] & DIRTY_DIFFTEST) {
+      memcpy(shadow + i * PAGE_SIZE, pmem + i * PAGE_SIZE, PAGE_SIZE);
+      snapshot_dirty[i] &= ~DIRTY_DIFFTEST;
+    }
+  }
+  isa_difftest_regs_out();
+  ckpt_cpu = last_cpu = cpu;
+  nr_pending = 0;
+}
+
+/* Roll REF and DUT back to the checkpoint. */
+static void rollback(void) {
+  int i;
+  for (i = 0; i < NR_PAGE; i ++) {
+    if (snapshot_dirty[i] & DIRTY_DIFFTEST) {
+      memcpy(pmem + i * PAGE_SIZE, shadow + i * PAGE_SIZE, PAGE_SIZE);
+      ref_difftest_memcpy_from_dut(host_paddr(pmem + i * PAGE_SIZE), shadow + i * PAGE_SIZE, PAGE_SIZE);
+      snapshot_dirty[i] &= ~DIRTY_DIFFTEST;
+    }
+  }
+  cpu = last_cpu = ckpt_cpu;
+  isa_difftest_regs_in();
+  ref_difftest_setregs(&ckpt_cpu);
+  nr_pending = 0;
+
+  tlb_flush();
+  dcache_flush_all();
+}
+
+/* Return whether REF agrees with the DUT state in `dut'. */
+static bool check(CPU_state *dut, vaddr_t pc, bool check_mem) {
+  CPU_state ref_r, cur = cpu;
+  ref_difftest_getregs(&ref_r);
+  // isa_difftest_checkregs() compares with `cpu'
+  cpu = *dut;
+  isa_difftest_regs_out();
+  bool ok = isa_difftest_checkregs(&ref_r, pc);
+  cpu = cur;
+  if (!ok || !check_mem || (ref_difftest_memcpy_to_dut == NULL && ref_difftest_memcmp_pages == NULL)) return ok;
+
+  static paddr_t addr[NR_PAGE];
+  static uint64_t sum[NR_PAGE];
+  int n = 0, i, j;
+  for (i = 0; i < NR_PAGE; i ++) {
+    if (!(snapshot_dirty[i] & DIRTY_DIFFTEST)) continue;
+    addr[n] = host_paddr(pmem + i * PAGE_SIZE);
+    if (ref_difftest_memcmp_pages != NULL) sum[n] = page_sum(pmem + i * PAGE_SIZE);
+    n ++;
+  }
+
+  // let REF find the page which differs, and copy it out to find the byte
+  int first = 0;
+  if (ref_difftest_memcmp_pages != NULL) {
+    first = ref_difftest_memcmp_pages(addr, sum, n);
+    if (first < 0) return true;
+    if (ref_difftest_memcpy_to_dut == NULL) {
+      Log("memory in the page at 0x%08x differs", addr[first]);
+      return false;
+    }
+    n = first + 1;
+  }
+
+  static uint8_t buf[PAGE_SIZE];
+  for (i = first; i < n; i ++) {
+    uint8_t *page = paddr_host(addr[i]);
+    ref_difftest_memcpy_to_dut(addr[i], buf, PAGE_SIZE);
+    if (memcmp(buf, page, PAGE_SIZE) != 0) {
+      for (j = 0; buf[j] == page[j]; j ++);
+      Log("memory at 0x%08x differs, REF = 0x%02x, DUT = 0x%02x", addr[i] + j, buf[j], page[j]);
+      return false;
+    }
+  }
+  return true;
+}
+
+/* REF and DUT disagree after the `nr_pending' instructions since the
+ * checkpoint. Both are run again from it to find the first instruction
+ * they disagree on, moving the checkpoint forward while they agree. */
+static void bisect(void) {
+  uint64_t lo = 0, hi = nr_pending;
+  Log("REF and DUT disagree within %ld instructions, bisecting", hi);
+  while (hi - lo > 1) {
+    uint64_t mid = lo + (hi - lo) / 2, n;
+    rollback();
+    for (n = lo; n < mid; n ++) exec_once();
+    ref_difftest_exec(mid - lo);
+    if (check(&cpu, cpu.pc, true)) {
+      checkpoint();
+      lo = mid;
+    }
+    else hi = mid;
+  }
+
+  rollback();
+  vaddr_t pc = cpu.pc;
+  exec_once();
+  ref_difftest_exec(1);
+  if (check(&cpu, pc, true)) {
+    // REF does not run the same way on the second time
+    Log("can not reproduce the disagreement at pc = 0x%08x", pc);
+  }
+  Log("the first instruction REF and DUT disagree on is at pc = 0x%08x", pc);
+  isa_reg_display();
+  nemu_state.state = NEMU_ABORT;
+  nemu_state.halt_pc = pc;
+}
+
+/* Run REF to catch up with DUT before the current instruction. */
+static bool catch_up(bool check_mem) {
+  if (nr_pending == 0) return true;
+  ref_difftest_exec(nr_pending);
+  if (check(&last_cpu, last_cpu.pc, check_mem)) return true;
+  bisect();
+  return false;
+}
+
+void difftest_sync(void) {
+#ifndef DIFF_TEST
+  return;
+#endif
+
+  ref_difftest_memcpy_from_dut(PC_START - IMAGE_START, guest_to_host(0), PMEM_SIZE);
+  isa_difftest_regs_out();
+  ref_difftest_setregs(&cpu);
 
-void init_difftest(char *ref_so_file, long img_size) {
+  if (interval != 1) {
+    int i;
+    for (i = 0; i < NR_PAGE; i ++) snapshot_dirty[i] |= DIRTY_DIFFTEST;
+    checkpoint();
+  }
+}
+
+void init_difftest(char *ref_so_file, long img_size, int check_interval) {
 #ifndef DIFF_TEST
   return;
 #endif
@@ -66,6 +284,10 @@ void init_difftest(char *ref_so_file, long img_size) {
   ref_difftest_exec = dlsym(handle, "difftest_exec");
   assert(ref_difftest_exec);
 
+  // optional, for comparing the memory
+  ref_difftest_memcpy_to_dut = dlsym(handle, "difftest_memcpy_to_dut");
+  ref_difftest_memcmp_pages = dlsym(handle, "difftest_memcmp_pages");
+
   void (*ref_difftest_init)(void) = dlsym(handle, "difftest_init");
   assert(ref_difftest_init);
 
@@ -78,10 +300,28 @@ void init_difftest(char *ref_so_file, long img_size) {
   ref_difftest_memcpy_from_dut(PC_START, guest_to_host(IMAGE_START), img_size);
   char *mainargs = guest_to_host(0);
   ref_difftest_memcpy_from_dut(PC_START - IMAGE_START, mainargs, strlen(mainargs) + 1);
+  isa_difftest_regs_out();
   ref_difftest_setregs(&cpu);
+
+  interval = check_interval;
+  if (interval != 1) {
+    if (interval == 0) Log("REF and DUT are compared after each basic block");
+    else Log("REF and DUT are compared every %d instructions", interval);
+    if (ref_difftest_memcpy_to_dut == NULL && ref_difftest_memcmp_pages == NULL) Log("%s can not copy its memory out, only the registers are compared", ref_so_file);
+
+    // the pages REF has got from DUT above
+    shadow = calloc(PMEM_SIZE, 1);
+    assert(shadow);
+    int i;
+    for (i = 0; i < NR_PAGE; i ++) {
+      if (!page_is_zero(pmem + i * PAGE_SIZE)) memcpy(shadow + i * PAGE_SIZE, pmem + i * PAGE_SIZE, PAGE_SIZE);
+    }
+    checkpoint();
+  }
 }
 
 static void checkregs(CPU_state *ref, vaddr_t pc) {
+  isa_difftest_regs_out();
   if (!isa_difftest_checkregs(ref, pc)) {
     extern void isa_reg_display(void);
     isa_reg_display();
@@ -90,37 +330,107 @@ static void checkregs(CPU_state *ref, vaddr_t pc) {
   }
 }
 
+/* DUT runs until its pc is that of REF after difftest_skip_dut(). */
+static void skip_dut_step(vaddr_t ori_pc, vaddr_t next_pc) {
+  CPU_state ref_r;
+  ref_difftest_getregs(&ref_r);
+  if (ref_r.pc == next_pc) {
+    checkregs(&ref_r, next_pc);
+    skip_dut_nr_instr = 0;
+    if (interval != 1) checkpoint();
+    return;
+  }
+  skip_dut_nr_instr --;
+  if (skip_dut_nr_instr == 0)
+    panic("can not catch up with ref.pc = %x at pc = %x", ref_r.pc, ori_pc);
+}
+
 void difftest_step(vaddr_t ori_pc, vaddr_t next_pc) {
   CPU_state ref_r;
 
   if (is_detach) return;
 
   if (skip_dut_nr_instr > 0) {
-    ref_difftest_getregs(&ref_r);
-    if (ref_r.pc == next_pc) {
-      checkregs(&ref_r, next_pc);
-      skip_dut_nr_instr = 0;
-      return;
-    }
-    skip_dut_nr_instr --;
-    if (skip_dut_nr_instr == 0)
-      panic("can not catch up with ref.pc = %x at pc = %x", ref_r.pc, ori_pc);
+    skip_dut_step(ori_pc, next_pc);
     return;
   }
 
   if (is_skip_ref) {
+    is_skip_ref = false;
+    if (interval != 1 && !catch_up(true)) return;
     // to skip the checking of an instruction, just copy the reg state to reference design
+    isa_difftest_regs_out();
     ref_difftest_setregs(&cpu);
+    if (interval != 1) checkpoint();
+    return;
+  }
+
+  if (interval == 1) {
+    ref_difftest_exec(1);
+    ref_difftest_getregs(&ref_r);
+
+    checkregs(&ref_r, ori_pc);
+    return;
+  }
+
+  nr_pending ++;
+  bool block_end = (next_pc != decinfo.seq_pc || nr_pending == MAX_PENDING);
+  if (interval == 0 ? !block_end : nr_pending < interval) {
+    last_cpu = cpu;
+    return;
+  }
+
+  ref_difftest_exec(nr_pending);
+  if (check(&cpu, next_pc, true)) checkpoint();
+  else bisect();
+}
+
+#ifdef BLOCK_CACHE
+/* Check after `n' instructions run by the block engine from `ori_pc'. */
+void difftest_block(vaddr_t ori_pc, uint64_t n) {
+  if (is_detach || n == 0) return;
+  if (interval == 1) {
+    // a single instruction is run
+    difftest_step(ori_pc, cpu.pc);
+    return;
+  }
+
+  if (skip_dut_nr_instr > 0) {
+    // REF has run the instructions before the last one
+    skip_dut_step(cpu.pc, cpu.pc);
+    return;
+  }
+
+  if (is_skip_ref) {
+    // the last instruction is not run by REF
+    nr_pending += n - 1;
+    if (!catch_up(true)) return;
     is_skip_ref = false;
+    isa_difftest_regs_out();
+    ref_difftest_setregs(&cpu);
+    checkpoint();
     return;
   }
 
-  ref_difftest_exec(1);
-  ref_difftest_getregs(&ref_r);
+  nr_pending += n;
+  ref_difftest_exec(nr_pending);
+  if (check(&cpu, cpu.pc, true)) checkpoint();
+  else bisect();
+}
 
-  checkregs(&ref_r, ori_pc);
+/* the number of instructions the block engine runs before a check */
+uint64_t difftest_block_budget(void) {
+  if (is_detach) return -1;
+  if (skip_dut_nr_instr > 0) return 1;
+  return (interval == 0 ? MAX_PENDING : interval);
 }
 
+/* whether the block engine stops after each block */
+bool difftest_block_once(void) {
+  return !is_detach && interval == 0;
+}
+#endif
+
 void difftest_detach() {
   is_detach = true;
 }
@@ -135,4 +445,5 @@ void difftest_attach() {
   skip_dut_nr_instr = 0;
 
   isa_difftest_attach();
+  if (interval != 1) checkpoint();
 }
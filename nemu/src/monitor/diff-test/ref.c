@@ -1,27 +1,60 @@
 #include "nemu.h"
 #include "monitor/diff-test.h"
 #include "isa/diff-test.h"
+#include "cpu/decode-cache.h"
+#include "monitor/machine.h"
 
 void cpu_exec(uint64_t);
+void raise_intr(uint32_t NO, vaddr_t epc);
+
+uint8_t* paddr_host(paddr_t addr);
 
 void difftest_memcpy_from_dut(paddr_t dest, void *src, size_t n) {
-  memcpy(guest_to_host(dest), src, n);
+  memcpy(paddr_host(dest), src, n);
+  dcache_flush_all();
+}
+
+void difftest_memcpy_to_dut(paddr_t src, void *dest, size_t n) {
+  memcpy(dest, paddr_host(src), n);
 }
 
 void difftest_getregs(void *r) {
+  isa_difftest_regs_out();
   memcpy(r, &cpu, DIFFTEST_REG_SIZE);
 }
 
 void difftest_setregs(const void *r) {
   memcpy(&cpu, r, DIFFTEST_REG_SIZE);
+  isa_difftest_regs_in();
 }
 
 void difftest_exec(uint64_t n) {
   cpu_exec(n);
 }
 
+/* Compare the pages at `addr' with their checksums in DUT. Return the
+ * index of the first page which differs, or -1 if all of them agree. */
+int difftest_memcmp_pages(const paddr_t *addr, const uint64_t *sum, int n) {
+  int i;
+  for (i = 0; i < n; i ++) {
+    if (page_sum(paddr_host(addr[i])) != sum[i]) return i;
+  }
+  return -1;
+}
+
+/* DUT has taken the interrupt `NO' before the instruction at pc */
+void difftest_raise_intr(uint32_t NO) {
+  raise_intr(NO, cpu.pc);
+}
+
 void difftest_init(void) {
   /* Perform ISA dependent initialization. */
   void init_isa();
+  void init_cache_state(void);
+  void init_bpred_state(void);
+  init_machine_context();
+  init_mem();
   init_isa();
+  init_cache_state();
+  init_bpred_state();
 }
@@ -0,0 +1,24 @@
+#include "monitor/machine.h"
+
+#include <sys/mman.h>
+
+__thread MachineContext *mctx = NULL;
+
+/* Each thread running a machine or a hart has a context of its own. */
+void init_machine_context(void) {
+  mctx = mmap(NULL, sizeof(MachineContext), PROT_READ | PROT_WRITE,
+      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  Assert(mctx != MAP_FAILED, "Can not allocate the context of the machine");
+#ifdef DECODE_CACHE
+  dcache_code_map = mctx->dcache_code_map;
+#endif
+}
+
+void free_machine_context(void) {
+  free_mmio_table();
+  munmap(mctx, sizeof(MachineContext));
+  mctx = NULL;
+#ifdef DECODE_CACHE
+  dcache_code_map = NULL;
+#endif
+}
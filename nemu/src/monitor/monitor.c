@@ -1,19 +1,44 @@
 #include "nemu.h"
 #include "monitor/monitor.h"
+#include "monitor/machine.h"
 #include <unistd.h>
+#include <stdlib.h>
 
 void init_log(const char *log_file);
+void init_itrace(const char *log_file);
 void init_isa();
-void init_regex();
 void init_wp_pool();
 void init_device();
-void init_difftest(char *ref_so_file, long img_size);
+void init_difftest(char *ref_so_file, long img_size, int check_interval);
+void init_jit(bool enable);
+void init_event(bool is_wall_clock);
+void init_symbol(const char *elf_file);
+void init_profile(int period, const char *log_file);
+void init_ftrace(bool enable, const char *log_file);
+void init_cache(const char *spec);
+void init_bpred(const char *name);
+void init_snapshot(const char *file);
+void init_hart(int n, bool jit);
+int run_pool(char *img_files[], int nr_img, int nr_thread, const char *mainargs, bool jit);
 
 static char *mainargs = "";
 static char *log_file = NULL;
 static char *diff_so_file = NULL;
 static char *img_file = NULL;
+static char *elf_file = NULL;
+static char *cache_spec = NULL;
+static char *bpred_name = NULL;
+static char *snapshot_file = NULL;
+static int diff_interval = 1;
 static int is_batch_mode = false;
+static int is_jit_mode = false;
+static int is_wall_clock = false;
+static int profile_period = 0;
+static int is_ftrace_mode = false;
+static int pool_size = 0;
+static int nr_hart = 1;
+static char **img_files = NULL;
+static int nr_img = 0;
 
 static inline void welcome() {
 #ifdef DEBUG
@@ -58,24 +83,45 @@ static inline long load_img() {
 
     // mainargs
     strcpy(guest_to_host(0), mainargs);
+
+    // nexus-am puts the ELF file next to the image
+    int len = strlen(img_file);
+    if (elf_file == NULL && len > 4 && strcmp(img_file + len - 4, ".bin") == 0) {
+      elf_file = strdup(img_file);
+      strcpy(elf_file + len - 4, ".elf");
+    }
   }
   return size;
 }
 
 static inline void parse_args(int argc, char *argv[]) {
   int o;
-  while ( (o = getopt(argc, argv, "-bl:d:a:")) != -1) {
+  img_files = malloc(argc * sizeof(char *));
+  assert(img_files);
+  while ( (o = getopt(argc, argv, "-bjwfl:d:D:a:e:p:c:B:r:P:H:")) != -1) {
     switch (o) {
       case 'b': is_batch_mode = true; break;
+      case 'j': is_jit_mode = true; break;
+      case 'w': is_wall_clock = true; break;
+      case 'f': is_ftrace_mode = true; break;
       case 'a': mainargs = optarg; break;
       case 'l': log_file = optarg; break;
       case 'd': diff_so_file = optarg; break;
+      case 'D': diff_interval = atoi(optarg); break;
+      case 'e': elf_file = optarg; break;
+      case 'p': profile_period = atoi(optarg); break;
+      case 'c': cache_spec = optarg; break;
+      case 'B': bpred_name = optarg; break;
+      case 'r': snapshot_file = optarg; break;
+      case 'P': pool_size = atoi(optarg); break;
+      case 'H': nr_hart = atoi(optarg); break;
       case 1:
-                if (img_file != NULL) Log("too much argument '%s', ignored", optarg);
-                else img_file = optarg;
+                img_files[nr_img ++] = optarg;
+                if (img_file == NULL) img_file = optarg;
+                else if (pool_size == 0) Log("too much argument '%s', ignored", optarg);
                 break;
       default:
-                panic("Usage: %s [-b] [-l log_file] [img_file]", argv[0]);
+                panic("Usage: %s [-b] [-j] [-w] [-f] [-l log_file] [-D interval] [-e elf_file] [-p period] [-c cache_spec] [-B predictor] [-r snapshot] [-P threads img_file...] [-H harts] [img_file]", argv[0]);
     }
   }
 }
@@ -86,26 +132,62 @@ int init_monitor(int argc, char *argv[]) {
   /* Parse arguments. */
   parse_args(argc, argv);
 
+  /* Run each image in a machine of its own, on a pool of threads. */
+  Assert(pool_size == 0 || nr_hart == 1, "The machines in a pool have a single hart");
+  if (pool_size > 0) {
+    // the models of caches and branch predictors are configured for all machines
+    init_cache(cache_spec);
+    init_bpred(bpred_name);
+    exit(run_pool(img_files, nr_img, pool_size, mainargs, is_jit_mode) != 0);
+  }
+
   /* Open the log file. */
   init_log(log_file);
+  init_itrace(log_file);
 
   /* Load the image to memory. */
+  init_machine_context();
+  init_mem();
   long img_size = load_img();
 
   /* Perform ISA dependent initialization. */
   init_isa();
 
-  /* Compile the regular expressions. */
-  init_regex();
+  /* Initialize the models of caches and branch predictors. The other
+   * harts set up their own with the same configuration. */
+  init_cache(cache_spec);
+  init_bpred(bpred_name);
 
   /* Initialize the watchpoint pool. */
   init_wp_pool();
 
+  /* Initialize the timing of devices. */
+  init_event(is_wall_clock);
+
   /* Initialize devices. */
   init_device();
 
+  /* Load the symbols of the guest program, and start profiling. */
+  init_symbol(elf_file);
+  init_profile(profile_period, log_file);
+  init_ftrace(is_ftrace_mode, log_file);
+
   /* Initialize differential testing. */
-  init_difftest(diff_so_file, img_size);
+  init_difftest(diff_so_file, img_size, diff_interval);
+
+  /* Initialize the JIT. Compiled code does not call the helpers
+   * reporting calls and returns, so it is not used with ftrace. */
+  init_jit(is_jit_mode && !is_ftrace_mode);
+
+  /* Initialize the harts other than the current one, which are
+   * started by the guest. */
+#ifdef DIFF_TEST
+  Assert(nr_hart == 1, "Differential testing checks a single hart");
+#endif
+  init_hart(nr_hart, is_jit_mode && !is_ftrace_mode);
+
+  /* Restore the machine from a snapshot. */
+  init_snapshot(snapshot_file);
 
   /* Display welcome message. */
   welcome();
@@ -0,0 +1,165 @@
+#include "nemu.h"
+#include "monitor/monitor.h"
+#include "monitor/machine.h"
+#include "device/event.h"
+#include <stdlib.h>
+#include <setjmp.h>
+#include <time.h>
+#include <pthread.h>
+#include <semaphore.h>
+
+/* Run many images in one process. The state of the CPU, the memory and
+ * the devices is thread-local, or reached through the thread-local `mctx',
+ * so each host thread runs a machine of its own. Every image is run by a
+ * new thread, which starts with a clean machine, and at most `nr_thread'
+ * of them run at a time. A failed assertion only ends the machine
+ * hitting it, which is reported as failed.
+ */
+
+void cpu_exec(uint64_t);
+void init_isa();
+void init_event(bool is_wall_clock);
+void init_device_headless();
+void init_jit(bool enable);
+void free_jit(void);
+void free_block_pool(void);
+void init_cache_state(void);
+void free_cache_state(void);
+void init_bpred_state(void);
+void free_bpred_state(void);
+
+typedef struct {
+  const char *img_file;
+  bool loaded;
+  NEMUState state;
+  uint64_t nr_instr;
+  double time;
+} Machine;
+
+static const char *pool_mainargs = "";
+static bool pool_jit = false;
+static sem_t nr_idle;
+static int nr_fail = 0;
+
+static inline double host_time() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+static bool load_img(const char *img_file) {
+  FILE *fp = fopen(img_file, "rb");
+  if (fp == NULL) return false;
+  fseek(fp, 0, SEEK_END);
+  long size = ftell(fp);
+  fseek(fp, 0, SEEK_SET);
+  bool ok = (size > 0 && size <= PMEM_SIZE - IMAGE_START && fread(guest_to_host(IMAGE_START), size, 1, fp) == 1);
+  fclose(fp);
+  return ok;
+}
+
+/* set while a machine of the pool runs on this thread */
+static __thread jmp_buf *fatal_jmp = NULL;
+
+void assert_fail(const char *cond, const char *file, int line, const char *func) {
+  log_flush();
+  fflush(stdout);
+  fprintf(stderr, "%s:%d: %s: Assertion `%s' failed.\n", file, line, func, cond);
+  // the other machines of the pool keep running
+  if (fatal_jmp != NULL) longjmp(*fatal_jmp, 1);
+  abort();
+}
+
+static bool report(Machine *m) {
+  if (!m->loaded) {
+    printf("[ LOAD FAIL ] %s\n", m->img_file);
+    return false;
+  }
+  bool pass = (m->state.state == NEMU_END && m->state.halt_ret == 0);
+  printf("[ %s ] %s, %ld instructions in %.3f s\n", (pass ? "PASS" : "FAIL"),
+      m->img_file, m->nr_instr, m->time);
+  return pass;
+}
+
+static void* machine_thread(void *arg) {
+  Machine *m = arg;
+  log_quiet = true;
+
+  init_machine_context();
+  init_mem();
+  m->loaded = load_img(m->img_file);
+  if (m->loaded) {
+    jmp_buf buf;
+    fatal_jmp = &buf;
+    if (setjmp(buf) == 0) {
+      strcpy(guest_to_host(0), pool_mainargs);
+      init_isa();
+      init_event(false);
+      init_device_headless();
+      init_jit(pool_jit);
+      init_cache_state();
+      init_bpred_state();
+
+      m->time = host_time();
+      cpu_exec(-1);
+      m->time = host_time() - m->time;
+    }
+    else {
+      // a failed assertion, the image is reported as failed
+      nemu_state = (NEMUState) { .state = NEMU_ABORT, .halt_pc = cpu.pc };
+      if (m->time != 0) m->time = host_time() - m->time;
+    }
+    fatal_jmp = NULL;
+    m->state = nemu_state;
+    m->nr_instr = g_nr_guest_instr;
+    free_jit();
+    free_block_pool();
+    free_cache_state();
+    free_bpred_state();
+  }
+  free_mem();
+  free_machine_context();
+
+  if (!report(m)) __atomic_add_fetch(&nr_fail, 1, __ATOMIC_RELAXED);
+  sem_post(&nr_idle);
+  return NULL;
+}
+
+/* Return the number of images which do not hit the good trap. */
+int run_pool(char *img_files[], int nr_img, int nr_thread, const char *mainargs, bool jit) {
+#ifdef DIFF_TEST
+  panic("Differential testing checks a single machine, it can not run a pool");
+#endif
+  pool_mainargs = mainargs;
+  pool_jit = jit;
+
+  Machine *machines = calloc(nr_img, sizeof(Machine));
+  assert(machines);
+  sem_init(&nr_idle, 0, nr_thread);
+
+  pthread_attr_t attr;
+  pthread_attr_init(&attr);
+  pthread_attr_setstacksize(&attr, MACHINE_STACK_SIZE);
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+
+  double start = host_time();
+  int i;
+  for (i = 0; i < nr_img; i ++) {
+    sem_wait(&nr_idle);
+    machines[i].img_file = img_files[i];
+    pthread_t t;
+    int ret = pthread_create(&t, &attr, machine_thread, &machines[i]);
+    Assert(ret == 0, "Can not create a thread for '%s'", img_files[i]);
+  }
+  // wait for the last machines
+  for (i = 0; i < nr_thread; i ++) sem_wait(&nr_idle);
+  double time = host_time() - start;
+
+  printf("%d images on %d threads in %.3f s, %.1f images/s, %d failed\n",
+      nr_img, nr_thread, time, nr_img / time, nr_fail);
+
+  pthread_attr_destroy(&attr);
+  sem_destroy(&nr_idle);
+  free(machines);
+  return nr_fail;
+}
@@ -0,0 +1,350 @@
+#include "nemu.h"
+#include "monitor/monitor.h"
+#include "monitor/snapshot.h"
+#include "monitor/diff-test.h"
+#include "memory/tlb.h"
+#include "cpu/decode-cache.h"
+#include "cpu/hart.h"
+#include "device/perfcnt.h"
+#include "device/event.h"
+#include <stdlib.h>
+#include <limits.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define NR_PAGE (PMEM_SIZE / PAGE_SIZE)
+#define NR_SECTION 64
+#define NR_HOOK 8
+
+/* A snapshot file is the header, the sections, the page list, and the
+ * data of the pages in the order of the list, from a page boundary.
+ * A full snapshot lists the non-zero pages. An incremental one lists
+ * the pages written since its parent, marking those now all zero. */
+
+#define PAGE_ZERO 0x80000000u
+
+typedef struct {
+  char magic[8];        // "NEMUSNAP"
+  char isa[12];
+  uint32_t nr_section;
+  uint32_t nr_page;     // entries in the page list
+  uint32_t nr_data;     // pages stored
+  uint64_t id;
+  uint64_t parent_id;   // 0 for a full snapshot
+  char parent[PATH_MAX];
+} SnapshotHeader;
+
+typedef struct {
+  char name[32];
+  uint64_t size;
+} SectionHeader;
+
+typedef struct {
+  const char *name;
+  void *p;
+  size_t size;
+} Section;
+
+__thread uint8_t snapshot_dirty[NR_PAGE] = {};
+
+static __thread Section sections[NR_SECTION];
+static __thread int nr_section = 0;
+static __thread void (*hooks[NR_HOOK])(void);
+static __thread int nr_hook = 0;
+
+// the last snapshot saved or loaded, which the next one refers to
+static __thread char last_file[PATH_MAX] = "";
+static __thread uint64_t last_id = 0;
+
+void snapshot_add(const char *name, void *p, size_t size) {
+  assert(nr_section < NR_SECTION);
+  sections[nr_section ++] = (Section) { .name = name, .p = p, .size = size };
+}
+
+void snapshot_add_hook(void (*hook)(void)) {
+  assert(nr_hook < NR_HOOK);
+  hooks[nr_hook ++] = hook;
+}
+
+static inline bool page_is_zero(const uint8_t *p) {
+  const uint64_t *q = (const uint64_t *)p;
+  int i;
+  for (i = 0; i < PAGE_SIZE / sizeof(uint64_t); i ++) {
+    if (q[i] != 0) return false;
+  }
+  return true;
+}
+
+static inline uint64_t new_id() {
+  struct timespec now;
+  clock_gettime(CLOCK_REALTIME, &now);
+  return now.tv_sec * 1000000000ull + now.tv_nsec;
+}
+
+static inline long page_align(long off) {
+  return (off + PAGE_MASK) & ~(long)PAGE_MASK;
+}
+
+/* Pages written from now on go to the snapshot after `file'. */
+static void set_last(const char *file, uint64_t id) {
+  if (realpath(file, last_file) == NULL) strcpy(last_file, file);
+  last_id = id;
+  int i;
+  for (i = 0; i < NR_PAGE; i ++) snapshot_dirty[i] &= ~DIRTY_SNAPSHOT;
+}
+
+bool snapshot_save(const char *file) {
+  if (hart_started()) {
+    printf("A snapshot only holds hart 0, the other harts have started\n");
+    return false;
+  }
+
+  // an incremental snapshot can not replace its parent
+  bool full = (last_id == 0);
+  if (!full) {
+    char *path = realpath(file, NULL);
+    if (path != NULL) {
+      full = (strcmp(path, last_file) == 0);
+      free(path);
+    }
+  }
+
+  SnapshotHeader *h = calloc(1, sizeof(SnapshotHeader));
+  uint32_t *list = malloc(NR_PAGE * sizeof(uint32_t));
+  assert(h && list);
+  memcpy(h->magic, "NEMUSNAP", sizeof(h->magic));
+  strncpy(h->isa, str(__ISA__), sizeof(h->isa) - 1);
+  h->nr_section = nr_section;
+  h->id = new_id();
+  if (!full) {
+    h->parent_id = last_id;
+    strcpy(h->parent, last_file);
+  }
+
+  int i;
+  for (i = 0; i < NR_PAGE; i ++) {
+    if (!full && !(snapshot_dirty[i] & DIRTY_SNAPSHOT)) continue;
+    bool zero = page_is_zero(pmem + i * PAGE_SIZE);
+    if (zero && full) continue;
+    list[h->nr_page ++] = i | (zero ? PAGE_ZERO : 0);
+    if (!zero) h->nr_data ++;
+  }
+
+  // write to another file first, since the old one may be mapped into pmem
+  char tmp[PATH_MAX + 8];
+  snprintf(tmp, sizeof(tmp), "%s.tmp", file);
+  FILE *fp = fopen(tmp, "wb");
+  bool ok = (fp != NULL);
+  if (ok) {
+    fwrite(h, sizeof(*h), 1, fp);
+    for (i = 0; i < nr_section; i ++) {
+      SectionHeader sh = { .size = sections[i].size };
+      strncpy(sh.name, sections[i].name, sizeof(sh.name) - 1);
+      fwrite(&sh, sizeof(sh), 1, fp);
+      fwrite(sections[i].p, sections[i].size, 1, fp);
+    }
+    fwrite(list, sizeof(list[0]), h->nr_page, fp);
+    fseek(fp, page_align(ftell(fp)), SEEK_SET);
+    for (i = 0; i < h->nr_page; i ++) {
+      if (!(list[i] & PAGE_ZERO)) fwrite(pmem + list[i] * PAGE_SIZE, PAGE_SIZE, 1, fp);
+    }
+    ok = !ferror(fp);
+    ok = (fclose(fp) == 0) && ok;
+    ok = ok && rename(tmp, file) == 0;
+  }
+
+  if (ok) {
+    set_last(file, h->id);
+    printf("Saved %s snapshot to '%s', with %d pages\n",
+        (full ? "a full" : "an incremental"), file, h->nr_data);
+  }
+  else {
+    printf("Can not write '%s'\n", file);
+    remove(tmp);
+  }
+  free(list);
+  free(h);
+  return ok;
+}
+
+static bool check_header(int fd, SnapshotHeader *h, const char *file, uint64_t id) {
+  if (pread(fd, h, sizeof(*h), 0) != sizeof(*h) || memcmp(h->magic, "NEMUSNAP", sizeof(h->magic)) != 0) {
+    printf("'%s' is not a snapshot\n", file);
+    return false;
+  }
+  if (strncmp(h->isa, str(__ISA__), sizeof(h->isa)) != 0) {
+    printf("'%s' is a snapshot of %.12s\n", file, h->isa);
+    return false;
+  }
+  if (id != 0 && h->id != id) {
+    printf("'%s' has changed since a snapshot referring to it was saved\n", file);
+    return false;
+  }
+  return true;
+}
+
+/* Check the sections of the snapshot to load against those added. */
+static bool check_sections(int fd, SnapshotHeader *h, const char *file) {
+  if (h->nr_section != nr_section) {
+    printf("'%s' is saved by a different NEMU\n", file);
+    return false;
+  }
+  long off = sizeof(*h);
+  int i;
+  for (i = 0; i < nr_section; i ++) {
+    SectionHeader sh;
+    if (pread(fd, &sh, sizeof(sh), off) != sizeof(sh) ||
+        strncmp(sh.name, sections[i].name, sizeof(sh.name)) != 0 || sh.size != sections[i].size) {
+      printf("'%s' is saved by a different NEMU\n", file);
+      return false;
+    }
+    off += sizeof(sh) + sh.size;
+  }
+  return true;
+}
+
+/* Read the page list of `file', and set `*off' to the data of the
+ * pages. Return NULL if the list or the data is out of the file or of
+ * pmem, so that nothing is loaded from a truncated or corrupt file. */
+static uint32_t* read_page_list(int fd, SnapshotHeader *h, const char *file, long *off) {
+  struct stat st;
+  if (fstat(fd, &st) != 0 || h->nr_page > NR_PAGE || h->nr_data > h->nr_page) goto bad;
+
+  // skip the sections
+  *off = sizeof(*h);
+  int i;
+  for (i = 0; i < h->nr_section; i ++) {
+    SectionHeader sh;
+    if (pread(fd, &sh, sizeof(sh), *off) != sizeof(sh) || sh.size > st.st_size) goto bad;
+    *off += sizeof(sh) + sh.size;
+  }
+
+  uint32_t *list = malloc(h->nr_page * sizeof(uint32_t) + 1);
+  assert(list);
+  size_t size = h->nr_page * sizeof(uint32_t);
+  if (pread(fd, list, size, *off) != size) { free(list); goto bad; }
+  *off = page_align(*off + size);
+
+  uint32_t nr_data = 0;
+  for (i = 0; i < h->nr_page; i ++) {
+    bool zero = (list[i] & PAGE_ZERO) != 0;
+    // a full snapshot only lists the pages stored
+    if ((list[i] & ~PAGE_ZERO) >= NR_PAGE || (zero && h->parent_id == 0)) break;
+    if (!zero) nr_data ++;
+  }
+  if (i < h->nr_page || nr_data != h->nr_data ||
+      *off + (long)nr_data * PAGE_SIZE > st.st_size) { free(list); goto bad; }
+  return list;
+
+bad:
+  printf("'%s' is truncated or corrupt\n", file);
+  return NULL;
+}
+
+/* Load the pages of `file' on those of its parents. Nothing is
+ * changed if the file or one of its parents can not be loaded. */
+static bool load_pages(const char *file, uint64_t id, SnapshotHeader *h) {
+  int fd = open(file, O_RDONLY);
+  if (fd < 0) {
+    printf("Can not open '%s'\n", file);
+    return false;
+  }
+  long off = 0;
+  uint32_t *list = NULL;
+  bool ok = check_header(fd, h, file, id) && (list = read_page_list(fd, h, file, &off)) != NULL;
+  if (ok && h->parent_id != 0) {
+    SnapshotHeader *parent = malloc(sizeof(SnapshotHeader));
+    assert(parent);
+    ok = load_pages(h->parent, h->parent_id, parent);
+    free(parent);
+  }
+  if (!ok) {
+    free(list);
+    close(fd);
+    return false;
+  }
+
+  int i;
+  if (h->parent_id == 0) {
+    // map the runs of consecutive pages, the others are zero
+    void *p = mmap(pmem, PMEM_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0);
+    Assert(p != MAP_FAILED, "Can not map pmem");
+    int j;
+    for (i = 0; i < h->nr_page; i = j) {
+      for (j = i + 1; j < h->nr_page && list[j] == list[j - 1] + 1; j ++);
+      p = mmap(pmem + list[i] * PAGE_SIZE, (j - i) * PAGE_SIZE, PROT_READ | PROT_WRITE,
+          MAP_PRIVATE | MAP_FIXED, fd, off + (long)i * PAGE_SIZE);
+      Assert(p != MAP_FAILED, "Can not map '%s'", file);
+    }
+  }
+  else {
+    for (i = 0; i < h->nr_page; i ++) {
+      uint8_t *page = pmem + (list[i] & ~PAGE_ZERO) * PAGE_SIZE;
+      if (list[i] & PAGE_ZERO) memset(page, 0, PAGE_SIZE);
+      else {
+        Assert(pread(fd, page, PAGE_SIZE, off) == PAGE_SIZE, "Can not read '%s'", file);
+        off += PAGE_SIZE;
+      }
+    }
+  }
+
+  free(list);
+  close(fd);
+  return true;
+}
+
+bool snapshot_load(const char *file) {
+  if (hart_started()) {
+    printf("A snapshot only holds hart 0, the other harts have started\n");
+    return false;
+  }
+
+  SnapshotHeader *h = malloc(sizeof(SnapshotHeader));
+  assert(h);
+  int fd = open(file, O_RDONLY);
+  if (fd < 0) {
+    printf("Can not open '%s'\n", file);
+    free(h);
+    return false;
+  }
+  if (!check_header(fd, h, file, 0) || !check_sections(fd, h, file) || !load_pages(file, 0, h)) {
+    close(fd);
+    free(h);
+    return false;
+  }
+
+  long off = sizeof(*h);
+  int i;
+  for (i = 0; i < nr_section; i ++) {
+    off += sizeof(SectionHeader);
+    Assert(pread(fd, sections[i].p, sections[i].size, off) == sections[i].size, "Can not read '%s'", file);
+    off += sections[i].size;
+  }
+  close(fd);
+
+  for (i = 0; i < nr_hook; i ++) hooks[i]();
+
+  // everything cached from the old state is invalid
+  tlb_flush();
+  dcache_flush_all();
+  event_next = 0;
+  nemu_state.state = NEMU_STOP;
+
+  difftest_sync();
+
+  set_last(file, h->id);
+  Log("Loaded the snapshot '%s' at pc = 0x%08x", file, cpu.pc);
+  free(h);
+  return true;
+}
+
+void init_snapshot(const char *file) {
+  snapshot_add("cpu", &cpu, sizeof(cpu));
+  snapshot_add("instr", &g_nr_guest_instr, sizeof(g_nr_guest_instr));
+  snapshot_add("perfcnt", &perfcnt, sizeof(perfcnt));
+
+  if (file != NULL && !snapshot_load(file)) panic("Can not load the snapshot '%s'", file);
+}
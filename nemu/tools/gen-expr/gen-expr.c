@@ -4,66 +4,334 @@
 #include <time.h>
 #include <assert.h>
 #include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdbool.h>
 
-// this should be enough
-static char buf[65536];
+/* Usage: gen-expr [-s seed] [-b | -c [-j threads]] [n]
+ *
+ * By default, each expression is compiled and run with gcc to get its
+ * result, with its numbers made unsigned. With -b, results come from the
+ * reference evaluator below, which follows C on uint32_t like expr() of
+ * NEMU: 32-bit wrap-around, and unsigned division.
+ * With -c, no expression is printed. Each one is checked against the
+ * expr() of NEMU in this process, and a mismatch is shrunk before it
+ * is reported. Case i is generated from seed + i, so any case can be
+ * reproduced alone with `-s seed+i 1'.
+ */
 
-int mindex;
-int totalOp;
-static inline int choose(unsigned int i){
-  return rand()%i;
+#define MAX_OP 32
+#define MAX_EXPR_LEN 4096
+#define MAX_REPORT 10
+
+typedef struct {
+  char buf[MAX_EXPR_LEN];
+  int len;
+  int nr_op;
+  uint32_t rng;
+} Gen;
+
+static inline uint32_t choose(Gen *g, uint32_t n) {
+  g->rng ^= g->rng << 13; g->rng ^= g->rng >> 17; g->rng ^= g->rng << 5;
+  return g->rng % n;
 }
-static inline void gen_num(){
-  int num = choose(65536);
-  sprintf(buf+mindex, "%d", num);
+
+static inline void gen_str(Gen *g, const char *s) {
+  int n = strlen(s);
+  memcpy(g->buf + g->len, s, n + 1);
+  g->len += n;
+}
+
+static inline void gen_space(Gen *g) {
+  if (choose(g, 8) == 0) gen_str(g, " ");
 }
-static inline void gen_rand_op(){
-  switch(choose(4)){
-    case 0:
-      buf[mindex] = '+';
+
+static void gen_rand_expr(Gen *g) {
+  int choice = choose(g, 3);
+  if (MAX_OP - g->nr_op < 3) {
+    choice = 0;
+  }
+  switch (choice) {
+    case 0: {
+      char num[16];
+      sprintf(num, "%u", choose(g, 65536));
+      gen_str(g, num);
+      g->nr_op ++;
       break;
+    }
     case 1:
-      buf[mindex] = '-';
+      g->nr_op += 2;
+      gen_str(g, "(");
+      gen_rand_expr(g);
+      gen_str(g, ")");
       break;
-    case 2:
-      buf[mindex] = '*';
-      break;
-    case 3:
-      buf[mindex] = '/';
+    default: {
+      static const char *ops[] = { "+", "-", "*", "/" };
+      g->nr_op += 2;
+      gen_rand_expr(g);
+      gen_space(g);
+      gen_str(g, ops[choose(g, 4)]);
+      gen_space(g);
+      gen_rand_expr(g);
       break;
+    }
   }
-  mindex++;
 }
-static inline void gen_rand_expr() {
-  int choice = choose(3);
-  if(32 - totalOp < 3){
-    choice = 0;
+
+static void gen_case(Gen *g, uint32_t seed) {
+  g->len = 0;
+  g->nr_op = 0;
+  g->buf[0] = '\0';
+  g->rng = seed * 2654435761u + 1;  // never 0
+  gen_rand_expr(g);
+}
+
+/* The reference evaluator, a recursive descent parser. It also builds
+ * the tree of the expression, which keeps the parentheses, so that
+ * printing the tree gives the input back.
+ */
+
+enum { N_NUM, N_PAREN, N_BIN };
+
+typedef struct RefNode {
+  int type;
+  char op;
+  uint32_t val;
+  struct RefNode *l, *r;
+} RefNode;
+
+#define NR_REF_NODE 512
+
+typedef struct {
+  const char *p;
+  RefNode pool[NR_REF_NODE];
+  int nr_node;
+  int ok;
+} Ref;
+
+static RefNode* ref_node(Ref *ref, int type, char op, uint32_t val, RefNode *l, RefNode *r) {
+  if (ref->nr_node == NR_REF_NODE) { ref->ok = 0; return NULL; }
+  RefNode *n = &ref->pool[ref->nr_node ++];
+  n->type = type; n->op = op; n->val = val; n->l = l; n->r = r;
+  return n;
+}
+
+static inline void ref_skip(Ref *ref) {
+  while (*ref->p == ' ') ref->p ++;
+}
+
+static RefNode* ref_expr(Ref *ref);
+
+static RefNode* ref_factor(Ref *ref) {
+  ref_skip(ref);
+  if (*ref->p == '(') {
+    ref->p ++;
+    RefNode *e = ref_expr(ref);
+    ref_skip(ref);
+    if (*ref->p != ')') { ref->ok = 0; return NULL; }
+    ref->p ++;
+    return (ref->ok ? ref_node(ref, N_PAREN, 0, e->val, e, NULL) : NULL);
   }
-  switch(choice){
-    case 0:
-      gen_num();
-      while(buf[mindex]){
-        mindex++;
-      }
-      totalOp++;
-      break;
-    case 1:
-      totalOp += 2;
-      buf[mindex] = '('; mindex++;
-      gen_rand_expr();
-      buf[mindex] = ')'; mindex++;
-      buf[mindex] = 0;
-      break;
+  if (*ref->p < '0' || *ref->p > '9') { ref->ok = 0; return NULL; }
+  uint32_t val = 0;
+  while (*ref->p >= '0' && *ref->p <= '9') val = val * 10 + (*ref->p ++ - '0');
+  return ref_node(ref, N_NUM, 0, val, NULL, NULL);
+}
+
+static inline uint32_t ref_calc(Ref *ref, char op, uint32_t a, uint32_t b) {
+  switch (op) {
+    case '+': return a + b;
+    case '-': return a - b;
+    case '*': return a * b;
     default:
-      totalOp += 2;
-      gen_rand_expr();
-      gen_rand_op();
-      gen_rand_expr();
+      if (b == 0) { ref->ok = 0; return 0; }
+      return a / b;
+  }
+}
+
+static RefNode* ref_binary(Ref *ref, int level) {
+  RefNode *l = (level == 0 ? ref_binary(ref, 1) : ref_factor(ref));
+  while (ref->ok) {
+    ref_skip(ref);
+    char op = *ref->p;
+    if (level == 0 ? (op != '+' && op != '-') : (op != '*' && op != '/')) break;
+    ref->p ++;
+    RefNode *r = (level == 0 ? ref_binary(ref, 1) : ref_factor(ref));
+    if (!ref->ok) break;
+    l = ref_node(ref, N_BIN, op, ref_calc(ref, op, l->val, r->val), l, r);
+  }
+  return l;
+}
+
+static RefNode* ref_expr(Ref *ref) {
+  return ref_binary(ref, 0);
+}
+
+// return the tree of `e', or NULL if it can not be evaluated
+static RefNode* ref_eval(Ref *ref, const char *e) {
+  ref->p = e;
+  ref->nr_node = 0;
+  ref->ok = 1;
+  RefNode *root = ref_expr(ref);
+  ref_skip(ref);
+  return (ref->ok && *ref->p == '\0' ? root : NULL);
+}
+
+/* The checker */
+
+#ifdef NEMU_EXPR
+uint32_t expr(char *, bool *);
+
+/* expr() only needs these for registers and memory, which are
+ * never generated */
+uint32_t* isa_reg_str2ptr(const char *s) { return NULL; }
+uint8_t* paddr_host(uint32_t addr) { return NULL; }
+uint32_t paddr_read(uint32_t addr, int len) { return 0; }
+
+// assert() of NEMU reports through this, see include/debug.h
+void assert_fail(const char *cond, const char *file, int line, const char *func) {
+  fprintf(stderr, "%s:%d: %s: Assertion `%s' failed.\n", file, line, func, cond);
+  abort();
+}
+
+// return whether NEMU gives the same result as the reference
+static int check(Ref *ref, char *e) {
+  RefNode *root = ref_eval(ref, e);
+  if (root == NULL) return 1;  // e.g. divided by 0
+  bool success;
+  uint32_t result = expr(e, &success);
+  return success && result == root->val;
+}
+
+static void print_tree(char *s, int *len, RefNode *n, RefNode *skip, RefNode *with) {
+  if (n == skip) n = with;
+  switch (n->type) {
+    case N_NUM: *len += sprintf(s + *len, "%u", n->val); break;
+    case N_PAREN:
+      s[(*len) ++] = '(';
+      print_tree(s, len, n->l, skip, with);
+      s[(*len) ++] = ')';
       break;
+    default:
+      print_tree(s, len, n->l, skip, with);
+      s[(*len) ++] = n->op;
+      print_tree(s, len, n->r, skip, with);
+  }
+  s[*len] = '\0';
+}
+
+/* Replace a subtree with one of its children, or a number with a
+ * smaller one, as long as NEMU still disagrees with the reference. */
+static void shrink(Ref *ref, char *e) {
+  static const uint32_t small[] = { 0, 1, 2 };
+  char cand[MAX_EXPR_LEN];
+  int progress = 1;
+  while (progress) {
+    progress = 0;
+    RefNode *root = ref_eval(ref, e);
+    if (root == NULL) return;
+    int nr_node = ref->nr_node, i, k;
+    for (i = 0; i < nr_node && !progress; i ++) {
+      RefNode *n = &ref->pool[i];
+      RefNode with[3];
+      int nr_with = 0;
+      if (n->type == N_NUM) {
+        for (k = 0; k < 3; k ++) {
+          if (small[k] < n->val) with[nr_with ++] = (RefNode) { .type = N_NUM, .val = small[k] };
+        }
+      }
+      else {
+        with[nr_with ++] = *n->l;
+        if (n->r != NULL) with[nr_with ++] = *n->r;
+      }
+      for (k = 0; k < nr_with && !progress; k ++) {
+        int len = 0;
+        print_tree(cand, &len, root, n, &with[k]);
+        // the reference tree is rebuilt when the candidate is checked
+        Ref *tmp = malloc(sizeof(Ref));
+        assert(tmp);
+        if (ref_eval(tmp, cand) != NULL && !check(tmp, cand)) {
+          strcpy(e, cand);
+          progress = 1;
+        }
+        free(tmp);
+      }
+    }
+  }
+}
+
+typedef struct {
+  pthread_t thread;
+  int id;
+  uint32_t seed;
+  long n, nr_thread;
+  long nr_checked, nr_skipped, nr_mismatch;
+} Worker;
+
+static pthread_mutex_t report_lock = PTHREAD_MUTEX_INITIALIZER;
+static int nr_report = 0;
+
+static void* worker_main(void *arg) {
+  Worker *w = arg;
+  Gen *g = malloc(sizeof(Gen));
+  Ref *ref = malloc(sizeof(Ref));
+  assert(g && ref);
+  long i;
+  for (i = w->id; i < w->n; i += w->nr_thread) {
+    gen_case(g, w->seed + i);
+    if (ref_eval(ref, g->buf) == NULL) { w->nr_skipped ++; continue; }
+    w->nr_checked ++;
+    if (check(ref, g->buf)) continue;
+
+    w->nr_mismatch ++;
+    char e[MAX_EXPR_LEN];
+    strcpy(e, g->buf);
+    shrink(ref, e);
+    RefNode *root = ref_eval(ref, e);
+    bool success;
+    uint32_t result = expr(e, &success);
+    pthread_mutex_lock(&report_lock);
+    if (nr_report ++ < MAX_REPORT) {
+      printf("mismatch at case %ld (-s %u 1): %s\n", i, w->seed + (uint32_t)i, g->buf);
+      printf("  shrunk to: %s\n", e);
+      printf("  reference = %u, nemu = %u%s\n", root->val, result, (success ? "" : " (failed)"));
+    }
+    pthread_mutex_unlock(&report_lock);
+  }
+  free(g);
+  free(ref);
+  return NULL;
+}
+
+static int run_check(uint32_t seed, long n, int nr_thread) {
+  Worker *w = calloc(nr_thread, sizeof(Worker));
+  assert(w);
+  struct timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  int i;
+  for (i = 0; i < nr_thread; i ++) {
+    w[i] = (Worker) { .id = i, .seed = seed, .n = n, .nr_thread = nr_thread };
+    pthread_create(&w[i].thread, NULL, worker_main, &w[i]);
+  }
+  long checked = 0, skipped = 0, mismatch = 0;
+  for (i = 0; i < nr_thread; i ++) {
+    pthread_join(w[i].thread, NULL);
+    checked += w[i].nr_checked;
+    skipped += w[i].nr_skipped;
+    mismatch += w[i].nr_mismatch;
   }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  double sec = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+  printf("seed %u: %ld checked, %ld skipped (divided by 0), %ld mismatched, "
+      "%d threads, %.2f s, %.0f cases/s\n",
+      seed, checked, skipped, mismatch, nr_thread, sec, (checked + skipped) / sec);
+  free(w);
+  return mismatch != 0;
 }
+#endif
 
-static char code_buf[65536];
+static char code_buf[MAX_EXPR_LEN * 2 + 256];
+static char expr_buf[MAX_EXPR_LEN * 2];
 static char *code_format =
 "#include <stdio.h>\n"
 "int main() { "
@@ -72,18 +340,60 @@ static char *code_format =
 "  return 0; "
 "}";
 
+// `e' with a `u' after each number, so that gcc divides as unsigned
+static char* unsigned_expr(const char *e) {
+  char *p = expr_buf;
+  for (; *e != '\0'; e ++) {
+    *p ++ = *e;
+    if (*e >= '0' && *e <= '9' && !(e[1] >= '0' && e[1] <= '9')) *p ++ = 'u';
+  }
+  *p = '\0';
+  return expr_buf;
+}
+
 int main(int argc, char *argv[]) {
-  int seed = time(0);
-  srand(seed);
-  int loop = 1;
-  if (argc > 1) {
-    sscanf(argv[1], "%d", &loop);
+  uint32_t seed = time(0);
+  int batch = 0, check_mode = 0, nr_thread = sysconf(_SC_NPROCESSORS_ONLN);
+  int o;
+  while ((o = getopt(argc, argv, "s:bcj:")) != -1) {
+    switch (o) {
+      case 's': seed = strtoul(optarg, NULL, 0); break;
+      case 'b': batch = 1; break;
+      case 'c': check_mode = 1; break;
+      case 'j': nr_thread = atoi(optarg); break;
+      default:
+        fprintf(stderr, "Usage: %s [-s seed] [-b | -c [-j threads]] [n]\n", argv[0]);
+        return 1;
+    }
   }
-  int i;
+  long loop = 1;
+  if (optind < argc) {
+    sscanf(argv[optind], "%ld", &loop);
+  }
+
+  if (check_mode) {
+#ifdef NEMU_EXPR
+    return run_check(seed, loop, (nr_thread > 0 ? nr_thread : 1));
+#else
+    fprintf(stderr, "built without expr() of NEMU\n");
+    return 1;
+#endif
+  }
+
+  Gen *g = malloc(sizeof(Gen));
+  Ref *ref = malloc(sizeof(Ref));
+  assert(g && ref);
+  long i;
   for (i = 0; i < loop; i ++) {
-    gen_rand_expr();
+    gen_case(g, seed + i);
+
+    if (batch) {
+      RefNode *root = ref_eval(ref, g->buf);
+      if (root != NULL) printf("%u %s\n", root->val, g->buf);
+      continue;
+    }
 
-    sprintf(code_buf, code_format, buf);
+    sprintf(code_buf, code_format, unsigned_expr(g->buf));
 
     FILE *fp = fopen("/tmp/.code.c", "w");
     assert(fp != NULL);
@@ -96,11 +406,14 @@ int main(int argc, char *argv[]) {
     fp = popen("/tmp/.expr", "r");
     assert(fp != NULL);
 
-    int result;
-    fscanf(fp, "%d", &result);
+    unsigned result;
+    ret = fscanf(fp, "%u", &result);
     pclose(fp);
+    if (ret != 1) continue;
 
-    printf("%u %s\n", result, buf);
+    printf("%u %s\n", result, g->buf);
   }
+  free(g);
+  free(ref);
   return 0;
 }
@@ -0,0 +1,171 @@
+/* Render an instruction trace dumped by NEMU into disassembly.
+ *
+ *   itrace [-n N] FILE
+ *
+ * The bytes of all records are disassembled by a single run of objdump.
+ * Every record holds exactly one instruction, so a linear sweep over the
+ * bytes put back to back stays on the instruction boundaries. Set OBJDUMP
+ * to use another objdump, e.g. a cross one for riscv32 and mips32. Note
+ * that the targets of pc-relative jumps are not adjusted.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <assert.h>
+
+// keep these consistent with include/monitor/itrace.h
+#define ITRACE_MAX_LEN 15
+
+typedef struct {
+  uint32_t pc;
+  uint8_t len;
+  uint8_t bytes[ITRACE_MAX_LEN];
+} ItraceRecord;
+
+typedef struct {
+  char magic[4];
+  char isa[12];
+  uint32_t nr_record;
+  uint32_t record_size;
+} ItraceHeader;
+
+static struct {
+  const char *isa;
+  const char *objdump;
+  const char *options;
+} isa_table [] = {
+  { "x86", "objdump", "-m i386" },
+  { "riscv32", "riscv64-linux-gnu-objdump", "-m riscv:rv32" },
+  { "mips32", "mips-linux-gnu-objdump", "-m mips:isa32 -EL" },
+};
+
+#define NR_ISA (sizeof(isa_table) / sizeof(isa_table[0]))
+
+static ItraceRecord *rec;
+static uint32_t nr_rec;
+// the offset of each record among the bytes put back to back
+static uint32_t *offset;
+static char **asm_str;
+
+static void print_bytes(ItraceRecord *r) {
+  int i;
+  for (i = 0; i < r->len; i ++) printf("%02x ", r->bytes[i]);
+  printf("%*s", 50 - (12 + 3 * r->len), "");
+}
+
+/* find the record at `off', by binary search since offsets ascend */
+static int find_record(uint32_t off) {
+  int l = 0, r = nr_rec - 1;
+  while (l <= r) {
+    int m = (l + r) / 2;
+    if (offset[m] == off) return m;
+    if (offset[m] < off) l = m + 1;
+    else r = m - 1;
+  }
+  return -1;
+}
+
+/* fill asm_str[] with the disassembly of each record */
+static void disassemble(const char *isa) {
+  int i;
+  for (i = 0; i < NR_ISA; i ++) {
+    if (strcmp(isa, isa_table[i].isa) == 0) break;
+  }
+  if (i == NR_ISA) {
+    fprintf(stderr, "unknown ISA '%s'\n", isa);
+    return;
+  }
+
+  const char *objdump = getenv("OBJDUMP");
+  if (objdump == NULL) objdump = isa_table[i].objdump;
+
+  char tmp[] = "/tmp/itrace-XXXXXX";
+  int fd = mkstemp(tmp);
+  assert(fd >= 0);
+  FILE *fp = fdopen(fd, "wb");
+  uint32_t k;
+  for (k = 0; k < nr_rec; k ++) fwrite(rec[k].bytes, rec[k].len, 1, fp);
+  fclose(fp);
+
+  char cmd[512];
+  snprintf(cmd, sizeof(cmd), "%s -D -b binary %s %s 2> /dev/null",
+      objdump, isa_table[i].options, tmp);
+  fp = popen(cmd, "r");
+  assert(fp);
+
+  char line[512];
+  while (fgets(line, sizeof(line), fp) != NULL) {
+    // the format is "  offset:\tbytes\tassembly"
+    unsigned off;
+    char *bytes = strchr(line, '\t');
+    char *s = (bytes ? strchr(bytes + 1, '\t') : NULL);
+    if (s == NULL || sscanf(line, " %x:", &off) != 1) continue;
+
+    int idx = find_record(off);
+    if (idx < 0) continue;
+    s[strcspn(s, "\n")] = '\0';
+    asm_str[idx] = strdup(s + 1);
+  }
+  pclose(fp);
+  unlink(tmp);
+}
+
+int main(int argc, char *argv[]) {
+  int o;
+  long n = -1;
+  while ((o = getopt(argc, argv, "n:")) != -1) {
+    switch (o) {
+      case 'n': n = atol(optarg); break;
+      default:
+        fprintf(stderr, "Usage: %s [-n N] FILE\n", argv[0]);
+        return 1;
+    }
+  }
+  if (optind >= argc) {
+    fprintf(stderr, "Usage: %s [-n N] FILE\n", argv[0]);
+    return 1;
+  }
+
+  FILE *fp = fopen(argv[optind], "rb");
+  if (fp == NULL) { perror(argv[optind]); return 1; }
+
+  ItraceHeader h;
+  if (fread(&h, sizeof(h), 1, fp) != 1 || memcmp(h.magic, "ITRC", 4) != 0 ||
+      h.record_size != sizeof(ItraceRecord)) {
+    fprintf(stderr, "%s is not an instruction trace\n", argv[optind]);
+    return 1;
+  }
+  h.isa[sizeof(h.isa) - 1] = '\0';
+
+  rec = malloc(sizeof(ItraceRecord) * h.nr_record + 1);
+  nr_rec = fread(rec, sizeof(ItraceRecord), h.nr_record, fp);
+  fclose(fp);
+
+  // only render the last N records
+  if (n >= 0 && n < nr_rec) {
+    rec += nr_rec - n;
+    nr_rec = n;
+  }
+
+  offset = malloc(sizeof(uint32_t) * nr_rec + 1);
+  asm_str = calloc(nr_rec + 1, sizeof(char *));
+  uint32_t k, off = 0;
+  for (k = 0; k < nr_rec; k ++) {
+    if (rec[k].len > ITRACE_MAX_LEN) rec[k].len = ITRACE_MAX_LEN;
+    offset[k] = off;
+    off += rec[k].len;
+  }
+
+  disassemble(h.isa);
+
+  // without a disassembler, only the raw bytes are shown
+  for (k = 0; k < nr_rec; k ++) {
+    printf("%8x:   ", rec[k].pc);
+    print_bytes(&rec[k]);
+    printf("%s\n", (asm_str[k] ? asm_str[k] : ""));
+  }
+  return 0;
+}
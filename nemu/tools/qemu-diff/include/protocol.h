@@ -35,4 +35,9 @@ void gdb_send(struct gdb_conn *conn, const uint8_t *command, size_t size);
 
 uint8_t *gdb_recv(struct gdb_conn *conn, size_t *size);
 
+// nonzero if a reply arrives within `timeout_ms', after sending what is queued
+int gdb_poll(struct gdb_conn *conn, int timeout_ms);
+
 const char * gdb_start_noack(struct gdb_conn *conn);
+
+void gdb_report(struct gdb_conn *conn);
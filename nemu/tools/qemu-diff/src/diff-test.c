@@ -5,33 +5,54 @@
 
 bool gdb_connect_qemu(void);
 bool gdb_memcpy_to_qemu(uint32_t, void *, int);
+bool gdb_memcpy_from_qemu(uint32_t, void *, int);
 bool gdb_getregs(union isa_gdb_regs *);
 bool gdb_setregs(union isa_gdb_regs *);
-bool gdb_si(void);
+bool gdb_setreg(int, uint32_t);
+bool gdb_si(uint64_t);
+void gdb_probe_si(void);
 void gdb_exit(void);
 
 void init_isa(void);
 
+// the registers of QEMU, if they are known since the last step
+static union isa_gdb_regs qemu_r;
+static bool qemu_r_valid = false;
+
 void difftest_memcpy_from_dut(paddr_t dest, void *src, size_t n) {
   bool ok = gdb_memcpy_to_qemu(dest, src, n);
   assert(ok == 1);
 }
 
+void difftest_memcpy_to_dut(paddr_t src, void *dest, size_t n) {
+  bool ok = gdb_memcpy_from_qemu(src, dest, n);
+  assert(ok == 1);
+}
+
 void difftest_getregs(void *r) {
-  union isa_gdb_regs qemu_r;
-  gdb_getregs(&qemu_r);
+  if (!qemu_r_valid) {
+    gdb_getregs(&qemu_r);
+    qemu_r_valid = true;
+  }
   memcpy(r, &qemu_r, DIFFTEST_REG_SIZE);
 }
 
 void difftest_setregs(const void *r) {
-  union isa_gdb_regs qemu_r;
-  gdb_getregs(&qemu_r);
-  memcpy(&qemu_r, r, DIFFTEST_REG_SIZE);
-  gdb_setregs(&qemu_r);
+  // only write the registers which are changed, without reading them back
+  const uint32_t *val = r;
+  int i;
+  for (i = 0; i < DIFFTEST_REG_SIZE / sizeof(uint32_t); i ++) {
+    if (!qemu_r_valid || qemu_r.array[i] != val[i]) {
+      gdb_setreg(i, val[i]);
+      qemu_r.array[i] = val[i];
+    }
+  }
 }
 
 void difftest_exec(uint64_t n) {
-  while (n --) gdb_si();
+  bool ok = gdb_si(n);
+  assert(ok);
+  qemu_r_valid = false;
 }
 
 void difftest_init(void) {
@@ -70,5 +91,6 @@ void difftest_init(void) {
     atexit(gdb_exit);
 
     init_isa();
+    gdb_probe_si();
   }
 }
@@ -1,6 +1,51 @@
 #include "common.h"
 
+// replies which may be left unread before waiting for them
+#define MAX_PENDING 256
+// payload of a memory packet, within the packet buffer of QEMU
+#define MTU 1500
+
 static struct gdb_conn *conn;
+// Without acks, packets can be sent before the replies of the earlier
+// ones. A stub in all-stop mode may not take packets while a step runs,
+// e.g. QEMU stops the target on any byte and drops it, so steps are only
+// sent in a batch if a probe at connect shows that each gets its reply.
+static bool noack = false;
+static bool has_X = false;
+static bool batch_si = false;
+static int nr_pending = 0;
+
+// read the replies of the packets sent by send_nowait()
+static void drain(void) {
+  for (; nr_pending > 0; nr_pending --) {
+    size_t size;
+    uint8_t *reply = gdb_recv(conn, &size);
+    assert(size > 0 && reply[0] != 'E');
+    free(reply);
+  }
+}
+
+// send a packet whose reply is only checked for errors,
+// which must not resume the target
+static void send_nowait(const char *buf, size_t len) {
+  gdb_send(conn, (const uint8_t *)buf, len);
+  nr_pending ++;
+  if (!noack || nr_pending >= MAX_PENDING) drain();
+}
+
+static uint8_t* request(const char *buf, size_t len, size_t *size) {
+  gdb_send(conn, (const uint8_t *)buf, len);
+  drain();
+  return gdb_recv(conn, size);
+}
+
+static bool request_ok(const char *buf, size_t len) {
+  size_t size;
+  uint8_t *reply = request(buf, len, &size);
+  bool ok = !strcmp((const char*)reply, "OK");
+  free(reply);
+  return ok;
+}
 
 bool gdb_connect_qemu(void) {
   // connect to gdbserver on localhost port 1234
@@ -8,51 +53,126 @@ bool gdb_connect_qemu(void) {
     usleep(1);
   }
 
+  noack = (gdb_start_noack(conn)[0] != '\0');
+  // an empty binary write tells whether `X' is supported
+  has_X = request_ok("X0,0:", 5);
+  printf("qemu-diff: %s, %s memory writes\n", (noack ? "no-ack mode" : "ack mode"), (has_X ? "binary" : "hex"));
+
   return true;
 }
 
-static bool gdb_memcpy_to_qemu_small(uint32_t dest, void *src, int len) {
+// whether a stop reply is the one of a finished step (SIGTRAP)
+static bool is_step_reply(const uint8_t *reply, size_t size) {
+  return size >= 3 && (reply[0] == 'T' || reply[0] == 'S') &&
+    reply[1] == '0' && reply[2] == '5';
+}
+
+/* Send two steps back to back, and see whether both of them report a
+ * finished step. The steps run from wherever the target is, so this is
+ * done before the state of DUT is copied to it.
+ */
+void gdb_probe_si(void) {
+  if (!noack) return;
+  gdb_send(conn, (const uint8_t *)"vCont;s:1", 9);
+  gdb_send(conn, (const uint8_t *)"vCont;s:1", 9);
+  drain();
+
+  int i, nr_ok = 0;
+  // a dropped step never replies
+  for (i = 0; i < 2 && gdb_poll(conn, 1000); i ++) {
+    size_t size;
+    uint8_t *reply = gdb_recv(conn, &size);
+    nr_ok += is_step_reply(reply, size);
+    free(reply);
+  }
+  batch_si = (nr_ok == 2);
+  printf("qemu-diff: steps are %s\n", (batch_si ? "sent in batches" : "sent one at a time"));
+}
+
+static void gdb_memcpy_to_qemu_small(uint32_t dest, void *src, int len) {
   char *buf = malloc(len * 2 + 128);
   assert(buf != NULL);
-  int p = sprintf(buf, "M0x%x,%x:", dest, len);
-  int i;
-  for (i = 0; i < len; i ++) {
-    p += sprintf(buf + p, "%c%c", hex_encode(((uint8_t *)src)[i] >> 4), hex_encode(((uint8_t *)src)[i] & 0xf));
+  uint8_t *s = src;
+  int p, i;
+  if (has_X) {
+    p = sprintf(buf, "X%x,%x:", dest, len);
+    for (i = 0; i < len; i ++) {
+      uint8_t c = s[i];
+      if (c == '$' || c == '#' || c == '}' || c == '*') {
+        buf[p ++] = '}';
+        c ^= 0x20;
+      }
+      buf[p ++] = c;
+    }
+  }
+  else {
+    p = sprintf(buf, "M%x,%x:", dest, len);
+    for (i = 0; i < len; i ++) {
+      buf[p ++] = hex_encode(s[i] >> 4);
+      buf[p ++] = hex_encode(s[i] & 0xf);
+    }
   }
 
-  gdb_send(conn, (const uint8_t *)buf, strlen(buf));
+  send_nowait(buf, p);
   free(buf);
+}
+
+bool gdb_memcpy_to_qemu(uint32_t dest, void *src, int len) {
+  while (len > MTU) {
+    gdb_memcpy_to_qemu_small(dest, src, MTU);
+    dest += MTU;
+    src += MTU;
+    len -= MTU;
+  }
+  gdb_memcpy_to_qemu_small(dest, src, len);
+  // the writes are checked when the next reply is waited for
+  return true;
+}
 
+static bool gdb_memcpy_from_qemu_reply(void *dest, int len) {
   size_t size;
   uint8_t *reply = gdb_recv(conn, &size);
-  bool ok = !strcmp((const char*)reply, "OK");
+  bool ok = (size == len * 2);
+  int i;
+  for (i = 0; ok && i < len; i ++) {
+    ((uint8_t *)dest)[i] = gdb_decode_hex(reply[i * 2], reply[i * 2 + 1]);
+  }
   free(reply);
 
   return ok;
 }
 
-bool gdb_memcpy_to_qemu(uint32_t dest, void *src, int len) {
-  const int mtu = 1500;
+bool gdb_memcpy_from_qemu(uint32_t src, void *dest, int len) {
   bool ok = true;
-  while (len > mtu) {
-    ok &= gdb_memcpy_to_qemu_small(dest, src, mtu);
-    dest += mtu;
-    src += mtu;
-    len -= mtu;
+  while (len > 0) {
+    // ask for a batch of chunks, then read the replies
+    int batch = (noack ? MAX_PENDING : 1);
+    int n, i;
+    char buf[32];
+    for (n = 0; n < batch && n * MTU < len; n ++) {
+      int l = (len - n * MTU < MTU ? len - n * MTU : MTU);
+      gdb_send(conn, (const uint8_t *)buf, sprintf(buf, "m%x,%x", src + n * MTU, l));
+    }
+    drain();
+    for (i = 0; i < n; i ++) {
+      int l = (len < MTU ? len : MTU);
+      ok &= gdb_memcpy_from_qemu_reply(dest, l);
+      src += l;
+      dest += l;
+      len -= l;
+    }
   }
-  ok &= gdb_memcpy_to_qemu_small(dest, src, len);
   return ok;
 }
 
 bool gdb_getregs(union isa_gdb_regs *r) {
-  gdb_send(conn, (const uint8_t *)"g", 1);
   size_t size;
-  uint8_t *reply = gdb_recv(conn, &size);
+  uint8_t *reply = request("g", 1, &size);
 
   int i;
   uint8_t *p = reply;
   uint8_t c;
-  for (i = 0; i < sizeof(union isa_gdb_regs) / sizeof(uint32_t); i ++) {
+  for (i = 0; i < sizeof(union isa_gdb_regs) / sizeof(uint32_t) && p + 8 <= reply + size; i ++) {
     c = p[8];
     p[8] = '\0';
     r->array[i] = gdb_decode_hex_str(p);
@@ -71,33 +191,59 @@ bool gdb_setregs(union isa_gdb_regs *r) {
   assert(buf != NULL);
   buf[0] = 'G';
 
-  void *src = r;
+  uint8_t *src = (void *)r;
   int p = 1;
   int i;
   for (i = 0; i < len; i ++) {
-    p += sprintf(buf + p, "%c%c", hex_encode(((uint8_t *)src)[i] >> 4), hex_encode(((uint8_t *)src)[i] & 0xf));
+    buf[p ++] = hex_encode(src[i] >> 4);
+    buf[p ++] = hex_encode(src[i] & 0xf);
   }
 
-  gdb_send(conn, (const uint8_t *)buf, strlen(buf));
+  bool ok = request_ok(buf, p);
   free(buf);
 
-  size_t size;
-  uint8_t *reply = gdb_recv(conn, &size);
-  bool ok = !strcmp((const char*)reply, "OK");
-  free(reply);
-
   return ok;
 }
 
-bool gdb_si(void) {
-  char buf[] = "vCont;s:1";
-  gdb_send(conn, (const uint8_t *)buf, strlen(buf));
-  size_t size;
-  uint8_t *reply = gdb_recv(conn, &size);
-  free(reply);
+// write a single register without waiting for the reply
+bool gdb_setreg(int no, uint32_t val) {
+  char buf[32];
+  uint8_t *v = (void *)&val;
+  int p = sprintf(buf, "P%x=", no);
+  int i;
+  for (i = 0; i < sizeof(val); i ++) {
+    buf[p ++] = hex_encode(v[i] >> 4);
+    buf[p ++] = hex_encode(v[i] & 0xf);
+  }
+  send_nowait(buf, p);
   return true;
 }
 
+// single step `n' times, in batches if the stub takes them,
+// and check that each step gets its stop reply
+bool gdb_si(uint64_t n) {
+  bool ok = true;
+  while (n > 0) {
+    int batch = (!batch_si ? 1 : (n < MAX_PENDING ? n : MAX_PENDING));
+    int i;
+    for (i = 0; i < batch; i ++) {
+      gdb_send(conn, (const uint8_t *)"vCont;s:1", 9);
+    }
+    // the replies of the packets before come first
+    drain();
+    for (i = 0; i < batch; i ++) {
+      size_t size;
+      uint8_t *reply = gdb_recv(conn, &size);
+      ok &= is_step_reply(reply, size);
+      free(reply);
+    }
+    n -= batch;
+  }
+  return ok;
+}
+
 void gdb_exit(void) {
+  drain();
+  gdb_report(conn);
   gdb_end(conn);
 }
@@ -20,20 +20,39 @@
 #include "common.h"
 #include <ctype.h>
 #include <err.h>
+#include <errno.h>
 #include <stdbool.h>
+#include <time.h>
 
 #include <arpa/inet.h>
 
 #include <netinet/in.h>
 #include <netinet/tcp.h>
 
+#include <poll.h>
 #include <sys/socket.h>
 #include <sys/types.h>
 
+#define IN_SIZE (64 * 1024)
+#define OUT_FLUSH_SIZE (64 * 1024)
+
+// Packets are written into `out', which is only sent when a reply is
+// waited for, so that packets whose replies are read later go out
+// together.  Replies are read from the socket into `in' in bulk.
 struct gdb_conn {
-  FILE *in;
-  FILE *out;
+  int fd;
   bool ack;
+
+  uint8_t in[IN_SIZE];
+  size_t in_pos, in_len;
+
+  uint8_t *out;
+  size_t out_len, out_size;
+
+  // statistics
+  uint64_t nr_packet, nr_wait;
+  uint64_t wait_ns, max_wait_ns;
+  uint64_t bytes_out, bytes_in;
 };
 
 
@@ -63,32 +82,75 @@ uint64_t gdb_decode_hex_str(uint8_t *bytes) {
   return value;
 }
 
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void conn_flush(struct gdb_conn *conn) {
+  size_t done = 0;
+  while (done < conn->out_len) {
+    ssize_t n = write(conn->fd, conn->out + done, conn->out_len - done);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      err(1, "send");
+    }
+    done += n;
+  }
+  conn->bytes_out += conn->out_len;
+  conn->out_len = 0;
+}
+
+static void conn_write(struct gdb_conn *conn, const void *p, size_t n) {
+  if (conn->out_len + n > conn->out_size) {
+    while (conn->out_len + n > conn->out_size)
+      conn->out_size *= 2;
+    conn->out = realloc(conn->out, conn->out_size);
+    if (conn->out == NULL)
+      err(1, "realloc");
+  }
+  memcpy(conn->out + conn->out_len, p, n);
+  conn->out_len += n;
+}
+
+// return the next character received, or EOF
+static int conn_getc(struct gdb_conn *conn) {
+  if (conn->in_pos == conn->in_len) {
+    // everything sent may be waiting for its reply
+    conn_flush(conn);
+
+    ssize_t n;
+    while ((n = read(conn->fd, conn->in, IN_SIZE)) < 0) {
+      if (errno != EINTR)
+        err(1, "recv");
+    }
+    if (n == 0)
+      return EOF;
+    conn->bytes_in += n;
+    conn->in_pos = 0;
+    conn->in_len = n;
+  }
+  return conn->in[conn->in_pos++];
+}
+
 
 static struct gdb_conn* gdb_begin(int fd) {
-  struct gdb_conn *conn = calloc(1, sizeof(struct gdb_conn *));
+  struct gdb_conn *conn = calloc(1, sizeof(struct gdb_conn));
   if (conn == NULL)
     err(1, "calloc");
 
+  conn->fd = fd;
   conn->ack = true;
-
-  // duplicate the handle to separate read/write state
-  int fd2 = dup(fd);
-  if (fd2 < 0)
-    err(1, "dup");
-
-  // open a FILE* for reading
-  conn->in = fdopen(fd, "rb");
-  if (conn->in == NULL)
-    err(1, "fdopen");
-
-  // open a FILE* for writing
-  conn->out = fdopen(fd2, "wb");
+  conn->out_size = 4096;
+  conn->out = malloc(conn->out_size);
   if (conn->out == NULL)
-    err(1, "fdopen");
+    err(1, "malloc");
 
   // reset line state by acking any earlier input
-  fputc('+', conn->out);
-  fflush(conn->out);
+  conn_write(conn, "+", 1);
+  conn_flush(conn);
 
   return conn;
 }
@@ -131,12 +193,13 @@ struct gdb_conn* gdb_begin_inet(const char *addr, uint16_t port) {
 
 
 void gdb_end(struct gdb_conn *conn) {
-  fclose(conn->in);
-  fclose(conn->out);
+  conn_flush(conn);
+  close(conn->fd);
+  free(conn->out);
   free(conn);
 }
 
-static void send_packet(FILE *out, const uint8_t *command, size_t size) {
+static void send_packet(struct gdb_conn *conn, const uint8_t *command, size_t size) {
   // compute the checksum -- simple mod256 addition
   uint8_t sum = 0;
   size_t i;
@@ -147,31 +210,31 @@ static void send_packet(FILE *out, const uint8_t *command, size_t size) {
   // gdbserver.  e.g. giving "invalid hex digit" on an RLE'd address.
   // So just write raw here, and maybe let higher levels escape/RLE.
 
-  fputc('$', out); // packet start
-  fwrite(command, 1, size, out); // payload
-  fprintf(out, "#%02X", sum); // packet end, checksum
-  fflush(out);
+  char tail[4];
+  sprintf(tail, "#%02X", sum);
+  conn_write(conn, "$", 1); // packet start
+  conn_write(conn, command, size); // payload
+  conn_write(conn, tail, 3); // packet end, checksum
+  conn->nr_packet++;
 
-  if (ferror(out))
-    err(1, "send");
-  else if (feof(out))
-    errx(0, "send: Connection closed");
+  if (conn->out_len >= OUT_FLUSH_SIZE)
+    conn_flush(conn);
 }
 
 void gdb_send(struct gdb_conn *conn, const uint8_t *command, size_t size) {
   bool acked = false;
   do {
-    send_packet(conn->out, command, size);
+    send_packet(conn, command, size);
 
     if (!conn->ack)
       break;
 
     // look for '+' ACK or '-' NACK/resend
-    acked = fgetc(conn->in) == '+';
+    acked = conn_getc(conn) == '+';
   } while (!acked);
 }
 
-static uint8_t* recv_packet(FILE *in, size_t *ret_size, bool* ret_sum_ok) {
+static uint8_t* recv_packet(struct gdb_conn *conn, size_t *ret_size, bool* ret_sum_ok) {
   size_t i = 0;
   size_t size = 4096;
   uint8_t *reply = malloc(size);
@@ -182,10 +245,13 @@ static uint8_t* recv_packet(FILE *in, size_t *ret_size, bool* ret_sum_ok) {
   uint8_t sum = 0;
   bool escape = false;
 
+  // a round trip if the reply has not arrived with an earlier one
+  uint64_t start = (conn->in_pos == conn->in_len ? now_ns() : 0);
+
   // fast-forward to the first start of packet
-  while ((c = fgetc(in)) != EOF && c != '$');
+  while ((c = conn_getc(conn)) != EOF && c != '$');
 
-  while ((c = fgetc(in)) != EOF) {
+  while ((c = conn_getc(conn)) != EOF) {
     sum += c;
     switch (c) {
       case '$': // new packet?  start over...
@@ -197,8 +263,8 @@ static uint8_t* recv_packet(FILE *in, size_t *ret_size, bool* ret_sum_ok) {
       case '#': // end of packet
         sum -= c; // not part of the checksum
         {
-          uint8_t msb = fgetc(in);
-          uint8_t lsb = fgetc(in);
+          uint8_t msb = conn_getc(conn);
+          uint8_t lsb = conn_getc(conn);
           *ret_sum_ok = sum == gdb_decode_hex(msb, lsb);
         }
         *ret_size = i;
@@ -211,6 +277,14 @@ static uint8_t* recv_packet(FILE *in, size_t *ret_size, bool* ret_sum_ok) {
         }
         reply[i] = '\0';
 
+        if (start != 0) {
+          uint64_t t = now_ns() - start;
+          conn->nr_wait++;
+          conn->wait_ns += t;
+          if (t > conn->max_wait_ns)
+            conn->max_wait_ns = t;
+        }
+
         return reply;
 
       case '}': // escape: next char is XOR 0x20
@@ -224,10 +298,10 @@ static uint8_t* recv_packet(FILE *in, size_t *ret_size, bool* ret_sum_ok) {
         // The count character can't be >126 or '$'/'#' packet markers.
 
         if (i > 0) { // need something to repeat!
-          int c2 = fgetc(in);
+          int c2 = conn_getc(conn);
           if (c2 < 29 || c2 > 126 || c2 == '$' || c2 == '#') {
             // invalid count character!
-            ungetc(c2, in);
+            conn->in_pos--;
           } else {
             int count = c2 - 29;
 
@@ -266,31 +340,39 @@ static uint8_t* recv_packet(FILE *in, size_t *ret_size, bool* ret_sum_ok) {
     reply[i++] = c;
   }
 
-  if (ferror(in))
-    err(1, "recv");
-  else if (feof(in))
-    errx(0, "recv: Connection closed");
-  else
-    errx(1, "recv: Unknown connection error");
+  errx(0, "recv: Connection closed");
 }
 
 uint8_t* gdb_recv(struct gdb_conn *conn, size_t *size) {
   uint8_t *reply;
   bool acked = false;
   do {
-    reply = recv_packet(conn->in, size, &acked);
+    reply = recv_packet(conn, size, &acked);
 
     if (!conn->ack)
       break;
 
     // send +/- depending on checksum result, retry if needed
-    fputc(acked ? '+' : '-', conn->out);
-    fflush(conn->out);
+    conn_write(conn, acked ? "+" : "-", 1);
+    conn_flush(conn);
   } while (!acked);
 
   return reply;
 }
 
+int gdb_poll(struct gdb_conn *conn, int timeout_ms) {
+  if (conn->in_pos != conn->in_len)
+    return true;
+  conn_flush(conn);
+  struct pollfd pfd = { .fd = conn->fd, .events = POLLIN };
+  int r;
+  while ((r = poll(&pfd, 1, timeout_ms)) < 0) {
+    if (errno != EINTR)
+      err(1, "poll");
+  }
+  return r > 0;
+}
+
 const char* gdb_start_noack(struct gdb_conn *conn) {
   static const char cmd[] = "QStartNoAckMode";
   gdb_send(conn, (const uint8_t *)cmd, sizeof(cmd) - 1);
@@ -304,3 +386,11 @@ const char* gdb_start_noack(struct gdb_conn *conn) {
     conn->ack = false;
   return ok ? "OK" : "";
 }
+
+void gdb_report(struct gdb_conn *conn) {
+  printf("qemu-diff: %lu packets, %lu round trips, latency avg %.1f us, max %.1f us, "
+      "%lu bytes sent, %lu bytes received\n",
+      conn->nr_packet, conn->nr_wait,
+      (conn->nr_wait ? conn->wait_ns / 1000.0 / conn->nr_wait : 0.0), conn->max_wait_ns / 1000.0,
+      conn->bytes_out, conn->bytes_in);
+}
@@ -23,6 +23,9 @@ extern "C" {
 
 // ================= Device Register Specifications ==================
 
+_AM_DEVREG(PERFCNT, COUNT, 1, uint64_t instr, cycle, load, store, branch,
+                              icache_miss, dcache_miss, tlb_miss);
+_AM_DEVREG(PERFCNT, INFO,  2, int has_cache, has_tlb);
 _AM_DEVREG(INPUT,  KBD,    1, int keydown, keycode);
 _AM_DEVREG(TIMER,  UPTIME, 1, uint32_t hi, lo);
 _AM_DEVREG(TIMER,  DATE,   2, int year, month, day, hour, minute, second);
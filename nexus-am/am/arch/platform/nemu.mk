@@ -3,12 +3,18 @@ AM_SRCS := nemu-common/trm.c \
            nemu-common/nemu-input.c \
            nemu-common/nemu-timer.c \
            nemu-common/nemu-video.c \
+           nemu-common/nemu-perfcnt.c \
            $(ISA)/nemu/cte.c \
            $(ISA)/nemu/trap.S \
            $(ISA)/nemu/vme.c \
-           dummy/mpe.c \
            $(ISA)/nemu/boot/start.S
 
+ifeq ($(ISA), mips32)
+AM_SRCS += dummy/mpe.c
+else
+AM_SRCS += nemu-common/mpe.c
+endif
+
 LD_SCRIPT := $(AM_HOME)/am/src/$(ISA)/nemu/boot/loader.ld
 
 ifdef mainargs
@@ -19,6 +19,8 @@
 # define RTC_ADDR     0x48
 # define SCREEN_ADDR  0x100
 # define SYNC_ADDR    0x104
+# define PERFCNT_ADDR 0x200
+# define MPE_ADDR     0x300
 # define FB_ADDR      0xa0000000
 #else
 # define SERIAL_PORT  0xa10003f8
@@ -26,6 +28,8 @@
 # define RTC_ADDR     0xa1000048
 # define SCREEN_ADDR  0xa1000100
 # define SYNC_ADDR    0xa1000104
+# define PERFCNT_ADDR 0xa1000200
+# define MPE_ADDR     0xa1000300
 # define FB_ADDR      0xa0000000
 #endif
 
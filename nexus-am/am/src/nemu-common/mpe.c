@@ -0,0 +1,47 @@
+#include <am.h>
+#include <nemu.h>
+
+#define NCPU_OFFSET  0
+#define CPU_OFFSET   4
+#define START_OFFSET 8
+#define STOP_OFFSET  12
+
+static void (*mpe_entry)() = NULL;
+
+// called by _mpe_start on the stack of the CPU
+void __am_mpe_main() {
+  mpe_entry();
+  // nothing left to do on this CPU
+  outl(MPE_ADDR + STOP_OFFSET, 0);
+  while (1);
+}
+
+int _mpe_init(void (*entry)()) {
+  extern char _mpe_start;
+  mpe_entry = entry;
+  outl(MPE_ADDR + START_OFFSET, (uintptr_t)&_mpe_start);
+  entry();
+  return 1;
+}
+
+int _ncpu() {
+  return inl(MPE_ADDR + NCPU_OFFSET);
+}
+
+int _cpu() {
+  return inl(MPE_ADDR + CPU_OFFSET);
+}
+
+intptr_t _atomic_xchg(volatile intptr_t *addr, intptr_t newval) {
+  intptr_t result;
+#if defined(__ISA_X86__)
+  asm volatile ("lock xchg %0, %1":
+    "+m"(*addr), "=a"(result) : "1"(newval) : "cc");
+#elif defined(__ISA_RISCV32__)
+  asm volatile ("amoswap.w.aqrl %0, %2, %1":
+    "=r"(result), "+A"(*addr) : "r"(newval) : "memory");
+#else
+# error unsupported ISA __ISA__
+#endif
+  return result;
+}
@@ -0,0 +1,39 @@
+#include <am.h>
+#include <amdev.h>
+#include <nemu.h>
+
+#define CTRL_OFFSET 0
+#define CNT_OFFSET 8
+
+static inline uint64_t read_cnt(int i) {
+  uint32_t lo = inl(PERFCNT_ADDR + CNT_OFFSET + i * 8);
+  uint32_t hi = inl(PERFCNT_ADDR + CNT_OFFSET + i * 8 + 4);
+  return ((uint64_t)hi << 32) | lo;
+}
+
+size_t __am_perfcnt_read(uintptr_t reg, void *buf, size_t size) {
+  switch (reg) {
+    case _DEVREG_PERFCNT_COUNT: {
+      _DEV_PERFCNT_COUNT_t *cnt = (_DEV_PERFCNT_COUNT_t *)buf;
+      // latch all counters, then read them out
+      outl(PERFCNT_ADDR + CTRL_OFFSET, 0);
+      cnt->instr       = read_cnt(0);
+      cnt->cycle       = read_cnt(1);
+      cnt->load        = read_cnt(2);
+      cnt->store       = read_cnt(3);
+      cnt->branch      = read_cnt(4);
+      cnt->icache_miss = read_cnt(5);
+      cnt->dcache_miss = read_cnt(6);
+      cnt->tlb_miss    = read_cnt(7);
+      return sizeof(_DEV_PERFCNT_COUNT_t);
+    }
+    case _DEVREG_PERFCNT_INFO: {
+      _DEV_PERFCNT_INFO_t *info = (_DEV_PERFCNT_INFO_t *)buf;
+      uint32_t flags = inl(PERFCNT_ADDR + CTRL_OFFSET);
+      info->has_cache = (flags & 0x1) != 0;
+      info->has_tlb = (flags & 0x2) != 0;
+      return sizeof(_DEV_PERFCNT_INFO_t);
+    }
+  }
+  return 0;
+}
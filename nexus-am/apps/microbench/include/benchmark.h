@@ -92,6 +92,8 @@ extern Setting *setting;
 typedef struct Result {
   int pass;
   unsigned long tsc, msec;
+  int has_perfcnt;
+  uint64_t instr, cycle;
 } Result;
 
 void prepare(Result *res);
@@ -1,4 +1,5 @@
 #include <am.h>
+#include <amdev.h>
 #include <benchmark.h>
 #include <limits.h>
 
@@ -26,6 +27,10 @@ Benchmark benchmarks[] = {
 
 // Running a benchmark
 static void bench_prepare(Result *res) {
+  _DEV_PERFCNT_COUNT_t cnt = {0};
+  res->has_perfcnt = _io_read(_DEV_PERFCNT, _DEVREG_PERFCNT_COUNT, &cnt, sizeof(cnt)) != 0;
+  res->instr = cnt.instr;
+  res->cycle = cnt.cycle;
   res->msec = uptime();
 }
 
@@ -35,6 +40,24 @@ static void bench_reset() {
 
 static void bench_done(Result *res) {
   res->msec = uptime() - res->msec;
+  if (res->has_perfcnt) {
+    _DEV_PERFCNT_COUNT_t cnt;
+    _io_read(_DEV_PERFCNT, _DEVREG_PERFCNT_COUNT, &cnt, sizeof(cnt));
+    res->instr = cnt.instr - res->instr;
+    res->cycle = cnt.cycle - res->cycle;
+  }
+}
+
+// print the instructions and CPI without 64-bit division
+static void print_perfcnt(Result *res) {
+  uint64_t instr = res->instr, cycle = res->cycle;
+  printf("  instrs: %d K", (unsigned int)(instr >> 10));
+  while (instr >> 24) { instr >>= 1; cycle >>= 1; }
+  if (instr != 0) {
+    unsigned int cpi = (uint32_t)cycle * 100 / (uint32_t)instr;
+    printf(", CPI: %d.%d%d", cpi / 100, cpi / 10 % 10, cpi % 10);
+  }
+  printf("\n");
 }
 
 static const char *bench_check(Benchmark *bench) {
@@ -95,12 +118,13 @@ int main(const char *args) {
     } else {
       unsigned long msec = ULONG_MAX;
       int succ = 1;
+      Result best;
       for (int i = 0; i < REPEAT; i ++) {
         Result res;
         run_once(bench, &res);
         printf(res.pass ? "*" : "X");
         succ &= res.pass;
-        if (res.msec < msec) msec = res.msec;
+        if (res.msec < msec) { msec = res.msec; best = res; }
       }
 
       if (succ) printf(" Passed.");
@@ -113,6 +137,7 @@ int main(const char *args) {
       printf("\n");
       if (setting_id != 0) {
         printf("  min time: %d ms [%d]\n", (unsigned int)msec, (unsigned int)cur);
+        if (best.has_perfcnt) print_perfcnt(&best);
       }
 
       bench_score += cur;
@@ -8,6 +8,7 @@ static const char *tests[256] = {
   ['i'] = "interrupt/yield test",
   ['d'] = "scan devices",
   ['m'] = "multiprocessor test",
+  ['l'] = "spin lock test",
   ['t'] = "real-time clock test",
   ['k'] = "readkey test",
   ['v'] = "display test",
@@ -20,6 +21,7 @@ int main(const char *args) {
     CASE('i', hello_intr, IOE, CTE(simple_trap));
     CASE('d', devscan, IOE);
     CASE('m', mp_print, MPE);
+    CASE('l', spinlock_test, MPE);
     CASE('t', rtc_test, IOE);
     CASE('k', keyboard_test, IOE);
     CASE('v', video_test, IOE);
@@ -0,0 +1,45 @@
+#include <amtest.h>
+
+#define N 10000
+
+static volatile intptr_t lk = 0;
+static volatile int count = 0, nr_done = 0;
+
+static void lock() {
+#if defined(__ISA_RISCV32__)
+  intptr_t tmp;
+  asm volatile (
+    "1: lr.w.aq %0, %1\n"
+    "   bnez %0, 1b\n"
+    "   sc.w %0, %2, %1\n"
+    "   bnez %0, 1b\n"
+    : "=&r"(tmp), "+A"(lk) : "r"(1) : "memory");
+#else
+  while (_atomic_xchg(&lk, 1));
+#endif
+}
+
+static void unlock() {
+#if defined(__ISA_RISCV32__)
+  asm volatile ("amoswap.w.rl zero, zero, %0" : "+A"(lk) : : "memory");
+#else
+  _atomic_xchg(&lk, 0);
+#endif
+}
+
+void spinlock_test() {
+  for (int i = 0; i < N; i ++) {
+    lock();
+    count ++;
+    unlock();
+  }
+
+  lock();
+  nr_done ++;
+  unlock();
+  if (_cpu() != 0) return;
+
+  while (nr_done != _ncpu());
+  printf("%d CPUs, count = %d, expected %d\n", _ncpu(), count, N * _ncpu());
+  _halt(count != N * _ncpu());
+}